@@ -0,0 +1,40 @@
+#include "pch.h"
+#include "Systemic/BluetoothLE/BleBackend.h"
+
+#include <stdexcept>
+
+#ifdef _WIN32
+#include "Systemic/BluetoothLE/WinRTBackend.h"
+#endif
+
+namespace Systemic::BluetoothLE
+{
+    namespace
+    {
+        // The backend set by the user, replaced as a whole with std::atomic_store()
+        std::shared_ptr<BleBackend>& userBackend()
+        {
+            static std::shared_ptr<BleBackend> backend{};
+            return backend;
+        }
+    }
+
+    std::shared_ptr<BleBackend> BleBackend::getDefault()
+    {
+        auto backend = std::atomic_load(&userBackend());
+        if (!backend)
+        {
+#ifdef _WIN32
+            backend = WinRTBackend::instance();
+#else
+            throw std::runtime_error{ "No Bluetooth backend on this platform, set one with BleBackend::setDefault()" };
+#endif
+        }
+        return backend;
+    }
+
+    void BleBackend::setDefault(std::shared_ptr<BleBackend> backend)
+    {
+        std::atomic_store(&userBackend(), std::move(backend));
+    }
+}
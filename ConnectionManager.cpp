@@ -0,0 +1,332 @@
+#include "pch.h"
+#include "Systemic/Pixels/ConnectionManager.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace Systemic::Pixels
+{
+    ConnectionManager::~ConnectionManager()
+    {
+        std::lock_guard lock{ _mutex };
+
+        for (auto& [address, entry] : _entries)
+        {
+            if (entry.retryTimerId)
+            {
+                Internal::TimerQueue::instance().cancel(entry.retryTimerId);
+            }
+        }
+    }
+
+    std::shared_ptr<Pixel> ConnectionManager::add(const ScannedPixel& scannedPixel)
+    {
+        std::shared_ptr<Pixel> pixel{};
+        {
+            std::lock_guard lock{ _mutex };
+
+            auto& entry = _entries[scannedPixel.address()];
+            if (!entry.pixel)
+            {
+                entry.pixel = Pixel::create(scannedPixel, _delegate);
+                entry.pixel->setFastIdentifyMaxAge(_options.fastIdentifyMaxAge);
+            }
+            queue(entry, scannedPixel.rssi());
+            pixel = entry.pixel;
+        }
+        schedule();
+        return pixel;
+    }
+
+    void ConnectionManager::add(const std::shared_ptr<Pixel>& pixel, int rssi)
+    {
+        if (!pixel)
+        {
+            return;
+        }
+
+        {
+            std::lock_guard lock{ _mutex };
+
+            auto& entry = _entries[pixel->address()];
+            entry.pixel = pixel;
+            queue(entry, rssi);
+        }
+        schedule();
+    }
+
+    bool ConnectionManager::remove(const std::shared_ptr<Pixel>& pixel)
+    {
+        std::vector<Internal::AwaitableResult<bool>> idleWaiters{};
+        {
+            std::lock_guard lock{ _mutex };
+
+            const auto it = pixel ? _entries.find(pixel->address()) : _entries.end();
+            if (it == _entries.end() || it->second.pixel != pixel)
+            {
+                return false;
+            }
+            if (it->second.retryTimerId)
+            {
+                Internal::TimerQueue::instance().cancel(it->second.retryTimerId);
+            }
+            _entries.erase(it);
+            idleWaiters = takeIdleWaitersIfIdle();
+        }
+
+        for (auto& waiter : idleWaiters)
+        {
+            waiter.trySetResult(true);
+        }
+        return true;
+    }
+
+    std::vector<std::shared_ptr<Pixel>> ConnectionManager::pixels() const
+    {
+        std::lock_guard lock{ _mutex };
+
+        std::vector<std::shared_ptr<Pixel>> pixels{};
+        pixels.reserve(_entries.size());
+        for (auto& [address, entry] : _entries)
+        {
+            pixels.push_back(entry.pixel);
+        }
+        return pixels;
+    }
+
+    std::future<void> ConnectionManager::waitIdleAsync()
+    {
+        Internal::AwaitableResult<bool> idle{};
+        std::vector<Internal::AwaitableResult<bool>> idleWaiters{};
+        {
+            std::lock_guard lock{ _mutex };
+
+            _idleWaiters.push_back(idle);
+            idleWaiters = takeIdleWaitersIfIdle();
+        }
+
+        for (auto& waiter : idleWaiters)
+        {
+            waiter.trySetResult(true);
+        }
+        return Internal::toVoidFuture(idle);
+    }
+
+    ConnectionManagerStats ConnectionManager::stats() const
+    {
+        std::lock_guard lock{ _mutex };
+
+        auto stats = _stats;
+        for (auto& [address, entry] : _entries)
+        {
+            switch (entry.state)
+            {
+            case EntryState::Pending:
+                ++stats.pendingCount;
+                break;
+            case EntryState::Connecting:
+                ++stats.connectingCount;
+                break;
+            case EntryState::Connected:
+                ++stats.connectedCount;
+                break;
+            case EntryState::Stopped:
+                break;
+            }
+        }
+        return stats;
+    }
+
+    void ConnectionManager::queue(Entry& entry, int rssi)
+    {
+        entry.rssi = rssi;
+
+        // Don't interfere with an ongoing attempt or a scheduled retry
+        const bool isIdle = entry.state == EntryState::Stopped
+            || (entry.state == EntryState::Connected && entry.pixel->status() == PixelStatus::Disconnected);
+        if (isIdle)
+        {
+            entry.state = EntryState::Pending;
+            entry.failedAttempts = 0;
+            entry.readyTime = Clock::now();
+        }
+    }
+
+    void ConnectionManager::schedule()
+    {
+        std::vector<std::shared_ptr<Pixel>> toConnect{};
+        {
+            std::lock_guard lock{ _mutex };
+
+            size_t connectingCount = 0;
+            std::vector<Entry*> ready{};
+            for (auto& [address, entry] : _entries)
+            {
+                if (entry.state == EntryState::Connecting)
+                {
+                    ++connectingCount;
+                }
+                else if (entry.state == EntryState::Pending && !entry.retryTimerId)
+                {
+                    ready.push_back(&entry);
+                }
+            }
+
+            const auto maxConnects = std::max<size_t>(_options.maxConcurrentConnects, 1);
+            if (connectingCount >= maxConnects || ready.empty())
+            {
+                return;
+            }
+
+            // Strongest signal first
+            const size_t count = std::min(maxConnects - connectingCount, ready.size());
+            std::partial_sort(ready.begin(), ready.begin() + count, ready.end(),
+                [](const Entry* e1, const Entry* e2) { return e1->rssi > e2->rssi; });
+
+            const auto now = Clock::now();
+            for (size_t i = 0; i < count; ++i)
+            {
+                auto& entry = *ready[i];
+                entry.state = EntryState::Connecting;
+                _stats.queueWait.add(now - entry.readyTime);
+                ++_stats.attempts;
+                toConnect.push_back(entry.pixel);
+            }
+        }
+
+        for (auto& pixel : toConnect)
+        {
+            connectAsync(pixel);
+        }
+    }
+
+    Internal::DetachedTask ConnectionManager::connectAsync(std::shared_ptr<Pixel> pixel)
+    {
+        // Keep this instance alive until the attempt completes
+        const auto self = shared_from_this();
+
+        auto result = Pixel::ConnectResult::ConnectionFailed;
+        try
+        {
+            result = co_await pixel->requestConnect(_options.autoReconnect).waitAsync();
+        }
+        catch (...)
+        {
+            // Counted as a failed attempt
+        }
+        const auto timings = pixel->lastConnectTimings();
+
+        std::vector<Internal::AwaitableResult<bool>> idleWaiters{};
+        {
+            std::lock_guard lock{ _mutex };
+
+            if (timings.connect.count())
+            {
+                _stats.connect.add(timings.connect);
+            }
+            if (timings.identify.count())
+            {
+                _stats.identify.add(timings.identify);
+            }
+
+            const bool success = result == Pixel::ConnectResult::Success;
+            if (success)
+            {
+                ++_stats.successes;
+                _stats.total.add(timings.total);
+            }
+            else
+            {
+                ++_stats.failures;
+            }
+
+            const auto it = _entries.find(pixel->address());
+            if (it != _entries.end() && it->second.pixel == pixel)
+            {
+                auto& entry = it->second;
+                if (success)
+                {
+                    entry.state = EntryState::Connected;
+                    entry.failedAttempts = 0;
+                }
+                else if (result == Pixel::ConnectResult::Cancelled || result == Pixel::ConnectResult::IdentificationMismatch)
+                {
+                    // Connection was canceled on purpose or it's another die, don't retry
+                    entry.state = EntryState::Stopped;
+                }
+                else if (_options.maxAttempts > 0 && ++entry.failedAttempts >= _options.maxAttempts)
+                {
+                    entry.state = EntryState::Stopped;
+                    ++_stats.gaveUp;
+                }
+                else
+                {
+                    if (_options.maxAttempts <= 0)
+                    {
+                        ++entry.failedAttempts;
+                    }
+                    const auto backoff = nextBackoff(entry.failedAttempts);
+                    entry.state = EntryState::Pending;
+                    entry.readyTime = Clock::now() + backoff;
+                    entry.retryTimerId = Internal::TimerQueue::instance().schedule(backoff,
+                        [weakSelf = weak_from_this(), pixel]()
+                        {
+                            if (auto self = weakSelf.lock())
+                            {
+                                {
+                                    std::lock_guard lock{ self->_mutex };
+                                    const auto it = self->_entries.find(pixel->address());
+                                    if (it == self->_entries.end() || it->second.pixel != pixel)
+                                    {
+                                        return;
+                                    }
+                                    it->second.retryTimerId = {};
+                                }
+                                self->schedule();
+                            }
+                        });
+                }
+            }
+
+            idleWaiters = takeIdleWaitersIfIdle();
+        }
+
+        for (auto& waiter : idleWaiters)
+        {
+            waiter.trySetResult(true);
+        }
+
+        // Start the next connection
+        schedule();
+    }
+
+    std::chrono::milliseconds ConnectionManager::nextBackoff(int failedAttempts)
+    {
+        const double initial = static_cast<double>(_options.initialBackoff.count());
+        const double maxBackoff = static_cast<double>(std::max(_options.maxBackoff, _options.initialBackoff).count());
+        const double multiplier = std::max(_options.backoffMultiplier, 1.0);
+        double backoff = std::min(initial * std::pow(multiplier, std::max(failedAttempts - 1, 0)), maxBackoff);
+
+        const double jitter = std::clamp(_options.jitter, 0.0, 1.0);
+        if (jitter > 0)
+        {
+            std::uniform_real_distribution<double> distribution{ -jitter, jitter };
+            backoff *= 1 + distribution(_random);
+        }
+        return std::chrono::milliseconds{ static_cast<int64_t>(std::max(backoff, 0.0)) };
+    }
+
+    std::vector<Internal::AwaitableResult<bool>> ConnectionManager::takeIdleWaitersIfIdle()
+    {
+        for (auto& [address, entry] : _entries)
+        {
+            if (entry.state == EntryState::Pending || entry.state == EntryState::Connecting)
+            {
+                return {};
+            }
+        }
+        std::vector<Internal::AwaitableResult<bool>> idleWaiters{};
+        idleWaiters.swap(_idleWaiters);
+        return idleWaiters;
+    }
+}
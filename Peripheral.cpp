@@ -3,21 +3,18 @@
 #include "Systemic/BluetoothLE/Service.h"
 #include "Systemic/BluetoothLE/Characteristic.h"
 
-using namespace winrt::Windows::Devices::Bluetooth;
-using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
-
 namespace Systemic::BluetoothLE
 {
     namespace
     {
-        // Converts a WinRT GattCommunicationStatus to a ConnectionEventReason
-        inline ConnectionEventReason toReason(GattCommunicationStatus gattStatus)
+        // Converts the status of a services discovery to a ConnectionEventReason
+        inline ConnectionEventReason toReason(BleRequestStatus discoveryStatus)
         {
-            switch (gattStatus)
+            switch (discoveryStatus)
             {
-            case GattCommunicationStatus::Success:
+            case BleRequestStatus::Success:
                 return ConnectionEventReason::Success;
-            case GattCommunicationStatus::Unreachable:
+            case BleRequestStatus::Timeout:
                 return ConnectionEventReason::Timeout;
             default:
                 assert(false);
@@ -25,6 +22,56 @@ namespace Systemic::BluetoothLE
             }
         }
 
+        // Gets the layout of the discovered services
+        std::vector<DiscoveredServiceLayout> toLayout(const BleDiscoveryResult& discovery)
+        {
+            std::vector<DiscoveredServiceLayout> layout{};
+            layout.reserve(discovery.services.size());
+            for (auto& discovered : discovery.services)
+            {
+                auto& service = layout.emplace_back();
+                service.uuid = discovered->uuid();
+                const auto characteristics = discovered->characteristics();
+                service.characteristics.reserve(characteristics.size());
+                for (auto& characteristic : characteristics)
+                {
+                    service.characteristics.emplace_back(characteristic->uuid());
+                }
+            }
+            return layout;
+        }
+
+        // Checks that the discovered services have the same layout as the cached ones and include the required services
+        bool matchesLayout(
+            const BleDiscoveryResult& discovery,
+            const std::vector<DiscoveredServiceLayout>& cachedLayout,
+            const std::vector<BleUuid>& requiredServices,
+            bool isPartialDiscovery)
+        {
+            if (discovery.status != BleRequestStatus::Success || discovery.services.empty())
+            {
+                return false;
+            }
+            if (!isPartialDiscovery && discovery.services.size() != cachedLayout.size())
+            {
+                return false;
+            }
+
+            std::vector<BleUuid> servicesUuids{};
+            servicesUuids.reserve(discovery.services.size());
+            for (auto& service : toLayout(discovery))
+            {
+                auto it = std::find_if(cachedLayout.begin(), cachedLayout.end(),
+                    [&service](const auto& s) { return s.uuid == service.uuid; });
+                if ((it == cachedLayout.end()) || (it->characteristics != service.characteristics))
+                {
+                    return false;
+                }
+                servicesUuids.emplace_back(service.uuid);
+            }
+            return Internal::isSubset(requiredServices, std::move(servicesUuids));
+        }
+
         // Converts a ConnectionEventReason to a BleRequestStatus
         inline BleRequestStatus toRequestStatus(ConnectionEventReason reason)
         {
@@ -44,9 +91,10 @@ namespace Systemic::BluetoothLE
         }
     }
 
-    std::future<BleRequestStatus> Peripheral::connectAsync(
-        std::vector<winrt::guid> requiredServices /*= std::vector<winrt::guid>{}*/,
-        bool maintainConnection /*= false*/)
+    Systemic::Internal::AwaitableResult<BleRequestStatus> Peripheral::requestConnect(
+        std::vector<BleUuid> requiredServices /*= std::vector<BleUuid>{}*/,
+        bool maintainConnection /*= false*/,
+        DiscoveryOptions discoveryOptions /*= {}*/)
     {
         // TODO return error code => GattProtocolError
 
@@ -62,6 +110,11 @@ namespace Systemic::BluetoothLE
                 // TODO instead wait for other connection call to succeed
                 co_return BleRequestStatus::InvalidCall;
             }
+            if (_isLinkLost)
+            {
+                // Drop the maintained connection and start a new one
+                internalDisconnect(ConnectionEventReason::Canceled);
+            }
 
             // New connect session
             connectCounter = ++_connectCounter;
@@ -70,7 +123,7 @@ namespace Systemic::BluetoothLE
             _connecting = true;
 
             // We're going to start connecting
-            _connectionEventsQueue.emplace_back(ConnectionEvent::Connecting, ConnectionEventReason::Success);
+            queueConnectionEvent(ConnectionEvent::Connecting, ConnectionEventReason::Success);
         }
 
         BleRequestStatus result = BleRequestStatus::Canceled;
@@ -78,37 +131,43 @@ namespace Systemic::BluetoothLE
         {
             // Move to background thread to avoid blocking itself on re-entrant calls
             // (i.e. when try to connect on getting a connection failure event from a previous connection attempt)
-            co_await winrt::resume_background();
+            co_await Systemic::Internal::resumeBackground();
 
             // Notify "connecting" event
             notifyQueuedConnectionEvents();
 
-            // Get the device and a session object
-            // Those 2 requests will succeed as long as the device was previously scanned,
+            // Get the device with a session
+            // This request will succeed as long as the device was previously scanned,
             // even if it's presently not reachable
-            auto device = co_await BluetoothLEDevice::FromBluetoothAddressAsync(_address);
-            GattSession session = nullptr;
-            if ((connectCounter == _connectCounter) && device)
-            {
-                session = co_await GattSession::FromDeviceIdAsync(device.BluetoothDeviceId());
-            }
+            auto device = co_await _backend->requestOpenDevice(_address).waitAsync();
 
             // Those variables track the state of the connection process
-            GattCommunicationStatus gattStatus = GattCommunicationStatus::Success;
+            BleRequestStatus discoveryStatus = BleRequestStatus::Success;
             bool ownsSession = false;
             bool missingServices = false;
             std::vector<std::shared_ptr<Service>> services{};
 
-            if ((connectCounter == _connectCounter) && session)
+            if ((connectCounter == _connectCounter) && device)
             {
-                // We're connected and now need to retrieve the list of services
-
-                // This request might take a long time (up to 18 seconds) if the device is not reachable
-                // TODO use GetGattServicesForUuidAsync() + cache mode
-                auto servicesResult = co_await device.GetGattServicesAsync(BluetoothCacheMode::Uncached);
-                gattStatus = servicesResult.Status();
+                // We're connected and now need to retrieve the services and their characteristics
+                const auto isCanceled = [this, connectCounter]() { return connectCounter != _connectCounter; };
+                const auto servicesUuids = discoveryOptions.requiredServicesOnly ? requiredServices : std::vector<BleUuid>{};
+                const auto cachedLayout = discoveryOptions.cache ? discoveryOptions.cache->find(_address, discoveryOptions.cacheTag) : nullptr;
+
+                // With a known layout, first try with the system cache which doesn't query the device
+                bool isCachedDiscovery = cachedLayout != nullptr;
+                auto discovery = co_await device->requestDiscoverServices(servicesUuids, isCachedDiscovery, isCanceled).waitAsync();
+                if (isCachedDiscovery && !isCanceled()
+                    && !matchesLayout(discovery, *cachedLayout, requiredServices, !servicesUuids.empty()))
+                {
+                    // The cache is stale, the device firmware may have been updated
+                    // This request might take a long time (up to 18 seconds) if the device is not reachable
+                    isCachedDiscovery = false;
+                    discovery = co_await device->requestDiscoverServices(servicesUuids, false, isCanceled).waitAsync();
+                }
+                discoveryStatus = discovery.status;
 
-                if ((connectCounter == _connectCounter) && (gattStatus == GattCommunicationStatus::Success))
+                if ((connectCounter == _connectCounter) && (discoveryStatus == BleRequestStatus::Success))
                 {
                     std::lock_guard lock{ _connectOpMtx };
 
@@ -117,67 +176,50 @@ namespace Systemic::BluetoothLE
                     {
                         assert(!_device);
                         _device = device;
-                        _session = session;
-                        _connectionStatusChangedToken = _device.ConnectionStatusChanged({ this, &Peripheral::onDeviceConnectionStatusChanged });
+                        _device->setConnectionStatusHandler([this](bool isConnected) { onDeviceConnectionStatusChanged(isConnected); });
                         ownsSession = true;
 
-                        _connectionEventsQueue.emplace_back(ConnectionEvent::Connected, ConnectionEventReason::Success);
+                        queueConnectionEvent(ConnectionEvent::Connected, ConnectionEventReason::Success);
                     }
                 }
 
                 if (ownsSession)
                 {
                     // If true, it will auto-reconnect to a lost device as soon it's available again
-                    session.MaintainConnection(maintainConnection);
+                    device->setMaintainConnection(maintainConnection);
 
-                    auto gattServices = servicesResult.Services();
-                    bool hasRequiredServices = requiredServices.size() > 0;
                     // If no service is required, skip checking for missing services
-                    if (hasRequiredServices)
+                    if (!requiredServices.empty())
                     {
                         // Iterate through services to make sure we have all the requested ones
-                        std::vector<winrt::guid> servicesUuids{};
-                        servicesUuids.reserve(gattServices.Size());
-                        for (auto service : gattServices)
+                        std::vector<BleUuid> discoveredUuids{};
+                        discoveredUuids.reserve(discovery.services.size());
+                        for (auto& discovered : discovery.services)
                         {
-                            servicesUuids.emplace_back(service.Uuid());
+                            discoveredUuids.emplace_back(discovered->uuid());
                         }
-                        missingServices = !Internal::isSubset(requiredServices, std::move(servicesUuids));
+                        missingServices = !Internal::isSubset(requiredServices, std::move(discoveredUuids));
                     }
 
-                    // If all services are accounted for, get their characteristics
+                    // If all services are accounted for, create their instances
                     if (!missingServices)
                     {
-                        services.reserve(gattServices.Size());
-                        std::unordered_map<winrt::guid, std::vector<std::shared_ptr<Characteristic>>> characteristics{};
-                        for (auto service : gattServices)
+                        if (discoveryOptions.cache && !isCachedDiscovery)
                         {
-                            // TODO cache mode
-                            GattCharacteristicsResult characteristicsResult = nullptr;
-                            try
-                            {
-                                // Got an exception once, may be caused by having the device disconnected...
-                                characteristicsResult = co_await service.GetCharacteristicsAsync(BluetoothCacheMode::Uncached);
-                            }
-                            catch (const winrt::hresult_error&)
-                            {
-                                gattStatus = GattCommunicationStatus::AccessDenied;
-                                break;
-                            }
-
-                            gattStatus = characteristicsResult.Status();
-                            if ((connectCounter != _connectCounter) || (gattStatus != GattCommunicationStatus::Success))
-                            {
-                                break;
-                            }
+                            discoveryOptions.cache->add(_address, discoveryOptions.cacheTag, toLayout(discovery));
+                        }
 
-                            for (auto characteristic : characteristicsResult.Characteristics())
+                        services.reserve(discovery.services.size());
+                        std::unordered_map<BleUuid, std::vector<std::shared_ptr<Characteristic>>> characteristics{};
+                        for (auto& discovered : discovery.services)
+                        {
+                            for (auto& characteristic : discovered->characteristics())
                             {
-                                auto it = characteristics.try_emplace(characteristic.Uuid()); // , std::vector<std::shared_ptr<Characteristic>>{}
+                                auto it = characteristics.try_emplace(characteristic->uuid());
                                 it.first->second.emplace_back(new Characteristic(characteristic));
                             }
 
-                            services.emplace_back(new Service{ shared_from_this(), service, characteristics });
+                            services.emplace_back(new Service{ shared_from_this(), discovered, characteristics });
                             characteristics.clear();
                         }
                     }
@@ -192,9 +234,9 @@ namespace Systemic::BluetoothLE
 
             if (connectCounter == _connectCounter)
             {
-                // If not canceled, the only cause of failures are a null session missing services or a GATT error
-                auto reason = (session == nullptr) ? ConnectionEventReason::Unknown :
-                    (missingServices ? ConnectionEventReason::NotSupported : toReason(gattStatus));
+                // If not canceled, the only cause of failures are a null device, missing services or a GATT error
+                auto reason = (device == nullptr) ? ConnectionEventReason::Unknown :
+                    (missingServices ? ConnectionEventReason::NotSupported : toReason(discoveryStatus));
 
                 if (reason == ConnectionEventReason::Success)
                 {
@@ -210,7 +252,7 @@ namespace Systemic::BluetoothLE
 
                     _isReady = true;
 
-                    _connectionEventsQueue.emplace_back(ConnectionEvent::Ready, ConnectionEventReason::Success);
+                    queueConnectionEvent(ConnectionEvent::Ready, ConnectionEventReason::Success);
                 }
                 else
                 {
@@ -233,7 +275,7 @@ namespace Systemic::BluetoothLE
                     }
                     else
                     {
-                        _connectionEventsQueue.emplace_back(ConnectionEvent::FailedToConnect, reason);
+                        queueConnectionEvent(ConnectionEvent::FailedToConnect, reason);
                     }
                 }
             }
@@ -260,8 +302,7 @@ namespace Systemic::BluetoothLE
 
     void Peripheral::internalDisconnect(ConnectionEventReason reason, bool fromDevice)
     {
-        BluetoothLEDevice device{ nullptr };
-        GattSession session{ nullptr };
+        std::shared_ptr<BleDeviceBackend> device{};
         std::vector<std::shared_ptr<Service>> services{};
 
         std::lock_guard lock{ _connectOpMtx };
@@ -271,27 +312,22 @@ namespace Systemic::BluetoothLE
 
         // Nothing to do if no device
         if (!_device) return;
-        assert(_session != nullptr);
-
-        // Don't remove device as want it to reconnect automatically
-        if (fromDevice && (_session.MaintainConnection())) return;
 
         if (!fromDevice)
         {
             // Notify that we are disconnecting
-            _connectionEventsQueue.emplace_back(ConnectionEvent::Disconnecting, ConnectionEventReason::Success);
+            queueConnectionEvent(ConnectionEvent::Disconnecting, ConnectionEventReason::Success);
         }
 
         // Also notify of disconnection as we won't get a WinRT event
         // since we have to destroy the device to force a disconnection
-        _connectionEventsQueue.emplace_back(ConnectionEvent::Disconnected, reason);
+        queueConnectionEvent(ConnectionEvent::Disconnected, reason);
 
         // Unhook from event before destroying device
-        _device.ConnectionStatusChanged(_connectionStatusChangedToken);
+        _device->setConnectionStatusHandler(nullptr);
 
         // Copy members
         device = _device;
-        session = _session;
         services.reserve(_services.size());
         for (auto& [_, s] : _services)
         {
@@ -300,12 +336,38 @@ namespace Systemic::BluetoothLE
 
         // Clear members
         _isReady = false;
+        _isLinkLost = false;
         _services.clear();
-        _session = nullptr;
         _device = nullptr;
 
         // Lock is released first, then device and session are destroy here
         // Any callback to user code will see an empty services list, no session and no device
         // TODO in some circumstances, destroying the session+device may block for 5 seconds => spawn a thread?
     }
+
+    bool Peripheral::internalLinkLost()
+    {
+        std::lock_guard lock{ _connectOpMtx };
+
+        // Only once ready, a link lost during the connection sequence fails the connection
+        if (!_isReady || !_device || !_device->maintainConnection()) return false;
+
+        // Keep device, session and services, the system will reconnect automatically
+        _isReady = false;
+        _isLinkLost = true;
+        queueConnectionEvent(ConnectionEvent::Disconnected, ConnectionEventReason::LinkLoss);
+        return true;
+    }
+
+    void Peripheral::internalLinkRestored()
+    {
+        std::lock_guard lock{ _connectOpMtx };
+
+        if (!_isLinkLost) return;
+
+        _isLinkLost = false;
+        _isReady = true;
+        queueConnectionEvent(ConnectionEvent::Connected, ConnectionEventReason::Success);
+        queueConnectionEvent(ConnectionEvent::Ready, ConnectionEventReason::Success);
+    }
 }
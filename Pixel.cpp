@@ -6,53 +6,105 @@
 #include "Systemic/BluetoothLE/Service.h"
 #include "Systemic/Pixels/Helpers.h"
 #include "Systemic/Pixels/PixelBleUuids.h"
+#include "Systemic/Internal/AwaitableResult.h"
+
+#include <optional>
 
 using namespace Systemic::BluetoothLE;
 
 namespace Systemic::Pixels
 {
     Pixel::Pixel(const ScannedPixel& scannedPixel, std::shared_ptr<PixelDelegate> delegate)
-        : _data(scannedPixel.data)
-        , _peripheral(Peripheral::create(scannedPixel.data.address, [this](ConnectionEvent ev, ConnectionEventReason /*reason*/)
+        : _name(scannedPixel.data.name)
+        , _advertisementTime(scannedPixel.data.timestamp)
+        , _snapshot(makeSnapshot(scannedPixel.data))
+        , _peripheral(Peripheral::create(scannedPixel.data.address, [this](ConnectionEvent ev, ConnectionEventReason reason)
             {
-                std::lock_guard lock{ _mutex };
+                bool linkRestored = false;
+                {
+                    std::lock_guard lock{ _mutex };
 
-                switch (ev)
+                    switch (ev)
+                    {
+                    case ConnectionEvent::Connecting:
+                        setStatus(PixelStatus::Connecting);
+                        break;
+                    case ConnectionEvent::Disconnecting:
+                        setStatus(PixelStatus::Disconnecting);
+                        break;
+                    case ConnectionEvent::Disconnected:
+                        if (reason == ConnectionEventReason::LinkLoss)
+                        {
+                            // The link is maintained, the system is reconnecting on its own
+                            _linkLossTime = std::chrono::steady_clock::now();
+                            _linkStats.update([](auto& stats) { ++stats.linkLossCount; });
+                            setStatus(PixelStatus::Connecting);
+                            break;
+                        }
+                        _linkLossTime = {};
+                        setStatus(PixelStatus::Disconnected);
+                        break;
+                    case ConnectionEvent::FailedToConnect:
+                        setStatus(PixelStatus::Disconnected);
+                        break;
+                    case ConnectionEvent::Connected:
+                        // Nothing
+                        break;
+                    case ConnectionEvent::Ready:
+                        linkRestored = _linkLossTime != std::chrono::steady_clock::time_point{};
+                        break;
+                    }
+                }
+
+                if (linkRestored)
                 {
-                case ConnectionEvent::Connecting:
-                    _status = PixelStatus::Connecting;
-                    break;
-                case ConnectionEvent::Disconnecting:
-                    _status = PixelStatus::Disconnecting;
-                    break;
-                case ConnectionEvent::Disconnected:
-                case ConnectionEvent::FailedToConnect:
-                    _status = PixelStatus::Disconnected;
-                    break;
-                case ConnectionEvent::Connected:
-                case ConnectionEvent::Ready:
-                    // Nothing
-                    break;
+                    restoreLinkAsync();
                 }
             }))
         , _delegate(delegate)
     {
+        _rollStatistics.reset(Helpers::getFaceCount(Helpers::getDieType(scannedPixel.data.ledCount)));
     }
 
-            std::future<Pixel::ConnectResult> Pixel::connectAsync()
+            std::future<Pixel::ConnectResult> Pixel::connectAsync(bool autoReconnect /*= false*/)
+            {
+                return Systemic::Internal::toFuture(requestConnect(autoReconnect));
+            }
+
+            Systemic::Internal::AwaitableResult<Pixel::ConnectResult> Pixel::requestConnect(bool autoReconnect /*= false*/)
             {
+                using std::chrono::steady_clock;
+
                 auto result = ConnectResult::Success;
+                PixelConnectTimings timings{};
+                const auto startTime = steady_clock::now();
+
+                // Only the Pixel service is needed, its layout is cached per firmware build
+                DiscoveryOptions discoveryOptions{};
+                discoveryOptions.requiredServicesOnly = true;
+                discoveryOptions.cache = DiscoveryCache::shared();
+                discoveryOptions.cacheTag = static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::seconds>(firmwareDate().time_since_epoch()).count());
+                std::vector<Systemic::BluetoothLE::BleUuid> requiredServices{ PixelBleUuids::service };
 
                 try
                 {
-                    const auto connectStatus = co_await _peripheral->connectAsync({ PixelBleUuids::service });
+                    const auto connectStatus = co_await _peripheral->requestConnect(std::move(requiredServices), autoReconnect, discoveryOptions).waitAsync();
+                    timings.connect = steady_clock::now() - startTime;
 
                     if (connectStatus == BleRequestStatus::Success)
                     {
                         PixelStatus prevStatus{};
                         if (updateStatus(PixelStatus::Connecting, PixelStatus::Identifying, &prevStatus))
                         {
-                            result = co_await internalSetupAsync();
+                            // Trust the advertisement data if it's recent enough
+                            const auto maxAge = fastIdentifyMaxAge();
+                            const bool fastIdentify = maxAge.count() > 0 && pixelId()
+                                && _advertisementTime != steady_clock::time_point{}
+                                && steady_clock::now() - _advertisementTime <= maxAge;
+
+                            result = co_await requestSetup(fastIdentify).waitAsync();
+                            timings.identify = steady_clock::now() - startTime - timings.connect;
 
                             if (result == ConnectResult::Success)
                             {
@@ -65,16 +117,22 @@ namespace Systemic::Pixels
                         }
                         else if (_status == PixelStatus::Identifying)
                         {
-                            std::promise<PixelStatus> statusPromise{};
+                            // Wait for the other connection attempt to complete the identification
+                            Systemic::Internal::AwaitableResult<PixelStatus> identified{};
 
-                            StatusCallback callback{ [&statusPromise](auto status)
+                            StatusCallback callback{ [identified](auto status)
                                 {
-                                    statusPromise.set_value(status);
+                                    identified.trySetResult(status);
                                 } };
 
                             const auto cbIndex = _internalStatusCbs.add(callback);
+                            if (status() != PixelStatus::Identifying) // No lock needed
+                            {
+                                // The status changed before our callback was added
+                                identified.trySetResult(status());
+                            }
 
-                            co_await statusPromise.get_future();
+                            co_await identified.waitAsync();
 
                             _internalStatusCbs.remove(cbIndex);
                         }
@@ -84,11 +142,14 @@ namespace Systemic::Pixels
                         result = ConnectResult::ConnectionFailed;
                     }
 
-                    if (result == ConnectResult::Success && _status != PixelStatus::Ready) // No lock needed
+                    if (result == ConnectResult::Success && status() != PixelStatus::Ready) // No lock needed
                     {
                         result = ConnectResult::Cancelled;
                     }
 
+                    timings.total = steady_clock::now() - startTime;
+                    _connectTimings.store(timings);
+
                     co_return result;
                 }
                 catch (...)
@@ -110,6 +171,303 @@ namespace Systemic::Pixels
                 _peripheral->disconnect();
             }
 
+            Systemic::Internal::AwaitableResult<BulkTransferResult> Pixel::requestBulkData(
+                Messages::TransferAnimSet session,
+                std::vector<uint8_t> data,
+                BulkTransferOptions options,
+                BulkTransferProgressListener onProgress)
+            {
+                using namespace std::chrono;
+
+                if (data.empty() || data.size() > std::numeric_limits<uint16_t>::max() || options.windowSize < 1)
+                {
+                    co_return BulkTransferResult::InvalidData;
+                }
+                if (!isReady())
+                {
+                    co_return BulkTransferResult::NotReady;
+                }
+
+                // Size packets to fit in a single write, use the BLE default MTU if we don't have the actual value
+                const size_t packetSize = std::min<size_t>(
+                    MessageFramer::maxPacketSize(_peripheral->mtu()) - Messages::BulkData::headerSize, Messages::BulkData::maxDataSize);
+                const size_t packetCount = (data.size() + packetSize - 1) / packetSize;
+
+                // Acknowledgments are tracked by the message callback
+                struct AckState
+                {
+                    std::mutex mutex{};
+                    std::vector<bool> acked{};
+                    size_t ackedCount{};
+                    size_t sentCount{};
+                    // Set while the transfer waits for an acknowledgment
+                    std::optional<Systemic::Internal::AwaitableResult<bool>> ackSignal{};
+                };
+                const auto state = std::make_shared<AckState>();
+                state->acked.resize(packetCount);
+
+                const auto ackToken = _msgWaiters.add(Messages::MessageType::BulkDataAck, [state, packetSize](const auto& msg)
+                    {
+                        const auto& ack = static_cast<const Messages::BulkDataAck&>(*msg);
+                        const size_t index = ack.offset / packetSize;
+                        std::optional<Systemic::Internal::AwaitableResult<bool>> ackSignal{};
+                        {
+                            std::lock_guard lock{ state->mutex };
+                            if ((ack.offset % packetSize) || (index >= state->sentCount) || state->acked[index])
+                            {
+                                return;
+                            }
+                            state->acked[index] = true;
+                            ++state->ackedCount;
+                            ackSignal.swap(state->ackSignal);
+                        }
+                        if (ackSignal)
+                        {
+                            ackSignal->trySetResult(true);
+                        }
+                    });
+
+                BulkTransferProgress progress{};
+                progress.totalBytes = data.size();
+                progress.packetSize = packetSize;
+                const auto startTime = steady_clock::now();
+
+                // The Pixel notifies once it has stored the data, watch for it before the transfer starts
+                Systemic::Internal::AwaitableResult<bool> finished{};
+                const auto finishedToken = _msgWaiters.add(Messages::MessageType::TransferAnimSetFinished, [finished](const auto&)
+                    {
+                        finished.trySetResult(true);
+                    });
+
+                auto result = BulkTransferResult::Success;
+
+                // Open the transfer session, the Pixel only accepts bulk data within it
+                const auto sessionAck = co_await requestResponse(session, Messages::MessageType::TransferAnimSetAck, options.setupTimeout).waitAsync();
+                if (!sessionAck || !static_cast<const Messages::TransferAnimSetAck&>(*sessionAck).result)
+                {
+                    result = BulkTransferResult::SetupFailed;
+                }
+
+                // Let the Pixel know how much data to expect
+                if (result == BulkTransferResult::Success)
+                {
+                    Messages::BulkSetup setup{};
+                    setup.size = static_cast<uint16_t>(data.size());
+                    if (!co_await requestResponse(setup, Messages::MessageType::BulkSetupAck, options.setupTimeout).waitAsync())
+                    {
+                        result = BulkTransferResult::SetupFailed;
+                    }
+                }
+
+                std::vector<steady_clock::time_point> sentTimes(packetCount);
+                std::vector<int> retries(packetCount);
+                std::vector<size_t> toSend{};
+                toSend.reserve(options.windowSize);
+                size_t nextPacket = 0;
+                size_t firstUnacked = 0;
+
+                while (result == BulkTransferResult::Success)
+                {
+                    // Select packets to send, timed out ones first and then new ones if the window allows
+                    toSend.clear();
+                    size_t ackedCount{};
+                    std::optional<Systemic::Internal::AwaitableResult<bool>> ackSignal{};
+                    auto deadline = steady_clock::time_point::max();
+                    {
+                        std::unique_lock lock{ state->mutex };
+                        ackedCount = state->ackedCount;
+                        if (ackedCount == packetCount)
+                        {
+                            break;
+                        }
+
+                        while (firstUnacked < nextPacket && state->acked[firstUnacked])
+                        {
+                            ++firstUnacked;
+                        }
+
+                        const auto now = steady_clock::now();
+                        for (size_t i = firstUnacked; i < nextPacket; ++i)
+                        {
+                            if (!state->acked[i])
+                            {
+                                const auto timeoutTime = sentTimes[i] + options.ackTimeout;
+                                if (timeoutTime <= now)
+                                {
+                                    toSend.push_back(i);
+                                }
+                                else
+                                {
+                                    deadline = std::min(deadline, timeoutTime);
+                                }
+                            }
+                        }
+
+                        // Packets to send again are already counted as in flight
+                        size_t inFlight = nextPacket - ackedCount;
+                        while (inFlight < static_cast<size_t>(options.windowSize) && nextPacket < packetCount)
+                        {
+                            toSend.push_back(nextPacket++);
+                            ++inFlight;
+                        }
+                        state->sentCount = nextPacket;
+
+                        if (toSend.empty())
+                        {
+                            // Window is full, the next acknowledgment completes the signal
+                            state->ackSignal.emplace();
+                            ackSignal = state->ackSignal;
+                        }
+                    }
+
+                    if (ackSignal)
+                    {
+                        // Wait for an acknowledgment or for the next timeout without holding a thread,
+                        // then leave the thread that completed the wait (notification or timer thread)
+                        if (deadline == steady_clock::time_point::max())
+                        {
+                            co_await ackSignal->waitAsync();
+                        }
+                        else
+                        {
+                            co_await ackSignal->waitAsync(std::max(deadline - steady_clock::now(), steady_clock::duration::zero()));
+                        }
+                        co_await Systemic::Internal::resumeBackground();
+
+                        std::lock_guard lock{ state->mutex };
+                        state->ackSignal.reset();
+                        continue;
+                    }
+
+                    // Report progress
+                    const size_t acknowledgedBytes = std::min(ackedCount * packetSize, data.size());
+                    if (onProgress && acknowledgedBytes != progress.acknowledgedBytes)
+                    {
+                        progress.acknowledgedBytes = acknowledgedBytes;
+                        progress.elapsed = steady_clock::now() - startTime;
+                        onProgress(progress);
+                    }
+
+                    // Send packets
+                    for (const auto i : toSend)
+                    {
+                        if (sentTimes[i] != steady_clock::time_point{})
+                        {
+                            if (++retries[i] > options.maxRetries)
+                            {
+                                result = BulkTransferResult::Timeout;
+                                break;
+                            }
+                            ++progress.retransmissions;
+                        }
+
+                        Messages::BulkData packet{};
+                        packet.offset = static_cast<uint16_t>(i * packetSize);
+                        packet.size = static_cast<uint8_t>(std::min(packetSize, data.size() - packet.offset));
+                        memcpy(packet.data, data.data() + packet.offset, packet.size);
+
+                        // Only send the valid bytes of data
+                        std::vector<uint8_t> packetData{};
+                        Messages::Serialization::serializeMessage(packet, packetData);
+                        packetData.resize(Messages::BulkData::headerSize + packet.size);
+
+                        sentTimes[i] = steady_clock::now();
+                        ++progress.packetsSent;
+                        if (!co_await enqueueMessage(std::move(packetData), true, true).waitAsync()) // withoutAck
+                        {
+                            result = BulkTransferResult::SendFailed;
+                            break;
+                        }
+                    }
+                }
+
+                _msgWaiters.remove(ackToken);
+
+                // Wait for the Pixel to be done with the data, then leave the thread that completed the wait
+                if (result == BulkTransferResult::Success)
+                {
+                    if (!co_await finished.waitAsync(options.finishTimeout))
+                    {
+                        result = BulkTransferResult::NotFinished;
+                    }
+                    co_await Systemic::Internal::resumeBackground();
+                }
+                _msgWaiters.remove(finishedToken);
+
+                if (onProgress)
+                {
+                    {
+                        std::lock_guard lock{ state->mutex };
+                        progress.acknowledgedBytes = std::min(state->ackedCount * packetSize, data.size());
+                    }
+                    progress.elapsed = steady_clock::now() - startTime;
+                    onProgress(progress);
+                }
+
+                co_return result;
+            }
+
+            std::future<DataSetUploadResult> Pixel::ensureDataSetAsync(
+                Messages::TransferAnimSet animSet,
+                std::vector<uint8_t> data,
+                std::shared_ptr<DataSetCache> cache /*= nullptr*/,
+                BulkTransferOptions options /*= {}*/,
+                BulkTransferProgressListener onProgress /*= nullptr*/)
+            {
+                return Systemic::Internal::toFuture(requestDataSet(animSet, std::move(data), std::move(cache), std::move(options), std::move(onProgress)));
+            }
+
+            Systemic::Internal::AwaitableResult<DataSetUploadResult> Pixel::requestDataSet(
+                Messages::TransferAnimSet animSet,
+                std::vector<uint8_t> data,
+                std::shared_ptr<DataSetCache> cache,
+                BulkTransferOptions options,
+                BulkTransferProgressListener onProgress)
+            {
+                if (!isReady())
+                {
+                    co_return DataSetUploadResult::NotReady;
+                }
+                if (!cache)
+                {
+                    cache = DataSetCache::shared();
+                }
+
+                // Skip transfer if the die already has this data set, its description is part of the content
+                std::vector<uint8_t> content{};
+                Messages::Serialization::serializeMessage(animSet, content);
+                content.insert(content.end(), data.begin(), data.end());
+                const auto contentHash = DataSetCache::computeContentHash(content);
+                const auto knownHash = cache->findDataSetHash(contentHash);
+                const auto previousHash = dataSetHash();
+                if (knownHash && *knownHash == previousHash)
+                {
+                    co_return DataSetUploadResult::UpToDate;
+                }
+
+                const auto transferResult = co_await requestBulkData(animSet, data, options, std::move(onProgress)).waitAsync();
+                if (transferResult != BulkTransferResult::Success)
+                {
+                    co_return DataSetUploadResult::TransferFailed;
+                }
+
+                // Get the new hash from the die (our hash is updated when processing the message)
+                const auto iAmADie = std::static_pointer_cast<const Messages::IAmADie>(
+                    co_await requestResponse(
+                        Messages::MessageType::WhoAreYou,
+                        Messages::MessageType::IAmADie,
+                        std::chrono::seconds(2)).waitAsync()
+                );
+                if (!iAmADie || iAmADie->dataSetHash == previousHash)
+                {
+                    // Don't cache a hash that may not be the one of this data set
+                    co_return DataSetUploadResult::VerificationFailed;
+                }
+
+                cache->add(contentHash, iAmADie->dataSetHash, std::move(data));
+                co_return DataSetUploadResult::Uploaded;
+            }
+
             std::future<bool> Pixel::turnOffAsync()
             {
                 return sendMessageAsync(Messages::MessageType::Sleep, true); // withoutAck
@@ -133,7 +491,7 @@ namespace Systemic::Pixels
                     update = _status == expectedStatus;
                     if (update)
                     {
-                        _status = newStatus;
+                        setStatus(newStatus);
                     }
                 }
 
@@ -158,7 +516,34 @@ namespace Systemic::Pixels
                 return update;
             }
 
-            std::future<Pixel::ConnectResult> Pixel::internalSetupAsync()
+            PixelSnapshot Pixel::makeSnapshot(const ScannedPixelData& data)
+            {
+                PixelSnapshot snapshot{};
+                snapshot.address = data.address;
+                snapshot.pixelId = data.pixelId;
+                snapshot.ledCount = data.ledCount;
+                snapshot.designAndColor = data.designAndColor;
+                snapshot.firmwareDate = data.firmwareDate;
+                snapshot.rssi = data.rssi;
+                snapshot.batteryLevel = data.batteryLevel;
+                snapshot.isCharging = data.isCharging;
+                snapshot.rollState = data.rollState;
+                snapshot.currentFace = data.currentFace;
+                return snapshot;
+            }
+
+            void Pixel::setStatus(PixelStatus status)
+            {
+                // Called with the mutex held
+                _status = status;
+                _snapshot.update([status](auto& data)
+                    {
+                        data.status = status;
+                        ++data.version;
+                    });
+            }
+
+            Systemic::Internal::AwaitableResult<Pixel::ConnectResult> Pixel::requestSetup(bool fastIdentify /*= false*/)
             {
                 ConnectResult result = ConnectResult::Success;
 
@@ -169,37 +554,69 @@ namespace Systemic::Pixels
                     auto write = service->getCharacteristic(PixelBleUuids::writeCharacteristic);
                     if (notify && write)
                     {
-                        const auto status = co_await notify->subscribeAsync([this](auto data)
-                            {
-                                onValueChanged(data);
-                            });
+                        bool isSubscribed = false;
+                        {
+                            std::lock_guard lock{ _mutex };
+                            isSubscribed = _notifyCharacteristic == notify && _notifySubscription;
+                        }
+
+                        // Other subscribers may share the characteristic, only our subscription is replaced
+                        uint32_t subscription{};
+                        const auto status = isSubscribed
+                            ? co_await notify->requestRefreshSubscriptions().waitAsync()
+                            : co_await notify->requestSubscribe([this](ByteSpan data)
+                                {
+                                    onValueChanged(data);
+                                },
+                                &subscription).waitAsync();
 
                         if (status == BleRequestStatus::Success)
                         {
+                            std::shared_ptr<Characteristic> previousNotify{};
+                            uint32_t previousSubscription{};
                             {
                                 std::lock_guard lock{ _mutex };
 
+                                if (subscription)
+                                {
+                                    previousNotify = _notifyCharacteristic;
+                                    previousSubscription = _notifySubscription;
+                                    _notifySubscription = subscription;
+                                }
                                 _notifyCharacteristic = notify;
                                 _writeCharacteristic = write;
                             }
+                            if (previousNotify && previousNotify != notify)
+                            {
+                                // Services were discovered again
+                                previousNotify->requestUnsubscribe(previousSubscription);
+                            }
+
+                            if (fastIdentify)
+                            {
+                                // Identity is checked after the fact
+                                verifyIdentityAsync();
+                                co_return result;
+                            }
 
                             const auto iAmADie = std::static_pointer_cast<const Messages::IAmADie>(
-                                co_await sendAndWaitForResponseAsync(
+                                co_await requestResponse(
                                     Messages::MessageType::WhoAreYou,
                                     Messages::MessageType::IAmADie,
-                                    std::chrono::seconds(2))
+                                    std::chrono::seconds(2)).waitAsync()
                             );
                             if (!iAmADie)
                             {
                                 result = ConnectResult::IdentificationTimeout;
                             }
-                            else if (iAmADie->pixelId != _data.pixelId)
+                            else if (iAmADie->pixelId != pixelId())
                             {
                                 result = ConnectResult::IdentificationMismatch;
                             }
                         }
                         else
                         {
+                            // A failed subscription is removed by the characteristic
                             result = ConnectResult::SubscriptionError;
                         }
                     }
@@ -208,21 +625,141 @@ namespace Systemic::Pixels
                 co_return result;
             }
 
-            void Pixel::onValueChanged(const std::vector<uint8_t>& data)
+            Systemic::Internal::DetachedTask Pixel::verifyIdentityAsync()
             {
-                const auto msg = Messages::Serialization::deserializeMessage(data);
-                if (msg)
+                // Keep this instance alive until the die has answered
+                const auto self = shared_from_this();
+
+                const auto iAmADie = std::static_pointer_cast<const Messages::IAmADie>(
+                    co_await requestResponse(
+                        Messages::MessageType::WhoAreYou,
+                        Messages::MessageType::IAmADie,
+                        std::chrono::seconds(2)).waitAsync()
+                );
+                if (iAmADie && iAmADie->pixelId == pixelId())
                 {
-                    processMessage(*msg);
+                    co_return;
+                }
 
-                    std::vector<MessageCallback> callbacks = _internalMsgCbs.get();
+                // Don't report a failure if we got disconnected in the meantime
+                const auto currentStatus = status();
+                if (currentStatus != PixelStatus::Identifying && currentStatus != PixelStatus::Ready)
+                {
+                    co_return;
+                }
 
-                    for (const auto& cb : callbacks)
+                disconnect();
+                if (_delegate)
+                {
+                    _delegate->onFastIdentifyFailed(shared_from_this(), iAmADie != nullptr);
+                }
+            }
+
+            Systemic::Internal::DetachedTask Pixel::restoreLinkAsync()
+            {
+                // Keep this instance alive until the die is ready again
+                const auto self = shared_from_this();
+
+                if (!updateStatus(PixelStatus::Connecting, PixelStatus::Identifying))
+                {
+                    co_return;
+                }
+
+                // Services are still valid, only the subscription and the die state need to be restored
+                const auto result = co_await requestSetup().waitAsync();
+                if (result != ConnectResult::Success)
+                {
+                    disconnect();
+                    co_return;
+                }
+
+                std::vector<std::vector<uint8_t>> telemetryRequests{};
+                {
+                    std::lock_guard lock{ _mutex };
+                    telemetryRequests = _activeTelemetryRequests;
+                }
+                for (auto& request : telemetryRequests)
+                {
+                    co_await enqueueMessage(std::move(request), false, true).waitAsync();
+                }
+
+                std::chrono::steady_clock::duration outage{};
+                {
+                    std::lock_guard lock{ _mutex };
+                    if (_linkLossTime != std::chrono::steady_clock::time_point{})
                     {
-                        if (cb)
-                        {
-                            cb(msg);
-                        }
+                        outage = std::chrono::steady_clock::now() - _linkLossTime;
+                        _linkLossTime = {};
+                    }
+                }
+                _linkStats.update([outage](auto& stats)
+                    {
+                        ++stats.restoredCount;
+                        stats.lastOutage = outage;
+                        stats.longestOutage = std::max(stats.longestOutage, outage);
+                        stats.totalOutage += outage;
+                    });
+
+                updateStatus(PixelStatus::Identifying, PixelStatus::Ready);
+            }
+
+            void Pixel::trackTelemetryRequest(const std::vector<uint8_t>& data)
+            {
+                // Telemetry requests start with the message type followed by the request mode
+                const auto type = static_cast<Messages::MessageType>(data[0]);
+                if ((type != Messages::MessageType::RequestRssi && type != Messages::MessageType::RequestTelemetry) || data.size() < 2)
+                {
+                    return;
+                }
+
+                std::lock_guard lock{ _mutex };
+
+                auto& requests = _activeTelemetryRequests;
+                requests.erase(std::remove_if(requests.begin(), requests.end(),
+                    [&data](const auto& request) { return request[0] == data[0]; }), requests.end());
+                if (static_cast<Messages::TelemetryRequestMode>(data[1]) == Messages::TelemetryRequestMode::Automatic)
+                {
+                    requests.push_back(data);
+                }
+            }
+
+            void Pixel::onValueChanged(ByteSpan data)
+            {
+                // A notification may hold several messages or a fragment of one
+                _framer.receive(data, [this](ByteSpan message)
+                    {
+                        onMessageData(message);
+                    });
+            }
+
+            void Pixel::onMessageData(ByteSpan data)
+            {
+                // Decode on the stack, no allocation needed to update our state
+                Messages::Serialization::MessageStorage storage;
+                const auto message = Messages::Serialization::deserializeMessage(data, storage);
+                if (!message)
+                {
+                    return;
+                }
+
+                processMessage(*message);
+
+                // Only allocate a shared copy of the message if someone is listening
+                const bool hasWaiters = _msgWaiters.hasWaiters(message->type);
+                const bool isResponse = _requests.isExpecting(message->type);
+                if (hasWaiters || isResponse || _delegate)
+                {
+                    const auto msg = Messages::Serialization::deserializeMessage(data);
+                    assert(msg);
+
+                    if (isResponse)
+                    {
+                        _requests.dispatch(msg);
+                    }
+
+                    if (hasWaiters)
+                    {
+                        _msgWaiters.notify(msg);
                     }
 
                     if (_delegate)
@@ -239,42 +776,63 @@ namespace Systemic::Pixels
                 case Messages::MessageType::IAmADie:
                 {
                     const auto& iAmADie = static_cast<const Messages::IAmADie&>(message);
-                    if (!_data.pixelId || iAmADie.pixelId == _data.pixelId)
-                    {
-                        // Update read only properties (atomic writes, no lock)
-                        _data.ledCount = iAmADie.ledCount;
-                        _data.designAndColor = iAmADie.designAndColor;
-                        _data.pixelId = iAmADie.pixelId;
+                    const auto firmwareDate = Helpers::getFirmwareDate(iAmADie.buildTimestamp);
+                    const auto level = iAmADie.batteryLevelPercent;
+                    const bool isCharging = Helpers::isPixelChargingOrDone(iAmADie.batteryState);
 
-                        // Update notifiable properties
+                    bool identified = false, ledCountChanged = false, dateChanged = false, levelChanged = false, chargingChanged = false;
+                    _snapshot.update([&](auto& data)
+                        {
+                            if (!data.pixelId || iAmADie.pixelId == data.pixelId)
+                            {
+                                identified = true;
+
+                                // Update read only properties
+                                ledCountChanged = data.ledCount != iAmADie.ledCount;
+                                data.ledCount = iAmADie.ledCount;
+                                data.designAndColor = iAmADie.designAndColor;
+                                data.pixelId = iAmADie.pixelId;
+                                data.dataSetHash = iAmADie.dataSetHash;
+
+                                // Update notifiable properties
+
+                                // Skip sending roll state to delegate as we didn't get the data
+                                // from an actual roll event
+                                data.rollState = iAmADie.rollState;
+                                data.currentFace = iAmADie.currentFaceIndex + 1;
+
+                                dateChanged = data.firmwareDate != firmwareDate;
+                                data.firmwareDate = firmwareDate;
 
-                        // Skip sending roll state to delegate as we didn't get the data
-                        // from an actual roll event
-                        _data.rollState = iAmADie.rollState;
-                        _data.currentFace = iAmADie.currentFaceIndex + 1;
+                                levelChanged = data.batteryLevel != level;
+                                data.batteryLevel = level;
+
+                                chargingChanged = data.isCharging != isCharging;
+                                data.isCharging = isCharging;
+
+                                ++data.version;
+                            }
+                        });
+
+                    if (identified && ledCountChanged)
+                    {
+                        // Statistics are only valid for a given die type
+                        _rollStatistics.reset(Helpers::getFaceCount(Helpers::getDieType(iAmADie.ledCount)));
+                    }
 
-                        const auto firmwareDate = Helpers::getFirmwareDate(iAmADie.buildTimestamp);
-                        const bool dateChanged = _data.firmwareDate != firmwareDate;
-                        _data.firmwareDate = firmwareDate;
-                        if (_delegate && dateChanged)
+                    if (identified && _delegate)
+                    {
+                        if (dateChanged)
                         {
                             _delegate->onFirmwareDateChanged(shared_from_this(), firmwareDate);
                         }
-
-                        const auto level = iAmADie.batteryLevelPercent;
-                        const bool levelChanged = _data.batteryLevel != level;
-                        _data.batteryLevel = iAmADie.batteryLevelPercent;
-                        if (_delegate && levelChanged)
+                        if (levelChanged)
                         {
-                            _delegate->onBatteryLevelChanged(shared_from_this(), level);
+                            notifyBatteryLevel(level);
                         }
-
-                        const bool isCharging = Helpers::isPixelChargingOrDone(iAmADie.batteryState);
-                        const bool chargingChanged = _data.isCharging != isCharging;
-                        _data.isCharging = isCharging;
-                        if (_delegate && chargingChanged)
+                        if (chargingChanged)
                         {
-                            _delegate->onChargingStateChanged(shared_from_this(), isCharging);
+                            notifyChargingState(isCharging);
                         }
                     }
                     break;
@@ -285,17 +843,35 @@ namespace Systemic::Pixels
                     const auto& roll = static_cast<const Messages::RollState&>(message);
 
                     // Update properties
-                    _data.rollState = roll.state;
-                    _data.currentFace = roll.faceIndex + 1;
+                    _snapshot.update([&roll](auto& data)
+                        {
+                            data.rollState = roll.state;
+                            data.currentFace = roll.faceIndex + 1;
+                            ++data.version;
+                        });
+                    _rollHistory.add(RollEvent{ std::chrono::steady_clock::now(), roll.state, roll.faceIndex + 1 });
+                    if (roll.state == PixelRollState::OnFace)
+                    {
+                        _rollStatistics.addRoll(roll.faceIndex + 1);
+                    }
 
                     if (_delegate)
                     {
-                        // Always notify delegate of roll events
-                        _delegate->onRollStateChanged(shared_from_this(), roll.state, roll.faceIndex + 1);
-
-                        if (roll.state == PixelRollState::OnFace)
+                        // Always notify delegate of roll events, only intermediate states may be coalesced
+                        const auto state = roll.state;
+                        const int face = roll.faceIndex + 1;
+                        auto deliver = [self = shared_from_this(), state, face]()
+                            {
+                                self->_delegate->onRollStateChanged(self, state, face);
+                            };
+                        if (state == PixelRollState::OnFace)
                         {
-                            _delegate->onRolled(shared_from_this(), roll.faceIndex + 1);
+                            _eventCoalescer.notifyNow(PixelEventKind::RollState, deliver);
+                            _delegate->onRolled(shared_from_this(), face);
+                        }
+                        else
+                        {
+                            _eventCoalescer.notify(PixelEventKind::RollState, deliver);
                         }
                     }
                     break;
@@ -304,21 +880,25 @@ namespace Systemic::Pixels
                 case Messages::MessageType::BatteryLevel:
                 {
                     const auto& batteryLevel = static_cast<const Messages::BatteryLevel&>(message);
-
-                    const bool levelChanged = _data.batteryLevel != batteryLevel.levelPercent;
                     const bool isCharging = Helpers::isPixelChargingOrDone(batteryLevel.state);
-                    const bool chargingChanged = _data.isCharging != isCharging;
 
-                    _data.batteryLevel = batteryLevel.levelPercent;
+                    bool levelChanged = false, chargingChanged = false;
+                    _snapshot.update([&](auto& data)
+                        {
+                            levelChanged = data.batteryLevel != batteryLevel.levelPercent;
+                            chargingChanged = data.isCharging != isCharging;
+                            data.batteryLevel = batteryLevel.levelPercent;
+                            data.isCharging = isCharging;
+                            ++data.version;
+                        });
+
                     if (_delegate && levelChanged)
                     {
-                        _delegate->onBatteryLevelChanged(shared_from_this(), batteryLevel.levelPercent);
+                        notifyBatteryLevel(batteryLevel.levelPercent);
                     }
-
-                    _data.isCharging = isCharging;
                     if (_delegate && chargingChanged)
                     {
-                        _delegate->onChargingStateChanged(shared_from_this(), isCharging);
+                        notifyChargingState(isCharging);
                     }
                     break;
                 }
@@ -327,21 +907,258 @@ namespace Systemic::Pixels
                 {
                     const auto& rssi = static_cast<const Messages::Rssi&>(message);
 
-                    const bool rssiChanged = _data.rssi != rssi.value;
+                    bool rssiChanged = false;
+                    _snapshot.update([&](auto& data)
+                        {
+                            rssiChanged = data.rssi != rssi.value;
+                            data.rssi = rssi.value;
+                            ++data.version;
+                        });
 
-                    _data.rssi = rssi.value;
                     if (_delegate && rssiChanged)
                     {
-                        _delegate->onRssiChanged(shared_from_this(), rssi.value);
+                        const int value = rssi.value;
+                        _eventCoalescer.notify(PixelEventKind::Rssi, [self = shared_from_this(), value]()
+                            {
+                                self->_delegate->onRssiChanged(self, value);
+                            });
                     }
                     break;
                 }
                 }
             }
 
-            std::future<bool> Pixel::sendMessageAsync(const std::vector<uint8_t>& data, bool withoutAck /*= false*/)
+            void Pixel::notifyBatteryLevel(int level)
             {
-                const auto result = co_await _writeCharacteristic->writeAsync(data, withoutAck);
-                co_return result == BleRequestStatus::Success;
+                _eventCoalescer.notify(PixelEventKind::BatteryLevel, [self = shared_from_this(), level]()
+                    {
+                        self->_delegate->onBatteryLevelChanged(self, level);
+                    });
+            }
+
+            void Pixel::notifyChargingState(bool isCharging)
+            {
+                _eventCoalescer.notify(PixelEventKind::ChargingState, [self = shared_from_this(), isCharging]()
+                    {
+                        self->_delegate->onChargingStateChanged(self, isCharging);
+                    });
+            }
+
+            std::future<std::shared_ptr<const Messages::PixelMessage>> Pixel::sendAndWaitForResponseAsync(
+                std::vector<uint8_t> data,
+                Messages::MessageType responseType,
+                std::chrono::milliseconds timeout)
+            {
+                return Systemic::Internal::toFuture(requestResponse(std::move(data), responseType, timeout));
+            }
+
+            RequestMultiplexer::PendingResponse Pixel::requestResponse(
+                std::vector<uint8_t> data,
+                Messages::MessageType responseType,
+                std::chrono::milliseconds timeout)
+            {
+                RequestMultiplexer::PendingResponse result{};
+                runRequestAsync(result, std::move(data), responseType, timeout);
+                return result;
+            }
+
+            Systemic::Internal::DetachedTask Pixel::runRequestAsync(
+                RequestMultiplexer::PendingResponse result,
+                std::vector<uint8_t> data,
+                Messages::MessageType responseType,
+                std::chrono::milliseconds timeout)
+            {
+                // Keep this instance alive until the request completes
+                const auto self = shared_from_this();
+
+                // Wait for our turn if too many requests are already in flight
+                co_await _requests.acquireSlot().waitAsync();
+
+                RequestMultiplexer::PendingResponse pendingResponse{};
+                std::shared_ptr<const Messages::PixelMessage> response{};
+                try
+                {
+                    // Register and start the write together so that responses of a same type
+                    // come back in the order the requests are registered
+                    Systemic::Internal::AwaitableResult<bool> sent{};
+                    {
+                        std::lock_guard lock{ _requestsOrderMutex };
+                        pendingResponse = _requests.expectResponse(responseType);
+                        sent = enqueueMessage(std::move(data), false, false); // Don't coalesce requests
+                    }
+
+                    // Completed either by the response or by the timeout, without blocking a thread
+                    if (co_await sent.waitAsync())
+                    {
+                        response = co_await pendingResponse.waitAsync(timeout);
+                    }
+                }
+                catch (...)
+                {
+                    // Reported as a timeout
+                }
+
+                if (!response)
+                {
+                    // A timeout resumes us on the TimerQueue thread, don't hold up the other timers
+                    co_await Systemic::Internal::resumeBackground();
+                    _requests.cancelResponse(responseType, pendingResponse);
+                }
+
+                _requests.releaseSlot();
+                result.trySetResult(std::move(response));
+            }
+
+            std::future<bool> Pixel::sendMessageAsync(std::vector<uint8_t> data, bool withoutAck /*= false*/, bool allowCoalescing /*= true*/)
+            {
+                return Systemic::Internal::toFuture(enqueueMessage(std::move(data), withoutAck, allowCoalescing));
+            }
+
+            Systemic::Internal::AwaitableResult<bool> Pixel::enqueueMessage(std::vector<uint8_t> data, bool withoutAck, bool allowCoalescing)
+            {
+                if (data.empty())
+                {
+                    Systemic::Internal::AwaitableResult<bool> failed{};
+                    failed.trySetResult(false);
+                    return failed;
+                }
+                trackTelemetryRequest(data);
+
+                bool startWriting = false;
+                auto completion = _writeQueue.enqueue(std::move(data), withoutAck, allowCoalescing, startWriting);
+                if (startWriting)
+                {
+                    // Runs until the queue is empty, the first write is started before returning
+                    processWriteQueueAsync();
+                }
+                return completion;
+            }
+
+            Systemic::BluetoothLE::WriteFlowStats Pixel::writeFlowStats() const
+            {
+                std::lock_guard lock{ _mutex };
+                return _writeCharacteristic ? _writeCharacteristic->writeFlowStats() : Systemic::BluetoothLE::WriteFlowStats{};
+            }
+
+            Systemic::Internal::DetachedTask Pixel::processWriteQueueAsync()
+            {
+                // Keep this instance alive until the queue is emptied
+                const auto self = shared_from_this();
+
+                // The queue only stops writing once next() returns nothing, so each taken
+                // message must be completed and no exception may leave the loop
+                while (auto write = _writeQueue.next())
+                {
+                    std::vector<WriteScheduler::Write> packed{};
+                    bool success = false;
+                    try
+                    {
+                        // The characteristic is not set until connected
+                        std::shared_ptr<Systemic::BluetoothLE::Characteristic> characteristic{};
+                        {
+                            std::lock_guard lock{ _mutex };
+                            characteristic = _writeCharacteristic;
+                        }
+
+                        const size_t packetSize = MessageFramer::maxPacketSize(_peripheral->mtu());
+                        const bool framing = isFramingEnabled();
+
+                        if (!characteristic)
+                        {
+                            // Reported as a failed write
+                        }
+                        else if (write->data.size() > packetSize)
+                        {
+                            if (framing)
+                            {
+                                // Split in packets, the message is lost if any of them fails
+                                const auto fragments = MessageFramer::fragment(write->data, packetSize);
+                                success = !fragments.empty();
+                                for (const auto& fragment : fragments)
+                                {
+                                    if (co_await characteristic->requestWrite(fragment, write->withoutAck).waitAsync() != BleRequestStatus::Success)
+                                    {
+                                        success = false;
+                                        break;
+                                    }
+                                }
+                            }
+                            else
+                            {
+                                // A write without response must fit in a single packet, use a long write instead
+                                success = co_await characteristic->requestWrite(write->data, false).waitAsync() == BleRequestStatus::Success;
+                            }
+                        }
+                        else
+                        {
+                            // Pack the following small messages with this one
+                            std::vector<uint8_t> frame{};
+                            if (framing && MessageFramer::canPack(0, write->data.size(), packetSize))
+                            {
+                                while (auto other = _writeQueue.nextIf([&](const WriteScheduler::Write& w)
+                                    {
+                                        const size_t frameSize = frame.empty()
+                                            ? MessageFramer::packedHeaderSize + 1 + write->data.size() : frame.size();
+                                        return MessageFramer::canPack(frameSize, w.data.size(), packetSize);
+                                    }))
+                                {
+                                    if (frame.empty())
+                                    {
+                                        MessageFramer::pack(frame, write->data);
+                                    }
+                                    MessageFramer::pack(frame, other->data);
+                                    packed.push_back(std::move(*other));
+                                }
+                            }
+
+                            if (packed.empty() && write->withoutAck)
+                            {
+                                // Pipeline the writes without response, the next message is picked
+                                // once the credit window has room for it so it may still be coalesced
+                                co_await characteristic->waitForWriteCredit().waitAsync();
+                                writeWithoutAckAsync(characteristic, std::move(*write));
+                                continue;
+                            }
+
+                            // Request a confirmation if any of the packed messages requires one
+                            bool withoutAck = write->withoutAck;
+                            for (const auto& other : packed)
+                            {
+                                withoutAck = withoutAck && other.withoutAck;
+                            }
+
+                            const auto& data = packed.empty() ? write->data : frame;
+                            success = co_await characteristic->requestWrite(data, withoutAck).waitAsync() == BleRequestStatus::Success;
+                        }
+                    }
+                    catch (...)
+                    {
+                        // Reported as a failed write
+                        success = false;
+                    }
+
+                    _writeQueue.complete(*write, success);
+                    for (const auto& other : packed)
+                    {
+                        _writeQueue.complete(other, success);
+                    }
+                }
+            }
+
+            Systemic::Internal::DetachedTask Pixel::writeWithoutAckAsync(std::shared_ptr<Systemic::BluetoothLE::Characteristic> characteristic, WriteScheduler::Write write)
+            {
+                // Keep this instance alive until the write completes
+                const auto self = shared_from_this();
+
+                bool success = false;
+                try
+                {
+                    success = co_await characteristic->requestWrite(write.data, true).waitAsync() == BleRequestStatus::Success;
+                }
+                catch (...)
+                {
+                    // Reported as a failed write
+                }
+                _writeQueue.complete(write, success);
             }
 }
@@ -44,6 +44,7 @@ namespace
                 } info2;
                 memcpy(&info2, manufData.data(), manufData.size());
 
+                data.timestamp = std::chrono::steady_clock::now();
                 data.name = p->name();
                 data.address = p->address();
                 data.rssi = p->rssi();
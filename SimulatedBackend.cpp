@@ -0,0 +1,628 @@
+#include "pch.h"
+#include "Systemic/BluetoothLE/SimulatedBackend.h"
+#include "Systemic/Internal/AwaitableResult.h"
+#include "Systemic/Internal/TimerQueue.h"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+
+namespace Systemic::BluetoothLE
+{
+    namespace
+    {
+        using Systemic::Internal::TimerQueue;
+
+        // Returns an awaitable that completes on the timer thread after the given delay
+        auto delayAsync(std::chrono::milliseconds delay)
+        {
+            return Systemic::Internal::AwaitableResult<bool>{}.waitAsync(delay);
+        }
+    }
+
+    // A simulated peripheral, its state is guarded by the mutex
+    struct SimulatedBackend::VirtualPeripheral
+    {
+        const size_t index;
+        const bluetooth_address_t address;
+        std::mutex mutex{};
+        std::mt19937 random;
+        bool isInReach{ true };
+        std::weak_ptr<Device> device{};
+        TimerQueue::Clock::time_point lastNotification{};
+
+        VirtualPeripheral(size_t index, bluetooth_address_t address, std::uint32_t seed)
+            : index{ index }, address{ address }, random{ seed } {}
+    };
+
+    class SimulatedBackend::Characteristic final
+        : public BleCharacteristicBackend, public std::enable_shared_from_this<Characteristic>
+    {
+        const std::shared_ptr<SimulatedBackend> _backend;
+        const std::shared_ptr<VirtualPeripheral> _peripheral;
+        const std::weak_ptr<Device> _device;
+        const std::uint16_t _handle;
+        const SimulatedCharacteristic _info;
+        std::atomic<bool> _isNotifying{};
+
+        // Replaced as a whole with std::atomic_store()
+        std::shared_ptr<const std::function<void(ByteSpan)>> _onValueChanged{};
+
+    public:
+        Characteristic(
+            std::shared_ptr<SimulatedBackend> backend,
+            std::shared_ptr<VirtualPeripheral> peripheral,
+            std::weak_ptr<Device> device,
+            std::uint16_t handle,
+            SimulatedCharacteristic info)
+            :
+            _backend{ std::move(backend) },
+            _peripheral{ std::move(peripheral) },
+            _device{ std::move(device) },
+            _handle{ handle },
+            _info{ std::move(info) }
+        {
+        }
+
+        std::uint16_t handle() const override { return _handle; }
+
+        BleUuid uuid() const override { return _info.uuid; }
+
+        std::uint32_t properties() const override { return _info.properties; }
+
+        Systemic::Internal::AwaitableResult<std::vector<std::uint8_t>> requestRead() override
+        {
+            // Simulated characteristics have no stored value
+            co_await delayAsync(_backend->latency(*_peripheral, _backend->_options.operationLatency));
+            co_return std::vector<std::uint8_t>{};
+        }
+
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestWrite(std::vector<std::uint8_t> data, bool withoutResponse) override;
+
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestConfigureNotifications(bool enable) override;
+
+        void setValueChangedHandler(std::function<void(ByteSpan)> onValueChanged) override
+        {
+            std::shared_ptr<const std::function<void(ByteSpan)>> handler{};
+            if (onValueChanged)
+            {
+                handler = std::make_shared<const std::function<void(ByteSpan)>>(std::move(onValueChanged));
+            }
+            std::atomic_store(&_onValueChanged, std::move(handler));
+        }
+
+        // Calls the handler if notifications are enabled, returns whether it was called
+        bool deliver(ByteSpan data)
+        {
+            if (!_isNotifying) return false;
+            auto handler = std::atomic_load(&_onValueChanged);
+            if (!handler) return false;
+            (*handler)(data);
+            return true;
+        }
+
+        // The peripheral forgets about the notifications configuration when the link is lost
+        void onLinkLost()
+        {
+            _isNotifying = false;
+        }
+    };
+
+    class SimulatedBackend::Service final : public BleServiceBackend
+    {
+        const std::uint16_t _handle;
+        const BleUuid _uuid;
+        const std::vector<std::shared_ptr<Characteristic>> _characteristics;
+
+    public:
+        Service(std::uint16_t handle, BleUuid uuid, std::vector<std::shared_ptr<Characteristic>> characteristics)
+            : _handle{ handle }, _uuid{ uuid }, _characteristics{ std::move(characteristics) } {}
+
+        std::uint16_t handle() const override { return _handle; }
+
+        BleUuid uuid() const override { return _uuid; }
+
+        std::vector<std::shared_ptr<BleCharacteristicBackend>> characteristics() const override
+        {
+            return { _characteristics.begin(), _characteristics.end() };
+        }
+
+        void close() override {}
+
+        const std::vector<std::shared_ptr<Characteristic>>& simulatedCharacteristics() const { return _characteristics; }
+    };
+
+    class SimulatedBackend::Device final : public BleDeviceBackend, public std::enable_shared_from_this<Device>
+    {
+        const std::shared_ptr<SimulatedBackend> _backend;
+        const std::shared_ptr<VirtualPeripheral> _peripheral;
+        const std::wstring _name;
+        std::atomic<bool> _isConnected{};
+        std::atomic<bool> _maintainConnection{};
+
+        // Guards the members below
+        mutable std::mutex _mutex{};
+        std::vector<std::shared_ptr<Service>> _services{};
+        std::function<void(bool)> _onStatusChanged{};
+
+    public:
+        Device(std::shared_ptr<SimulatedBackend> backend, std::shared_ptr<VirtualPeripheral> peripheral, std::wstring name)
+            : _backend{ std::move(backend) }, _peripheral{ std::move(peripheral) }, _name{ std::move(name) } {}
+
+        ~Device()
+        {
+            if (_isConnected)
+            {
+                _backend->onConnectionChanged(*_peripheral, false);
+            }
+        }
+
+        bool isConnected() const override { return _isConnected; }
+
+        std::wstring deviceId() const override
+        {
+            std::wstringstream id{};
+            id << L"BluetoothLE#Simulated-" << std::hex << _peripheral->address;
+            return id.str();
+        }
+
+        std::wstring name() const override { return _name; }
+
+        std::uint16_t mtu() const override { return _backend->_options.mtu; }
+
+        bool maintainConnection() const override { return _maintainConnection; }
+
+        void setMaintainConnection(bool maintain) override { _maintainConnection = maintain; }
+
+        Systemic::Internal::AwaitableResult<BleDiscoveryResult> requestDiscoverServices(
+            std::vector<BleUuid> servicesUuids,
+            bool useCache,
+            std::function<bool()> isCanceled) override
+        {
+            // Keep ourselves alive until the discovery completes
+            auto self = shared_from_this();
+
+            // A cached discovery doesn't query the peripheral
+            if (!useCache || !hasServices())
+            {
+                co_await delayAsync(_backend->latency(*_peripheral, _backend->_options.operationLatency));
+            }
+
+            BleDiscoveryResult result{};
+            if (!_isConnected)
+            {
+                // That's what we get from an unreachable device
+                result.status = BleRequestStatus::Timeout;
+                co_return result;
+            }
+            if (isCanceled())
+            {
+                co_return result;
+            }
+
+            std::lock_guard lock{ _mutex };
+            if (_services.empty())
+            {
+                createServices();
+            }
+            for (const auto& service : _services)
+            {
+                if (servicesUuids.empty() || std::find(servicesUuids.begin(), servicesUuids.end(), service->uuid()) != servicesUuids.end())
+                {
+                    result.services.emplace_back(service);
+                }
+            }
+            co_return result;
+        }
+
+        void setConnectionStatusHandler(std::function<void(bool)> onStatusChanged) override
+        {
+            std::lock_guard lock{ _mutex };
+            _onStatusChanged = std::move(onStatusChanged);
+        }
+
+        // Updates the connection state and notifies the model and the user code
+        void setConnected(bool isConnected)
+        {
+            if (_isConnected.exchange(isConnected) == isConnected)
+            {
+                return;
+            }
+
+            std::function<void(bool)> callback{};
+            {
+                std::lock_guard lock{ _mutex };
+                if (!isConnected)
+                {
+                    for (const auto& service : _services)
+                    {
+                        for (const auto& characteristic : service->simulatedCharacteristics())
+                        {
+                            characteristic->onLinkLost();
+                        }
+                    }
+                }
+                callback = _onStatusChanged;
+            }
+
+            _backend->onConnectionChanged(*_peripheral, isConnected);
+            if (callback)
+            {
+                callback(isConnected);
+            }
+        }
+
+        // Delivers a notification to the matching characteristic, returns whether it was delivered
+        bool deliver(const SimulatedNotification& notification)
+        {
+            std::shared_ptr<Characteristic> target{};
+            {
+                std::lock_guard lock{ _mutex };
+                for (const auto& service : _services)
+                {
+                    for (const auto& characteristic : service->simulatedCharacteristics())
+                    {
+                        if (characteristic->uuid() == notification.characteristic)
+                        {
+                            target = characteristic;
+                            break;
+                        }
+                    }
+                    if (target) break;
+                }
+            }
+            return _isConnected && target && target->deliver(notification.data);
+        }
+
+    private:
+        bool hasServices() const
+        {
+            std::lock_guard lock{ _mutex };
+            return !_services.empty();
+        }
+
+        // Instantiates the model services, call with the mutex held
+        void createServices()
+        {
+            std::uint16_t handle = 0;
+            for (auto& service : _backend->services(*_peripheral))
+            {
+                const auto serviceHandle = ++handle;
+                std::vector<std::shared_ptr<Characteristic>> characteristics{};
+                characteristics.reserve(service.characteristics.size());
+                for (auto& characteristic : service.characteristics)
+                {
+                    characteristics.emplace_back(std::make_shared<Characteristic>(
+                        _backend, _peripheral, weak_from_this(), ++handle, characteristic));
+                }
+                _services.emplace_back(std::make_shared<Service>(serviceHandle, service.uuid, std::move(characteristics)));
+            }
+        }
+    };
+
+    Systemic::Internal::AwaitableResult<BleRequestStatus> SimulatedBackend::Characteristic::requestWrite(std::vector<std::uint8_t> data, bool /*withoutResponse*/)
+    {
+        // Keep this instance alive until the write completes
+        const auto self = shared_from_this();
+
+        co_await delayAsync(_backend->latency(*_peripheral, _backend->_options.operationLatency));
+
+        auto status = BleRequestStatus::Error;
+        auto device = _device.lock();
+        if (device && device->isConnected())
+        {
+            _backend->write(*_peripheral, _info.uuid, data);
+            status = BleRequestStatus::Success;
+        }
+        co_return status;
+    }
+
+    Systemic::Internal::AwaitableResult<BleRequestStatus> SimulatedBackend::Characteristic::requestConfigureNotifications(bool enable)
+    {
+        // Keep this instance alive until the request completes
+        const auto self = shared_from_this();
+
+        co_await delayAsync(_backend->latency(*_peripheral, _backend->_options.operationLatency));
+
+        auto device = _device.lock();
+        if (!device || !device->isConnected())
+        {
+            co_return BleRequestStatus::Error;
+        }
+
+        _isNotifying = enable;
+        co_return BleRequestStatus::Success;
+    }
+
+    // Sends the advertisements of the peripherals in a round robin fashion
+    class SimulatedBackend::Scan final : public BleScanBackend
+    {
+        struct State
+        {
+            // Held while advertising so the scan can't be destroyed meanwhile
+            std::mutex mutex{};
+            std::weak_ptr<SimulatedBackend> backend{};
+            std::function<void(const AdvertisementPacket&)> onAdvertisement{};
+            TimerQueue::Clock::duration period{};
+            size_t batchSize{};
+            size_t next{};
+            TimerQueue::TimerId timerId{};
+        };
+
+        const std::shared_ptr<State> _state{ std::make_shared<State>() };
+
+    public:
+        Scan(const std::shared_ptr<SimulatedBackend>& backend, std::function<void(const AdvertisementPacket&)> onAdvertisement)
+        {
+            // Spread the advertisements over the interval, with no more than one timer per millisecond
+            const auto count = std::max<size_t>(backend->_peripherals.size(), 1);
+            const auto interval = std::max(backend->_options.advertisementInterval, std::chrono::milliseconds{ 1 });
+            const auto period = std::max<TimerQueue::Clock::duration>(interval / count, std::chrono::milliseconds{ 1 });
+
+            std::lock_guard lock{ _state->mutex };
+            _state->backend = backend;
+            _state->onAdvertisement = std::move(onAdvertisement);
+            _state->period = period;
+            _state->batchSize = std::max<size_t>(static_cast<size_t>(count * period / interval), 1);
+            _state->timerId = TimerQueue::instance().schedule(period, [state = _state]() { run(state); });
+        }
+
+        ~Scan()
+        {
+            // Waits for on-going advertisements, the callback must not destroy the scan
+            std::lock_guard lock{ _state->mutex };
+            _state->onAdvertisement = nullptr;
+            TimerQueue::instance().cancel(_state->timerId);
+        }
+
+    private:
+        static void run(const std::shared_ptr<State>& state)
+        {
+            std::lock_guard lock{ state->mutex };
+            auto backend = state->backend.lock();
+            if (!backend || !state->onAdvertisement)
+            {
+                return;
+            }
+
+            const auto& peripherals = backend->_peripherals;
+            for (size_t i = 0; i < state->batchSize && !peripherals.empty(); ++i)
+            {
+                auto& peripheral = *peripherals[state->next++ % peripherals.size()];
+                AdvertisementPacket packet{};
+                if (backend->advertise(peripheral, packet))
+                {
+                    state->onAdvertisement(packet);
+                }
+            }
+
+            state->timerId = TimerQueue::instance().schedule(state->period, [state]() { run(state); });
+        }
+    };
+
+    std::shared_ptr<SimulatedBackend> SimulatedBackend::create(SimulatedBackendOptions options, std::shared_ptr<SimulatedPeripheralModel> model)
+    {
+        assert(model);
+        std::shared_ptr<SimulatedBackend> backend{ new SimulatedBackend(std::move(options), std::move(model)) };
+        backend->scheduleTick();
+        return backend;
+    }
+
+    SimulatedBackend::SimulatedBackend(SimulatedBackendOptions options, std::shared_ptr<SimulatedPeripheralModel> model)
+        : _options{ std::move(options) }, _model{ std::move(model) }
+    {
+        _peripherals.reserve(_options.peripheralCount);
+        for (size_t i = 0; i < _options.peripheralCount; ++i)
+        {
+            _peripherals.emplace_back(std::make_shared<VirtualPeripheral>(
+                i, address(i), _options.seed + static_cast<std::uint32_t>(i)));
+        }
+    }
+
+    void SimulatedBackend::setInReach(bluetooth_address_t address, bool isInReach)
+    {
+        auto peripheral = findPeripheral(address);
+        if (!peripheral) return;
+
+        std::shared_ptr<Device> device{};
+        {
+            std::lock_guard lock{ peripheral->mutex };
+            peripheral->isInReach = isInReach;
+            device = peripheral->device.lock();
+        }
+
+        // The system only reconnects a maintained connection
+        if (device && (!isInReach || device->maintainConnection()))
+        {
+            device->setConnected(isInReach);
+        }
+    }
+
+    SimulatedBackendStats SimulatedBackend::stats() const
+    {
+        SimulatedBackendStats stats{};
+        stats.advertisements = _advertisements;
+        stats.connections = _connections;
+        stats.writes = _writes;
+        stats.bytesWritten = _bytesWritten;
+        stats.notifications = _notifications;
+        stats.bytesNotified = _bytesNotified;
+        return stats;
+    }
+
+    Systemic::Internal::AwaitableResult<std::shared_ptr<BleDeviceBackend>> SimulatedBackend::requestOpenDevice(bluetooth_address_t address)
+    {
+        auto self = shared_from_this();
+        auto peripheral = findPeripheral(address);
+        if (!peripheral)
+        {
+            co_return nullptr;
+        }
+
+        co_await delayAsync(latency(*peripheral, _options.connectLatency));
+
+        AdvertisementPacket packet{};
+        {
+            std::lock_guard lock{ _modelMutex };
+            _model->advertise(peripheral->index, packet);
+        }
+
+        auto device = std::make_shared<Device>(self, peripheral, packet.name);
+        bool isInReach = false;
+        {
+            std::lock_guard lock{ peripheral->mutex };
+            peripheral->device = device;
+            isInReach = peripheral->isInReach;
+        }
+        if (isInReach)
+        {
+            ++_connections;
+            device->setConnected(true);
+        }
+        co_return device;
+    }
+
+    std::unique_ptr<BleScanBackend> SimulatedBackend::startScan(std::function<void(const AdvertisementPacket&)> onAdvertisement)
+    {
+        return std::make_unique<Scan>(shared_from_this(), std::move(onAdvertisement));
+    }
+
+    std::shared_ptr<SimulatedBackend::VirtualPeripheral> SimulatedBackend::findPeripheral(bluetooth_address_t address) const
+    {
+        if (address < _options.firstAddress || address - _options.firstAddress >= _peripherals.size())
+        {
+            return nullptr;
+        }
+        return _peripherals[static_cast<size_t>(address - _options.firstAddress)];
+    }
+
+    std::chrono::milliseconds SimulatedBackend::latency(VirtualPeripheral& peripheral, std::chrono::milliseconds base)
+    {
+        if (_options.latencyJitter.count() <= 0)
+        {
+            return base;
+        }
+        std::lock_guard lock{ peripheral.mutex };
+        std::uniform_int_distribution<std::chrono::milliseconds::rep> jitter{ 0, _options.latencyJitter.count() };
+        return base + std::chrono::milliseconds{ jitter(peripheral.random) };
+    }
+
+    bool SimulatedBackend::advertise(VirtualPeripheral& peripheral, AdvertisementPacket& packet)
+    {
+        {
+            // A connected peripheral stops advertising
+            std::lock_guard lock{ peripheral.mutex };
+            auto device = peripheral.device.lock();
+            if (!peripheral.isInReach || (device && device->isConnected()))
+            {
+                return false;
+            }
+        }
+
+        packet.timestamp = std::chrono::system_clock::now();
+        packet.address = peripheral.address;
+        packet.isConnectable = true;
+        packet.rssi = _options.rssi;
+        {
+            std::lock_guard lock{ _modelMutex };
+            _model->advertise(peripheral.index, packet);
+        }
+        ++_advertisements;
+        return true;
+    }
+
+    std::vector<SimulatedService> SimulatedBackend::services(VirtualPeripheral& peripheral)
+    {
+        std::lock_guard lock{ _modelMutex };
+        return _model->services(peripheral.index);
+    }
+
+    void SimulatedBackend::write(VirtualPeripheral& peripheral, const BleUuid& characteristic, ByteSpan data)
+    {
+        ++_writes;
+        _bytesWritten += data.size();
+
+        std::vector<SimulatedNotification> notifications{};
+        {
+            std::lock_guard lock{ _modelMutex };
+            notifications = _model->onWrite(peripheral.index, characteristic, data);
+        }
+        notify(peripheral, std::move(notifications));
+    }
+
+    void SimulatedBackend::onConnectionChanged(VirtualPeripheral& peripheral, bool isConnected)
+    {
+        std::lock_guard lock{ _modelMutex };
+        _model->onConnectionChanged(peripheral.index, isConnected);
+    }
+
+    void SimulatedBackend::scheduleTick()
+    {
+        if (_options.tickInterval.count() <= 0)
+        {
+            return;
+        }
+
+        TimerQueue::instance().schedule(_options.tickInterval, [weakSelf = weak_from_this()]()
+            {
+                auto self = weakSelf.lock();
+                if (!self) return;
+
+                for (auto& peripheral : self->_peripherals)
+                {
+                    std::shared_ptr<Device> device{};
+                    {
+                        std::lock_guard lock{ peripheral->mutex };
+                        device = peripheral->device.lock();
+                    }
+                    if (device && device->isConnected())
+                    {
+                        std::vector<SimulatedNotification> notifications{};
+                        {
+                            std::lock_guard lock{ self->_modelMutex };
+                            notifications = self->_model->onTick(peripheral->index);
+                        }
+                        self->notify(*peripheral, std::move(notifications));
+                    }
+                }
+
+                self->scheduleTick();
+            });
+    }
+
+    void SimulatedBackend::notify(VirtualPeripheral& peripheral, std::vector<SimulatedNotification> notifications)
+    {
+        for (auto& notification : notifications)
+        {
+            const auto delay = latency(peripheral, _options.notificationLatency);
+            const auto now = TimerQueue::Clock::now();
+            TimerQueue::Clock::duration wait{};
+            {
+                // Notifications are delivered in order, whatever the jitter
+                std::lock_guard lock{ peripheral.mutex };
+                const auto deadline = std::max(now + delay, peripheral.lastNotification);
+                peripheral.lastNotification = deadline;
+                wait = deadline - now;
+            }
+
+            TimerQueue::instance().schedule(wait,
+                [weakSelf = weak_from_this(), index = peripheral.index, notification = std::move(notification)]()
+                {
+                    auto self = weakSelf.lock();
+                    if (!self) return;
+
+                    auto& peripheral = *self->_peripherals[index];
+                    std::shared_ptr<Device> device{};
+                    {
+                        std::lock_guard lock{ peripheral.mutex };
+                        device = peripheral.device.lock();
+                    }
+                    if (device && device->deliver(notification))
+                    {
+                        ++self->_notifications;
+                        self->_bytesNotified += notification.data.size();
+                    }
+                });
+        }
+    }
+}
@@ -0,0 +1,275 @@
+#include "pch.h"
+#include "Systemic/Pixels/SimulatedPixelModel.h"
+#include "Systemic/BluetoothLE/Peripheral.h"
+#include "Systemic/BluetoothLE/Characteristic.h"
+#include "Systemic/Pixels/PixelBleUuids.h"
+#include "Systemic/Pixels/Messages.h"
+#include "Systemic/Pixels/MessageSerialization.h"
+#include "Systemic/Pixels/Helpers.h"
+
+#include <string>
+
+namespace Systemic::Pixels
+{
+    namespace
+    {
+        using namespace Systemic::BluetoothLE;
+        using namespace Systemic::Pixels::Messages;
+        using namespace Systemic::Pixels::Messages::Serialization;
+
+        // Appends a little endian value to some data
+        template <typename T>
+        void appendValue(std::vector<uint8_t>& data, T value)
+        {
+            for (size_t i = 0; i < sizeof(T); ++i)
+            {
+                data.push_back(static_cast<uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        // Queues a message to be notified by the die
+        template <typename T>
+        void queueMessage(const T& message, std::vector<SimulatedNotification>& outNotifications)
+        {
+            auto& notification = outNotifications.emplace_back();
+            notification.characteristic = PixelBleUuids::notifyCharacteristic;
+            serializeMessage(message, notification.data);
+        }
+
+        // Queues a roll state message
+        template <typename Die>
+        void queueRollState(const Die& die, std::vector<SimulatedNotification>& outNotifications)
+        {
+            RollState rollState{};
+            rollState.state = die.rollState;
+            rollState.faceIndex = die.faceIndex;
+            queueMessage(rollState, outNotifications);
+        }
+
+        // Computes the data set hash reported by a die, a FNV-1a hash of the transferred animation set
+        uint32_t computeDataSetHash(const std::vector<uint8_t>& animSet, const std::vector<uint8_t>& data)
+        {
+            uint32_t hash = 0x811c9dc5u;
+            for (const auto bytes : { &animSet, &data })
+            {
+                for (const auto byte : *bytes)
+                {
+                    hash = (hash ^ byte) * 0x01000193u;
+                }
+            }
+            return hash;
+        }
+    }
+
+    void SimulatedPixelModel::advertise(size_t index, AdvertisementPacket& packet)
+    {
+        auto& die = getDie(index);
+
+        packet.name = L"SimPixel" + std::to_wstring(index + 1);
+        packet.services = { PixelBleUuids::service };
+
+        // Same layout as a Pixel advertisement, see PixelScanner
+        auto& manufacturerData = packet.manufacturersData.emplace_back();
+        manufacturerData.first = 0xFFFF;
+        manufacturerData.second = {
+            die.ledCount,
+            static_cast<uint8_t>(die.designAndColor),
+            static_cast<uint8_t>(die.rollState),
+            die.faceIndex,
+            static_cast<uint8_t>(die.batteryLevel | (Helpers::isPixelChargingOrDone(die.batteryState) ? 0x80 : 0)) };
+
+        auto& serviceData = packet.dataSections.emplace_back();
+        serviceData.first = 0x16; // Service Data - 16-bit UUID
+        appendValue(serviceData.second, static_cast<uint16_t>(PixelBleUuids::service.data1));
+        appendValue(serviceData.second, die.pixelId);
+        appendValue(serviceData.second, buildTimestamp);
+    }
+
+    std::vector<SimulatedService> SimulatedPixelModel::services(size_t /*index*/)
+    {
+        SimulatedService service{};
+        service.uuid = PixelBleUuids::service;
+        service.characteristics.push_back({ PixelBleUuids::notifyCharacteristic, CharacteristicProperties::Notify });
+        service.characteristics.push_back({ PixelBleUuids::writeCharacteristic, CharacteristicProperties::Write | CharacteristicProperties::WriteWithoutResponse });
+        return { service };
+    }
+
+    void SimulatedPixelModel::onConnectionChanged(size_t index, bool /*isConnected*/)
+    {
+        // Drop any partially received message and transfer
+        auto& die = getDie(index);
+        die.framer = MessageFramer{};
+        die.isTransferringAnimSet = false;
+        die.bulkData.clear();
+    }
+
+    std::vector<SimulatedNotification> SimulatedPixelModel::onWrite(size_t index, const BleUuid& characteristic, ByteSpan data)
+    {
+        std::vector<SimulatedNotification> notifications{};
+        if (characteristic == PixelBleUuids::writeCharacteristic)
+        {
+            auto& die = getDie(index);
+            die.framer.receive(data, [&](ByteSpan message) { onMessage(die, message, notifications); });
+        }
+        return notifications;
+    }
+
+    std::vector<SimulatedNotification> SimulatedPixelModel::onTick(size_t index)
+    {
+        std::vector<SimulatedNotification> notifications{};
+        auto& die = getDie(index);
+        if (die.rollState == PixelRollState::Rolling)
+        {
+            if (--die.rollTicksLeft <= 0)
+            {
+                die.rollState = PixelRollState::OnFace;
+                die.faceIndex = static_cast<uint8_t>(std::uniform_int_distribution<int>{ 0, die.ledCount - 1 }(die.random));
+                queueRollState(die, notifications);
+            }
+        }
+        else if (std::uniform_int_distribution<int>{ 0, 99 }(die.random) < _rollPercent)
+        {
+            die.rollState = PixelRollState::Rolling;
+            die.rollTicksLeft = std::uniform_int_distribution<int>{ 1, 3 }(die.random);
+            queueRollState(die, notifications);
+        }
+        return notifications;
+    }
+
+    SimulatedPixelModel::Die& SimulatedPixelModel::getDie(size_t index)
+    {
+        auto it = _dice.find(index);
+        if (it == _dice.end())
+        {
+            it = _dice.emplace(index, Die{ _seed ^ static_cast<uint32_t>(0x9E3779B9u * (index + 1)) }).first;
+            auto& die = it->second;
+            die.pixelId = static_cast<uint32_t>(die.random());
+            die.ledCount = 20;
+            die.designAndColor = static_cast<PixelDesignAndColor>(
+                std::uniform_int_distribution<int>{ static_cast<int>(PixelDesignAndColor::OnyxBlack), static_cast<int>(PixelDesignAndColor::HematiteGrey) }(die.random));
+            die.faceIndex = static_cast<uint8_t>(std::uniform_int_distribution<int>{ 0, die.ledCount - 1 }(die.random));
+            die.batteryLevel = static_cast<uint8_t>(std::uniform_int_distribution<int>{ 20, 100 }(die.random));
+            die.batteryState = PixelBatteryState::Ok;
+            die.dataSetHash = static_cast<uint32_t>(die.random());
+        }
+        return it->second;
+    }
+
+    void SimulatedPixelModel::onMessage(Die& die, ByteSpan message, std::vector<SimulatedNotification>& outNotifications)
+    {
+        switch (getMessageType(message))
+        {
+        case MessageType::WhoAreYou:
+        {
+            IAmADie iAmADie{};
+            iAmADie.ledCount = die.ledCount;
+            iAmADie.designAndColor = die.designAndColor;
+            iAmADie.pixelId = die.pixelId;
+            iAmADie.availableFlash = 0x4000;
+            iAmADie.buildTimestamp = buildTimestamp;
+            iAmADie.rollState = die.rollState;
+            iAmADie.currentFaceIndex = die.faceIndex;
+            iAmADie.batteryLevelPercent = die.batteryLevel;
+            iAmADie.batteryState = die.batteryState;
+            iAmADie.dataSetHash = die.dataSetHash;
+            queueMessage(iAmADie, outNotifications);
+            break;
+        }
+        case MessageType::RequestRollState:
+            queueRollState(die, outNotifications);
+            break;
+        case MessageType::RequestBatteryLevel:
+        {
+            BatteryLevel batteryLevel{};
+            batteryLevel.levelPercent = die.batteryLevel;
+            batteryLevel.state = die.batteryState;
+            queueMessage(batteryLevel, outNotifications);
+            break;
+        }
+        case MessageType::RequestRssi:
+        {
+            Rssi rssi{};
+            rssi.value = static_cast<int8_t>(std::uniform_int_distribution<int>{ -70, -50 }(die.random));
+            queueMessage(rssi, outNotifications);
+            break;
+        }
+        case MessageType::RequestTemperature:
+        {
+            Temperature temperature{};
+            temperature.mcuTemperatureTimes100 = 2500;
+            temperature.batteryTemperatureTimes100 = 2400;
+            queueMessage(temperature, outNotifications);
+            break;
+        }
+        case MessageType::Blink:
+            queueMessage(PixelMessage{ MessageType::BlinkAck }, outNotifications);
+            break;
+        case MessageType::TransferAnimSet:
+        {
+            // Start a new transfer, dropping any unfinished one
+            die.isTransferringAnimSet = true;
+            die.animSet.assign(message.begin(), message.end());
+            die.bulkData.clear();
+            TransferAnimSetAck ack{};
+            ack.result = 1;
+            queueMessage(ack, outNotifications);
+            break;
+        }
+        case MessageType::BulkSetup:
+        {
+            // Bulk data is only accepted within a transfer
+            if (die.isTransferringAnimSet && die.bulkData.empty() && message.size() >= sizeof(BulkSetup))
+            {
+                const auto size = static_cast<uint16_t>(message[1] | (message[2] << 8));
+                if (size)
+                {
+                    die.bulkData.assign(size, 0);
+                    die.bulkReceived.assign(size, false);
+                    die.bulkReceivedCount = 0;
+                    queueMessage(PixelMessage{ MessageType::BulkSetupAck }, outNotifications);
+                }
+            }
+            break;
+        }
+        case MessageType::BulkData:
+        {
+            // Only the used part of the data is sent
+            if (die.bulkData.empty() || message.size() < BulkData::headerSize)
+            {
+                break;
+            }
+            const size_t size = message[1];
+            const size_t offset = message[2] | (message[3] << 8);
+            if (message.size() < BulkData::headerSize + size || offset + size > die.bulkData.size())
+            {
+                break;
+            }
+            for (size_t i = 0; i < size; ++i)
+            {
+                die.bulkData[offset + i] = message[BulkData::headerSize + i];
+                if (!die.bulkReceived[offset + i])
+                {
+                    die.bulkReceived[offset + i] = true;
+                    ++die.bulkReceivedCount;
+                }
+            }
+            BulkDataAck ack{};
+            ack.offset = static_cast<uint16_t>(offset);
+            queueMessage(ack, outNotifications);
+
+            // Store the animation set once all the data is received
+            if (die.bulkReceivedCount == die.bulkData.size())
+            {
+                die.dataSetHash = computeDataSetHash(die.animSet, die.bulkData);
+                die.isTransferringAnimSet = false;
+                die.bulkData.clear();
+                queueMessage(PixelMessage{ MessageType::TransferAnimSetFinished }, outNotifications);
+            }
+            break;
+        }
+        default:
+            // Other requests are ignored
+            break;
+        }
+    }
+}
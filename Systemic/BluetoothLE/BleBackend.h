@@ -0,0 +1,219 @@
+/**
+ * @file
+ * @brief Definition of the BleBackend interface and the interfaces it returns.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Systemic/Internal/AwaitableResult.h"
+#include "Systemic/Internal/ByteSpan.h"
+#include "BleTypes.h"
+
+namespace Systemic::BluetoothLE
+{
+    /// An advertisement packet, as received while scanning.
+    struct AdvertisementPacket
+    {
+        /// The time at which the packet was received.
+        std::chrono::system_clock::time_point timestamp{};
+
+        /// The Bluetooth address of the advertising peripheral.
+        bluetooth_address_t address{};
+
+        /// Whether the packet is a scan response, which completes an earlier advertisement.
+        bool isScanResponse{};
+
+        /// Whether the peripheral accepts connections.
+        bool isConnectable{};
+
+        /// The received signal strength, in dBm.
+        int rssi{};
+
+        /// The advertised transmit power, in dBm.
+        int txPowerLevel{};
+
+        /// The advertised name, may be empty.
+        std::wstring name{};
+
+        /// The advertised services.
+        std::vector<BleUuid> services{};
+
+        /// The manufacturer data sections, as pairs of company id and data.
+        std::vector<std::pair<std::uint16_t, std::vector<std::uint8_t>>> manufacturersData{};
+
+        /// The raw data sections, as pairs of data type and data.
+        std::vector<std::pair<std::uint8_t, std::vector<std::uint8_t>>> dataSections{};
+    };
+
+    /**
+     * @brief Backend interface of a characteristic, see Characteristic.
+     *
+     * Requests may complete on any thread.
+     */
+    class BleCharacteristicBackend
+    {
+    public:
+        virtual ~BleCharacteristicBackend() = default;
+
+        /// Gets the 16 bits handle of the characteristic.
+        virtual std::uint16_t handle() const = 0;
+
+        /// Gets the UUID of the characteristic.
+        virtual BleUuid uuid() const = 0;
+
+        /// Gets the standard BLE properties of the characteristic, see CharacteristicProperties.
+        virtual std::uint32_t properties() const = 0;
+
+        /// Reads the value of the characteristic.
+        /// Awaiting the result doesn't block a thread, the exception thrown by a failed read is rethrown to the caller.
+        virtual Systemic::Internal::AwaitableResult<std::vector<std::uint8_t>> requestRead() = 0;
+
+        /// Writes the value of the characteristic, the data is owned by the request.
+        /// Awaiting the result doesn't block a thread, a failure completes it with an error status.
+        virtual Systemic::Internal::AwaitableResult<BleRequestStatus> requestWrite(std::vector<std::uint8_t> data, bool withoutResponse) = 0;
+
+        /// Configures the peripheral to start or stop notifying the value changes.
+        /// Awaiting the result doesn't block a thread.
+        virtual Systemic::Internal::AwaitableResult<BleRequestStatus> requestConfigureNotifications(bool enable) = 0;
+
+        /// Sets the function called with each notified value, the data being only valid during the call.
+        /// Null stops listening.
+        virtual void setValueChangedHandler(std::function<void(ByteSpan)> onValueChanged) = 0;
+    };
+
+    /// Backend interface of a primary service, see Service.
+    class BleServiceBackend
+    {
+    public:
+        virtual ~BleServiceBackend() = default;
+
+        /// Gets the 16 bits handle of the service.
+        virtual std::uint16_t handle() const = 0;
+
+        /// Gets the UUID of the service.
+        virtual BleUuid uuid() const = 0;
+
+        /// Gets the characteristics of the service, in discovery order.
+        virtual std::vector<std::shared_ptr<BleCharacteristicBackend>> characteristics() const = 0;
+
+        /// Releases the service.
+        virtual void close() = 0;
+    };
+
+    /// The outcome of a services discovery, see BleDeviceBackend::requestDiscoverServices().
+    struct BleDiscoveryResult
+    {
+        /// The status of the discovery, either Success, Timeout, ProtocolError or AccessDenied.
+        BleRequestStatus status{ BleRequestStatus::Success };
+
+        /// The discovered services.
+        std::vector<std::shared_ptr<BleServiceBackend>> services{};
+    };
+
+    /**
+     * @brief Backend interface of a peripheral with an open GATT session, see Peripheral.
+     *
+     * The connection is released when the instance is destroyed.
+     */
+    class BleDeviceBackend
+    {
+    public:
+        virtual ~BleDeviceBackend() = default;
+
+        /// Indicates whether the peripheral is connected.
+        virtual bool isConnected() const = 0;
+
+        /// Gets the device id assigned by the system.
+        virtual std::wstring deviceId() const = 0;
+
+        /// Gets the name of the peripheral.
+        virtual std::wstring name() const = 0;
+
+        /// Gets the Maximum Transmission Unit (MTU).
+        virtual std::uint16_t mtu() const = 0;
+
+        /// Indicates whether the system reconnects automatically after a link loss.
+        virtual bool maintainConnection() const = 0;
+
+        /// Sets whether the system reconnects automatically after a link loss.
+        virtual void setMaintainConnection(bool maintain) = 0;
+
+        /**
+         * @brief Discovers the services with the given UUIDs (or all services if empty)
+         *        and their characteristics.
+         * @param servicesUuids The services to discover.
+         * @param useCache Whether to use the system cache rather than querying the peripheral.
+         * @param isCanceled Returns true if the discovery should stop early.
+         * @return The discovered services, awaiting them doesn't block a thread.
+         */
+        virtual Systemic::Internal::AwaitableResult<BleDiscoveryResult> requestDiscoverServices(
+            std::vector<BleUuid> servicesUuids,
+            bool useCache,
+            std::function<bool()> isCanceled) = 0;
+
+        /// Sets the function called with the connection state when it changes, null to unhook.
+        virtual void setConnectionStatusHandler(std::function<void(bool isConnected)> onStatusChanged) = 0;
+    };
+
+    /// Backend interface of a running scan, scanning stops when the instance is destroyed.
+    class BleScanBackend
+    {
+    public:
+        virtual ~BleScanBackend() = default;
+    };
+
+    /**
+     * @brief The platform interface on which the Scanner, Peripheral, Service and
+     *        Characteristic classes are built.
+     *
+     * The default backend is the platform one, it may be replaced by a simulated one
+     * (see SimulatedBackend) to run without a Bluetooth adapter nor peripherals.
+     *
+     * @note The interface only uses portable types. The platform backend is the WinRT one
+     *       and is only available on Windows. On other platforms the library is built with
+     *       CMake and runs against a backend given to setDefault(), such as SimulatedBackend.
+     */
+    class BleBackend
+    {
+    public:
+        virtual ~BleBackend() = default;
+
+        /**
+         * @brief Gets the peripheral with the given address and opens a GATT session,
+         *        which establishes the connection.
+         * @param address The Bluetooth address of the peripheral.
+         * @return The device, or null if the peripheral is unknown. Awaiting it doesn't block a thread.
+         */
+        virtual Systemic::Internal::AwaitableResult<std::shared_ptr<BleDeviceBackend>> requestOpenDevice(bluetooth_address_t address) = 0;
+
+        /**
+         * @brief Starts scanning for advertisement packets.
+         * @param onAdvertisement Called for each received advertisement packet.
+         * @return The running scan.
+         */
+        virtual std::unique_ptr<BleScanBackend> startScan(std::function<void(const AdvertisementPacket&)> onAdvertisement) = 0;
+
+        /**
+         * @brief Gets the backend used by default for new Scanner and Peripheral instances.
+         * @return The default backend, the platform one unless replaced with setDefault().
+         * @throws std::runtime_error If there is no platform backend and none was set.
+         */
+        static std::shared_ptr<BleBackend> getDefault();
+
+        /**
+         * @brief Replaces the backend used by default for new Scanner and Peripheral instances.
+         *
+         * Existing instances keep their backend.
+         * @param backend The new default backend, null to restore the platform one.
+         */
+        static void setDefault(std::shared_ptr<BleBackend> backend);
+    };
+}
@@ -5,7 +5,18 @@
 
 #pragma once
 
+#include <algorithm> // copy
+#include <array>
 #include <cstdint>
+#include <cstring>
+#include <functional> // hash
+#include <stdexcept>
+#include <string_view>
+#include <tuple>
+
+#ifdef _WIN32
+#include <winrt/base.h>
+#endif
 
 //! \defgroup BluetoothLE
 //! @brief A collection of C++ classes that provides a simplified access to Bluetooth Low Energy peripherals.
@@ -21,6 +32,7 @@
  * to first add them in Windows' Bluetooth devices manager.
  *
  * Requires at least Windows 10 version 1709 (Fall Creators Update).
+ * On other platforms, the library only runs with a simulated backend, see BleBackend.
  *
  * The Scanner class enables scanning for Bluetooth Low Energy peripherals.
  * It stores and notifies of discovered peripherals with ScannedPeripheral objects.
@@ -39,6 +51,105 @@ namespace Systemic::BluetoothLE
     /// Type for a Bluetooth address.
     using bluetooth_address_t = std::uint64_t;
 
+    /**
+     * @brief A 128 bits Bluetooth UUID, with the same layout as a Windows GUID.
+     *
+     * On Windows it converts implicitly from and to winrt::guid.
+     */
+    struct BleUuid
+    {
+        std::uint32_t data1{};
+        std::uint16_t data2{};
+        std::uint16_t data3{};
+        std::array<std::uint8_t, 8> data4{};
+
+        /// Initializes a null UUID.
+        BleUuid() = default;
+
+        /**
+         * @brief Initializes a UUID from its string representation.
+         * @param text The UUID in the "xxxxxxxx-xxxx-xxxx-xxxx-xxxxxxxxxxxx" format, may be enclosed in braces.
+         * @throws std::invalid_argument If the text is not a valid UUID.
+         */
+        explicit BleUuid(std::string_view text)
+        {
+            if (text.size() == 38 && text.front() == '{' && text.back() == '}')
+            {
+                text = text.substr(1, 36);
+            }
+            if (text.size() != 36 || text[8] != '-' || text[13] != '-' || text[18] != '-' || text[23] != '-')
+            {
+                throw std::invalid_argument{ "Invalid UUID format" };
+            }
+
+            // The 32 hexadecimal digits, most significant first
+            std::array<std::uint8_t, 16> bytes{};
+            size_t count = 0;
+            for (size_t i = 0; i < text.size(); ++i)
+            {
+                if (i == 8 || i == 13 || i == 18 || i == 23)
+                {
+                    continue;
+                }
+                const char c = text[i];
+                const int digit = (c >= '0' && c <= '9') ? c - '0'
+                    : (c >= 'a' && c <= 'f') ? c - 'a' + 10
+                    : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+                if (digit < 0)
+                {
+                    throw std::invalid_argument{ "Invalid UUID format" };
+                }
+                bytes[count / 2] = static_cast<std::uint8_t>((bytes[count / 2] << 4) | digit);
+                ++count;
+            }
+
+            data1 = (std::uint32_t{ bytes[0] } << 24) | (std::uint32_t{ bytes[1] } << 16) | (std::uint32_t{ bytes[2] } << 8) | bytes[3];
+            data2 = static_cast<std::uint16_t>((bytes[4] << 8) | bytes[5]);
+            data3 = static_cast<std::uint16_t>((bytes[6] << 8) | bytes[7]);
+            std::copy(bytes.begin() + 8, bytes.end(), data4.begin());
+        }
+
+#ifdef _WIN32
+        /// Initializes a UUID from a WinRT GUID.
+        BleUuid(const winrt::guid& guid)
+            : data1{ guid.Data1 }, data2{ guid.Data2 }, data3{ guid.Data3 }
+        {
+            std::copy(std::begin(guid.Data4), std::end(guid.Data4), data4.begin());
+        }
+
+        /// Converts the UUID to a WinRT GUID.
+        operator winrt::guid() const
+        {
+            winrt::guid guid{};
+            guid.Data1 = data1;
+            guid.Data2 = data2;
+            guid.Data3 = data3;
+            std::copy(data4.begin(), data4.end(), std::begin(guid.Data4));
+            return guid;
+        }
+#endif
+
+        /// Indicates whether both UUIDs are equal.
+        friend bool operator==(const BleUuid& left, const BleUuid& right)
+        {
+            return std::tie(left.data1, left.data2, left.data3, left.data4)
+                == std::tie(right.data1, right.data2, right.data3, right.data4);
+        }
+
+        /// Indicates whether the UUIDs are different.
+        friend bool operator!=(const BleUuid& left, const BleUuid& right)
+        {
+            return !(left == right);
+        }
+
+        /// Orders UUIDs by their fields, used for sorting.
+        friend bool operator<(const BleUuid& left, const BleUuid& right)
+        {
+            return std::tie(left.data1, left.data2, left.data3, left.data4)
+                < std::tie(right.data1, right.data2, right.data3, right.data4);
+        }
+    };
+
     /// Peripheral requests statuses.
     enum class BleRequestStatus
     {
@@ -82,3 +193,19 @@ namespace Systemic::BluetoothLE
         Timeout,
     };
 }
+
+namespace std
+{
+    /// Hash function for BleUuid, so it may be used as a key of unordered containers.
+    template <>
+    struct hash<Systemic::BluetoothLE::BleUuid>
+    {
+        size_t operator()(const Systemic::BluetoothLE::BleUuid& uuid) const noexcept
+        {
+            std::uint64_t low{};
+            std::memcpy(&low, uuid.data4.data(), sizeof(low));
+            const std::uint64_t high = (std::uint64_t{ uuid.data1 } << 32) | (std::uint64_t{ uuid.data2 } << 16) | uuid.data3;
+            return std::hash<std::uint64_t>{}(high ^ low);
+        }
+    };
+}
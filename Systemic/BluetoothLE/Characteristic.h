@@ -6,6 +6,12 @@
 #pragma once
 
 #include <type_traits> // underlying_type
+#include <memory>
+#include <optional>
+#include "Systemic/Internal/AwaitableResult.h"
+#include "Systemic/Internal/ByteSpan.h"
+#include "BleBackend.h"
+#include "WriteFlowController.h"
 
 namespace Systemic::BluetoothLE
 {
@@ -56,23 +62,45 @@ namespace Systemic::BluetoothLE
      *
      * Those operations are asynchronous and return a std::future.
      *
-     * The Characteristic class internally stores a WinRT's \c GattCharacteristic object.
+     * The Characteristic class internally stores a BleCharacteristicBackend object,
+     * which wraps a WinRT's \c GattCharacteristic object with the default backend.
      */
     class Characteristic
     {
-        using GattCharacteristic = winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattCharacteristic;
-        using GattValueChangedEventArgs = winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattValueChangedEventArgs;
-
         // Characteristic
-        GattCharacteristic _characteristic{ nullptr };
+        const std::shared_ptr<BleCharacteristicBackend> _characteristic;
 
-        // The user callback for value changes
-        std::function<void(const std::vector<std::uint8_t>&)> _onValueChanged{};
+    public:
+        /// Identifies a subscription to the value changes, see subscribeAsync().
+        using SubscriptionId = std::uint32_t;
 
-        // Value change
-        winrt::event_token _valueChangedToken{};
+    private:
+        using ValueChangedHandler = std::function<void(ByteSpan)>;
+
+        struct Subscriber
+        {
+            SubscriptionId id{};
+            ValueChangedHandler onValueChanged{};
+        };
+
+        using SubscriberList = std::vector<Subscriber>;
+
+        // The user callbacks for value changes, the list is never modified but replaced
+        // as a whole with std::atomic_store() so notifications may read it without taking a lock
+        std::shared_ptr<const SubscriberList> _subscribers{};
+
+        // Value change, the members below are guarded by the mutex
+        bool _isListening{};
+        SubscriptionId _lastSubscriptionId{};
+        bool _isNotifying{};            // Last configuration written to the peripheral
+        bool _isNotifyRefreshNeeded{};  // Whether the peripheral may have lost its configuration
+        bool _isUpdatingNotify{};       // Whether a configuration write is ongoing
+        std::vector<Systemic::Internal::AwaitableResult<BleRequestStatus>> _notifyWaiters{}; // Callers waiting for it
         std::recursive_mutex _subscribeMtx{};
 
+        // Pacing of the writes without response, shared with the writes in progress
+        const std::shared_ptr<WriteFlowController> _writeFlow{ std::make_shared<WriteFlowController>() };
+
     public:
         //! \name Destructor
         //! @{
@@ -82,11 +110,7 @@ namespace Systemic::BluetoothLE
          */
         ~Characteristic()
         {
-            if (_characteristic)
-            {
-                _characteristic.ValueChanged(_valueChangedToken);
-                _characteristic = nullptr;
-            }
+            _characteristic->setValueChangedHandler(nullptr);
         }
 
         //! @}
@@ -100,7 +124,7 @@ namespace Systemic::BluetoothLE
          */
         std::uint16_t handle() const
         {
-            return _characteristic.AttributeHandle();
+            return _characteristic->handle();
         }
 
         /**
@@ -108,9 +132,9 @@ namespace Systemic::BluetoothLE
          *
          * @return The UUID of the characteristic.
          */
-        winrt::guid uuid() const
+        BleUuid uuid() const
         {
-            return _characteristic.Uuid();
+            return _characteristic->uuid();
         }
 
         /**
@@ -122,7 +146,7 @@ namespace Systemic::BluetoothLE
         std::underlying_type<CharacteristicProperties>::type properties() const
         {
             return static_cast<std::underlying_type<CharacteristicProperties>::type>(
-                _characteristic.CharacteristicProperties());
+                _characteristic->properties());
         }
 
         /**
@@ -171,8 +195,7 @@ namespace Systemic::BluetoothLE
             // TODO return error code
 
             // Read from characteristic
-            auto result = co_await _characteristic.ReadValueAsync();
-            co_return Internal::dataBufferToBytesVector(result.Value());
+            return Systemic::Internal::toFuture(_characteristic->requestRead());
         }
 
         /**
@@ -180,6 +203,10 @@ namespace Systemic::BluetoothLE
          *
          * The call fails if the characteristic is not writable.
          *
+         * Writes without response are paced by a credit window: when too many of them
+         * are in flight, the write waits for an earlier one to complete before starting.
+         * See writeFlowStats().
+         *
          * @param data The data to write to the characteristic (may be empty).
          * @param withoutResponse Whether to wait for the peripheral to respond.
          * @return A future with the resulting request status.
@@ -187,104 +214,402 @@ namespace Systemic::BluetoothLE
         std::future<BleRequestStatus> writeAsync(const std::vector<std::uint8_t>& data, bool withoutResponse = false)
         {
             // TODO use std::span, test with empty buffer
-            using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+            return Systemic::Internal::toFuture(requestWrite(data, withoutResponse));
+        }
+
+        /**
+         * @brief Writes the given data to the value of the characteristic,
+         *        see writeAsync().
+         *
+         * Unlike awaiting a std::future, awaiting the result doesn't block a thread.
+         * A failure, including an exception thrown by the system, completes it with an error status.
+         *
+         * @param data The data to write to the characteristic, copied before returning.
+         * @param withoutResponse Whether to wait for the peripheral to respond.
+         * @return The resulting request status, to be awaited once.
+         */
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestWrite(const std::vector<std::uint8_t>& data, bool withoutResponse = false)
+        {
+            // Copy the data, the caller's vector may not outlive this call
+            std::vector<std::uint8_t> buffer{ data };
+
+            if (!withoutResponse)
+            {
+                // Write to characteristic
+                return _characteristic->requestWrite(std::move(buffer), false);
+            }
+
+            Systemic::Internal::AwaitableResult<BleRequestStatus> result{};
+            writeWithoutResponseAsync(_characteristic, _writeFlow, std::move(buffer), result);
+            return result;
+        }
 
-            // Write to characteristic
-            auto options = withoutResponse ? GattWriteOption::WriteWithoutResponse : GattWriteOption::WriteWithResponse;
-            auto result = co_await _characteristic.WriteValueAsync(Internal::bytesVectorToDataBuffer(data), options);
+        /**
+         * @brief Waits until a write without response may start right away.
+         *
+         * This lets a caller keep its data until the credit window has room for it,
+         * rather than queuing many writes at once.
+         *
+         * @return A future that completes once a write without response may start.
+         */
+        std::future<void> waitForWriteCreditAsync()
+        {
+            return Systemic::Internal::toVoidFuture(waitForWriteCredit());
+        }
 
-            co_return result == GattCommunicationStatus::Success ? BleRequestStatus::Success : BleRequestStatus::Error;
+        /**
+         * @brief Same as waitForWriteCreditAsync() but awaiting the result doesn't block a thread.
+         *
+         * @return The credit availability, to be awaited once.
+         */
+        WriteFlowController::Credit waitForWriteCredit()
+        {
+            return _writeFlow->waitAvailable();
+        }
+
+        /**
+         * @brief Gets the statistics of the writes without response.
+         *
+         * @return A snapshot of the write flow statistics.
+         */
+        WriteFlowStats writeFlowStats() const
+        {
+            return _writeFlow->stats();
         }
 
         /**
          * @brief Subscribes for value changes of the characteristic.
          *
-         * Replaces a previously registered value change callback.
-         * The call fails if the characteristic doesn't support notifications.
+         * Several subscribers may be registered at once, each one is notified of
+         * the value changes. The peripheral is configured for notifications only
+         * on the first subscription.
+         * The call fails if the characteristic doesn't support notifications,
+         * the subscriber is then removed.
          *
          * @param onValueChanged Called when the value of the characteristic changes.
+         * @param outId If not null, set with the id of the subscription before the function returns.
          * @return A future with the resulting request status.
          */
-        std::future<BleRequestStatus> subscribeAsync(const std::function<void(const std::vector<std::uint8_t>&)>& onValueChanged)
+        std::future<BleRequestStatus> subscribeAsync(
+            const std::function<void(const std::vector<std::uint8_t>&)>& onValueChanged,
+            SubscriptionId* outId = nullptr)
         {
-            using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+            if (!onValueChanged)
+            {
+                return subscribeSpanAsync(nullptr, outId);
+            }
+            return subscribeSpanAsync([onValueChanged](ByteSpan data)
+                {
+                    onValueChanged(std::vector<std::uint8_t>{ data.begin(), data.end() });
+                },
+                outId);
+        }
 
+        /**
+         * @brief Subscribes for value changes of the characteristic, with a callback
+         *        given a view on the notified data rather than a copy.
+         *
+         * The view borrows the system buffer and is only valid during the callback,
+         * the data must be copied to be used afterwards.
+         * See subscribeAsync() for the other details.
+         *
+         * @param onValueChanged Called when the value of the characteristic changes.
+         * @param outId If not null, set with the id of the subscription before the function returns.
+         * @return A future with the resulting request status.
+         */
+        std::future<BleRequestStatus> subscribeSpanAsync(std::function<void(ByteSpan)> onValueChanged, SubscriptionId* outId = nullptr)
+        {
+            return Systemic::Internal::toFuture(requestSubscribe(std::move(onValueChanged), outId));
+        }
+
+        /**
+         * @brief Same as subscribeSpanAsync() but awaiting the result doesn't block a thread.
+         *
+         * @param onValueChanged Called when the value of the characteristic changes.
+         * @param outId If not null, set with the id of the subscription before the function returns.
+         * @return The resulting request status, to be awaited once.
+         */
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestSubscribe(std::function<void(ByteSpan)> onValueChanged, SubscriptionId* outId = nullptr)
+        {
             // Check parameters
             if (!onValueChanged) co_return BleRequestStatus::InvalidParameters;
             if (!canNotify()) co_return BleRequestStatus::NotSupported;
 
+            SubscriptionId id{};
             {
                 std::lock_guard lock{ _subscribeMtx };
 
-                // Store the callback and subscribe
-                _onValueChanged = onValueChanged;
-                if (!_valueChangedToken)
+                // Copy the list with the new subscriber, notifications being processed keep using the previous list
+                auto subscribers = _subscribers ? std::make_shared<SubscriberList>(*_subscribers) : std::make_shared<SubscriberList>();
+                id = ++_lastSubscriptionId;
+                subscribers->push_back(Subscriber{ id, std::move(onValueChanged) });
+                std::atomic_store(&_subscribers, std::shared_ptr<const SubscriberList>{ std::move(subscribers) });
+
+                if (!_isListening)
                 {
-                    _valueChangedToken = _characteristic.ValueChanged({ this, &Characteristic::onValueChanged });
+                    _isListening = true;
+                    _characteristic->setValueChangedHandler([this](ByteSpan data) { this->onValueChanged(data); });
+                }
+                if (outId)
+                {
+                    *outId = id;
                 }
             }
 
-            // Update characteristic configuration
-            auto result = co_await _characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::Notify);
+            const auto status = co_await requestNotificationsUpdate(false).waitAsync();
+            if (status != BleRequestStatus::Success)
+            {
+                // Don't leave a subscriber that won't get notified
+                co_await requestUnsubscribe(id).waitAsync();
+            }
+            co_return status;
+        }
 
-            co_return result == GattCommunicationStatus::Success ? BleRequestStatus::Success : BleRequestStatus::Error;
+        /**
+         * @brief Configures the peripheral again for notifications if there are subscribers.
+         *
+         * The configuration may be lost when the connection is interrupted,
+         * this restores it without changing the subscriptions.
+         *
+         * @return A future with the resulting request status.
+         */
+        std::future<BleRequestStatus> refreshSubscriptionsAsync()
+        {
+            return Systemic::Internal::toFuture(requestRefreshSubscriptions());
+        }
+
+        /**
+         * @brief Same as refreshSubscriptionsAsync() but awaiting the result doesn't block a thread.
+         *
+         * @return The resulting request status, to be awaited once.
+         */
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestRefreshSubscriptions()
+        {
+            if (!hasSubscribers())
+            {
+                co_return BleRequestStatus::Success;
+            }
+            co_return co_await requestNotificationsUpdate(true).waitAsync();
         }
 
         /**
          * @brief Unsubscribes from value changes of the characteristic.
          *
+         * The peripheral is configured to stop notifications when the last subscriber leaves.
+         *
+         * @param id The id of the subscription, as returned by subscribeAsync().
+         * @return A future with the resulting request status.
+         */
+        std::future<BleRequestStatus> unsubscribeAsync(SubscriptionId id)
+        {
+            return Systemic::Internal::toFuture(requestUnsubscribe(id));
+        }
+
+        /**
+         * @brief Same as unsubscribeAsync(SubscriptionId) but awaiting the result doesn't block a thread.
+         *
+         * @param id The id of the subscription, as returned by subscribeAsync().
+         * @return The resulting request status, to be awaited once.
+         */
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestUnsubscribe(SubscriptionId id)
+        {
+            {
+                std::lock_guard lock{ _subscribeMtx };
+
+                if (!_subscribers)
+                {
+                    co_return BleRequestStatus::Success;
+                }
+                const auto it = std::find_if(_subscribers->begin(), _subscribers->end(),
+                    [id](const Subscriber& s) { return s.id == id; });
+                if (it == _subscribers->end())
+                {
+                    co_return BleRequestStatus::Success;
+                }
+
+                // Copy the list without the subscriber
+                auto subscribers = std::make_shared<SubscriberList>();
+                subscribers->reserve(_subscribers->size() - 1);
+                std::copy_if(_subscribers->begin(), _subscribers->end(), std::back_inserter(*subscribers),
+                    [id](const Subscriber& s) { return s.id != id; });
+                if (!subscribers->empty())
+                {
+                    std::atomic_store(&_subscribers, std::shared_ptr<const SubscriberList>{ std::move(subscribers) });
+                    co_return BleRequestStatus::Success;
+                }
+
+                // That was the last subscriber
+                removeAllSubscribers();
+            }
+
+            co_return co_await requestNotificationsUpdate(false).waitAsync();
+        }
+
+        /**
+         * @brief Unsubscribes all the subscribers from value changes of the characteristic.
+         *
          * @return A future with the resulting request status.
          */
         std::future<BleRequestStatus> unsubscribeAsync()
         {
-            using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+            return Systemic::Internal::toFuture(requestUnsubscribe());
+        }
 
+        /**
+         * @brief Same as unsubscribeAsync() but awaiting the result doesn't block a thread.
+         *
+         * @return The resulting request status, to be awaited once.
+         */
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestUnsubscribe()
+        {
             {
                 // Check if subscribed
                 std::lock_guard lock{ _subscribeMtx };
-                if (!_onValueChanged)
+                if (!_subscribers)
                 {
                     co_return BleRequestStatus::Success;
                 }
 
-                // Forget the callback
-                _onValueChanged = nullptr;
+                removeAllSubscribers();
             }
 
-            // Unsubscribe
-            _characteristic.ValueChanged(_valueChangedToken);
-            _valueChangedToken = winrt::event_token{};
+            co_return co_await requestNotificationsUpdate(false).waitAsync();
+        }
 
-            // Update characteristic configuration
-            auto result = co_await _characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(
-                GattClientCharacteristicConfigurationDescriptorValue::None);
+    private:
+        friend class Peripheral;
 
-            co_return result == GattCommunicationStatus::Success ? BleRequestStatus::Success : BleRequestStatus::Error;
+        // Initialize a new instance with a backend characteristic
+        explicit Characteristic(std::shared_ptr<BleCharacteristicBackend> characteristic)
+            : _characteristic{ std::move(characteristic) }
+        {
+            assert(_characteristic);
         }
 
-    private:
-        friend std::future<BleRequestStatus> Peripheral::connectAsync(std::vector<winrt::guid>, bool);
+        // Waits for a credit and writes without response, the completion of the operation returns the credit
+        static Systemic::Internal::DetachedTask writeWithoutResponseAsync(
+            std::shared_ptr<BleCharacteristicBackend> characteristic,
+            std::shared_ptr<WriteFlowController> writeFlow,
+            std::vector<std::uint8_t> data,
+            Systemic::Internal::AwaitableResult<BleRequestStatus> result)
+        {
+            // Wait for our turn
+            co_await writeFlow->acquire().waitAsync();
+
+            const size_t size = data.size();
+            const auto start = WriteFlowController::Clock::now();
+            const bool success = co_await characteristic->requestWrite(std::move(data), true).waitAsync() == BleRequestStatus::Success;
+            writeFlow->release(WriteFlowController::Clock::now() - start, size, success);
+
+            result.trySetResult(success ? BleRequestStatus::Success : BleRequestStatus::Error);
+        }
 
-        // Initialize a new instance with a GattCharacteristic object
-        explicit Characteristic(GattCharacteristic characteristic)
-            : _characteristic{ characteristic }
+        // Whether there is at least one subscriber
+        bool hasSubscribers() const
         {
+            const auto subscribers = std::atomic_load(&_subscribers);
+            return subscribers && !subscribers->empty();
         }
 
-        // Called when subscribed to the characteristic and its value changes
-        void onValueChanged(GattCharacteristic _, GattValueChangedEventArgs args)
+        // Configures the peripheral to notify value changes if there are subscribers, and to stop
+        // otherwise. Writes are serialized, a single request serves concurrent callers and it writes
+        // again if subscribers come or go in the meantime, so the last write matches the subscribers.
+        // The force parameter writes the configuration even if it is believed up to date.
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestNotificationsUpdate(bool force)
         {
-            // Safely get the callback
-            std::function<void(const std::vector<std::uint8_t>&)> callback{};
+            Systemic::Internal::AwaitableResult<BleRequestStatus> pending{};
+            bool isWaiting = false;
             {
                 std::lock_guard lock{ _subscribeMtx };
-                callback = _onValueChanged;
+                _isNotifyRefreshNeeded = _isNotifyRefreshNeeded || (force && _isListening);
+                if (_isUpdatingNotify)
+                {
+                    // Wait for the ongoing request, which checks the subscribers again once done
+                    _notifyWaiters.push_back(pending);
+                    isWaiting = true;
+                }
+                else if (_isNotifying == _isListening && !_isNotifyRefreshNeeded)
+                {
+                    co_return BleRequestStatus::Success;
+                }
+                else
+                {
+                    _isUpdatingNotify = true;
+                }
+            }
+            if (isWaiting)
+            {
+                co_return co_await pending.waitAsync();
+            }
+
+            auto status = BleRequestStatus::Success;
+            std::vector<Systemic::Internal::AwaitableResult<BleRequestStatus>> waiters{};
+            while (true)
+            {
+                bool enable{};
+                {
+                    std::lock_guard lock{ _subscribeMtx };
+                    if (status != BleRequestStatus::Success
+                        || (_isNotifying == _isListening && !_isNotifyRefreshNeeded))
+                    {
+                        // Done, in the same lock as the check so no caller waits for a request that won't write
+                        _isUpdatingNotify = false;
+                        waiters.swap(_notifyWaiters);
+                        break;
+                    }
+                    enable = _isListening;
+                    _isNotifyRefreshNeeded = false;
+                }
+
+                try
+                {
+                    // Update characteristic configuration
+                    status = co_await _characteristic->requestConfigureNotifications(enable).waitAsync();
+                }
+                catch (...)
+                {
+                    status = BleRequestStatus::Error;
+                }
+
+                {
+                    std::lock_guard lock{ _subscribeMtx };
+                    if (status == BleRequestStatus::Success)
+                    {
+                        _isNotifying = enable;
+                    }
+                    else if (enable)
+                    {
+                        // Unknown state, the next subscriber tries again
+                        _isNotifying = false;
+                    }
+                }
             }
+            for (auto& waiter : waiters)
+            {
+                waiter.trySetResult(status);
+            }
+            co_return status;
+        }
+
+        // Forgets the callbacks and stops listening to value changes, must be called with the mutex held
+        void removeAllSubscribers()
+        {
+            std::atomic_store(&_subscribers, std::shared_ptr<const SubscriberList>{});
+            _characteristic->setValueChangedHandler(nullptr);
+            _isListening = false;
+        }
 
-            if (callback)
+        // Called when subscribed to the characteristic and its value changes
+        void onValueChanged(ByteSpan data)
+        {
+            // Safely get the subscribers, without copying them
+            const auto subscribers = std::atomic_load(&_subscribers);
+            if (subscribers)
             {
-                callback(Internal::dataBufferToBytesVector(args.CharacteristicValue()));
+                for (const auto& subscriber : *subscribers)
+                {
+                    subscriber.onValueChanged(data);
+                }
             }
         }
     };
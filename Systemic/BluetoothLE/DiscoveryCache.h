@@ -0,0 +1,133 @@
+/**
+ * @file
+ * @brief Definition of the DiscoveryCache class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "BleTypes.h"
+
+namespace Systemic::BluetoothLE
+{
+    /// The layout of a GATT service, as discovered on a peripheral.
+    struct DiscoveredServiceLayout
+    {
+        /// The service UUID.
+        BleUuid uuid{};
+
+        /// The UUIDs of the characteristics of the service, in discovery order.
+        std::vector<BleUuid> characteristics{};
+    };
+
+    /**
+     * @brief A cache of the GATT services layouts discovered on peripherals.
+     *
+     * Layouts are stored by Bluetooth address and by a tag identifying the peripheral
+     * firmware, such as its build date. When a layout is known, Peripheral::connectAsync()
+     * first runs the services discovery using the system cache, which doesn't require
+     * any exchange with the peripheral, and only falls back to an uncached discovery
+     * if the result doesn't match the stored layout.
+     *
+     * A same cache instance is typically shared by all the Peripheral instances.
+     *
+     * This class is thread safe.
+     */
+    class DiscoveryCache
+    {
+        using Key = std::pair<bluetooth_address_t, uint64_t>;
+
+        std::map<Key, std::shared_ptr<const std::vector<DiscoveredServiceLayout>>> _layouts{};
+        mutable std::mutex _mutex{};
+
+    public:
+        /**
+         * @brief Gets a cache instance shared by the whole application.
+         * @return The shared cache instance.
+         */
+        static const std::shared_ptr<DiscoveryCache>& shared()
+        {
+            static const std::shared_ptr<DiscoveryCache> cache{ new DiscoveryCache{} };
+            return cache;
+        }
+
+        /**
+         * @brief Gets the services layout stored for a peripheral.
+         * @param address The Bluetooth address of the peripheral.
+         * @param tag The tag identifying the peripheral firmware.
+         * @return The services layout, or null if not in the cache.
+         */
+        std::shared_ptr<const std::vector<DiscoveredServiceLayout>> find(bluetooth_address_t address, uint64_t tag) const
+        {
+            std::lock_guard lock{ _mutex };
+            auto it = _layouts.find(Key{ address, tag });
+            return it != _layouts.end() ? it->second : nullptr;
+        }
+
+        /**
+         * @brief Adds or replaces the services layout of a peripheral.
+         *
+         * The services that were previously stored for the same peripheral and tag,
+         * but that are not in the given layout, are kept.
+         * @param address The Bluetooth address of the peripheral.
+         * @param tag The tag identifying the peripheral firmware.
+         * @param services The discovered services.
+         */
+        void add(bluetooth_address_t address, uint64_t tag, std::vector<DiscoveredServiceLayout> services)
+        {
+            std::lock_guard lock{ _mutex };
+            auto& layout = _layouts[Key{ address, tag }];
+            if (layout)
+            {
+                for (const auto& previous : *layout)
+                {
+                    const auto it = std::find_if(services.begin(), services.end(),
+                        [&previous](const auto& s) { return s.uuid == previous.uuid; });
+                    if (it == services.end())
+                    {
+                        services.push_back(previous);
+                    }
+                }
+            }
+            layout = std::make_shared<const std::vector<DiscoveredServiceLayout>>(std::move(services));
+        }
+
+        /**
+         * @brief Removes the services layouts stored for a peripheral.
+         * @param address The Bluetooth address of the peripheral.
+         */
+        void remove(bluetooth_address_t address)
+        {
+            std::lock_guard lock{ _mutex };
+            for (auto it = _layouts.begin(); it != _layouts.end();)
+            {
+                it = it->first.first == address ? _layouts.erase(it) : std::next(it);
+            }
+        }
+
+        /**
+         * @brief Gets the number of layouts in the cache.
+         * @return The number of layouts.
+         */
+        size_t size() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _layouts.size();
+        }
+
+        /// Removes all the layouts from the cache.
+        void clear()
+        {
+            std::lock_guard lock{ _mutex };
+            _layouts.clear();
+        }
+    };
+}
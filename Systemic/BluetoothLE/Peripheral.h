@@ -5,7 +5,11 @@
 
 #pragma once
 
+#include <atomic>
+#include "Systemic/Internal/SpscQueue.h"
 #include "BleTypes.h"
+#include "BleBackend.h"
+#include "DiscoveryCache.h"
 
 namespace Systemic::BluetoothLE
 {
@@ -61,6 +65,19 @@ namespace Systemic::BluetoothLE
         Peripheral,
     };
 
+    /// Services discovery settings for Peripheral::connectAsync().
+    struct DiscoveryOptions
+    {
+        /// Whether to only discover the required services, all services are discovered if none is required.
+        bool requiredServicesOnly = false;
+
+        /// Cache of the discovered services layouts, null to always run an uncached discovery.
+        std::shared_ptr<DiscoveryCache> cache{};
+
+        /// Tag identifying the peripheral firmware, a cached layout is only used for the same tag.
+        uint64_t cacheTag{};
+    };
+
     /**
      * @brief Represents a Bluetooth Low Energy (BLE) peripheral.
      *
@@ -79,45 +96,55 @@ namespace Systemic::BluetoothLE
      * A specific Service may be retrieved by its UUID with getDiscoveredService().
      * A service contains characteristics for which data may be read or written.
      *
-     * The Peripheral class internally stores a WinRT's \c BluetoothLEDevice and \c GattSession objects.
+     * The Peripheral class internally stores a BleDeviceBackend object once connected,
+     * which wraps a WinRT's \c BluetoothLEDevice and \c GattSession objects with the default backend.
      * @see https://docs.microsoft.com/en-us/uwp/api/windows.devices.bluetooth.bluetoothledevice
      */
     class Peripheral : public std::enable_shared_from_this<Peripheral>
     {
-        using BluetoothLEDevice = winrt::Windows::Devices::Bluetooth::BluetoothLEDevice;
-        using GattSession = winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattSession;
-
         // The Bluetooth address
         const bluetooth_address_t _address{};
 
         // The user callback for connection events
         const std::function<void(ConnectionEvent, ConnectionEventReason)> _onConnectionEvent{};
 
-        // Device and session
-        BluetoothLEDevice _device{ nullptr };
-        GattSession _session{ nullptr };
-        winrt::event_token _connectionStatusChangedToken{};
+        // The backend used to connect
+        const std::shared_ptr<BleBackend> _backend;
+
+        // Device with its session
+        std::shared_ptr<BleDeviceBackend> _device{};
 
         // Services
-        std::unordered_map<winrt::guid, std::shared_ptr<Service>> _services{};
+        std::unordered_map<BleUuid, std::shared_ptr<Service>> _services{};
 
-        // The ready state
+        // The ready state, and whether the link was lost while maintaining the connection
         volatile bool _isReady{};
+        volatile bool _isLinkLost{};
 
         // Connection
         mutable std::recursive_mutex _connectOpMtx{};   // Connection mutex
         volatile size_t _connectCounter{};              // Incremented every time connect or disconnect is called
         volatile bool _connecting{};                    // Whether we are trying to connect
 
-        // Queue of connection events to notify to user
-        std::vector<std::tuple<ConnectionEvent, ConnectionEventReason>> _connectionEventsQueue{};
+        // Queue of connection events to notify to user, events are pushed with the connection mutex held
+        // and popped by one thread at a time, as flagged by _notifyingConnectionEvents
+        Systemic::Internal::SpscQueue<std::tuple<ConnectionEvent, ConnectionEventReason>, 32> _connectionEventsQueue{};
+        std::atomic<bool> _notifyingConnectionEvents{};
+
+        // Events that didn't fit in the queue, notified after the queued ones
+        std::vector<std::tuple<ConnectionEvent, ConnectionEventReason>> _connectionEventsOverflow{};
+        std::atomic<size_t> _connectionEventsOverflowSize{};
+        std::mutex _connectionEventsOverflowMtx{};
 
-        Peripheral(bluetooth_address_t bluetoothAddress, const std::function<void(ConnectionEvent, ConnectionEventReason)>& onConnectionEvent)
+        Peripheral(
+            bluetooth_address_t bluetoothAddress,
+            const std::function<void(ConnectionEvent, ConnectionEventReason)>& onConnectionEvent,
+            std::shared_ptr<BleBackend> backend)
             : _address{ bluetoothAddress }, _onConnectionEvent{ onConnectionEvent }
+            , _backend{ backend ? std::move(backend) : BleBackend::getDefault() }
         {
             assert(bluetoothAddress); // TODO check arguments
             assert(onConnectionEvent);
-            _connectionEventsQueue.reserve(16);
         }
 
     public:
@@ -130,13 +157,15 @@ namespace Systemic::BluetoothLE
          *
          * @param bluetoothAddress The Bluetooth address of the BLE peripheral.
          * @param onConnectionEvent Called when the connection status of the peripheral changes.
+         * @param backend The backend to use for connecting, null for the default one (see BleBackend::getDefault()).
          * @return A Peripheral instance in a shared pointer.
          */
         static std::shared_ptr<Peripheral> create(
             bluetooth_address_t bluetoothAddress,
-            const std::function<void(ConnectionEvent, ConnectionEventReason)>& onConnectionEvent)
+            const std::function<void(ConnectionEvent, ConnectionEventReason)>& onConnectionEvent,
+            std::shared_ptr<BleBackend> backend = nullptr)
         {
-            return std::shared_ptr<Peripheral>{ new Peripheral(bluetoothAddress, onConnectionEvent) };
+            return std::shared_ptr<Peripheral>{ new Peripheral(bluetoothAddress, onConnectionEvent, std::move(backend)) };
         }
 
         /**
@@ -160,11 +189,35 @@ namespace Systemic::BluetoothLE
          * @param requiredServices List of services UUIDs that the peripheral should support, may be empty.
          * @param maintainConnection Whether to automatically reconnect after an unexpected disconnection
          *                           (i.e. not requested by a call to disconnect()).
+         *                           A Disconnected event with the LinkLoss reason is then raised
+         *                           when the link is lost, followed by the Connected and Ready events
+         *                           once it is restored. The discovered services are kept in between.
+         *                           Calling this method while the link is lost starts a new connection.
+         * @param discoveryOptions Services discovery settings. When the services layout of the peripheral
+         *                         is in the given cache, the discovery first uses the system cache and
+         *                         only queries the peripheral if the result doesn't match the layout.
          * @return A future with the resulting request status.
          */
         std::future<BleRequestStatus> connectAsync(
-            std::vector<winrt::guid> requiredServices = std::vector<winrt::guid>{},
-            bool maintainConnection = false);
+            std::vector<BleUuid> requiredServices = std::vector<BleUuid>{},
+            bool maintainConnection = false,
+            DiscoveryOptions discoveryOptions = {})
+        {
+            return Systemic::Internal::toFuture(requestConnect(std::move(requiredServices), maintainConnection, std::move(discoveryOptions)));
+        }
+
+        /**
+         * @brief Same as connectAsync() but awaiting the result doesn't block a thread.
+         *
+         * @param requiredServices List of services UUIDs that the peripheral should support, may be empty.
+         * @param maintainConnection Whether to automatically reconnect after an unexpected disconnection.
+         * @param discoveryOptions Services discovery settings.
+         * @return The resulting request status, to be awaited once.
+         */
+        Systemic::Internal::AwaitableResult<BleRequestStatus> requestConnect(
+            std::vector<BleUuid> requiredServices = std::vector<BleUuid>{},
+            bool maintainConnection = false,
+            DiscoveryOptions discoveryOptions = {});
 
         /**
          * @brief Immediately disconnects the peripheral.
@@ -201,10 +254,8 @@ namespace Systemic::BluetoothLE
          */
         bool isConnected() const
         {
-            using namespace winrt::Windows::Devices::Bluetooth;
-
             auto dev = safeGetDevice();
-            return dev ? (dev.ConnectionStatus() == BluetoothConnectionStatus::Connected) : false;
+            return dev ? dev->isConnected() : false;
         }
 
         /**
@@ -220,6 +271,17 @@ namespace Systemic::BluetoothLE
             return _isReady;
         }
 
+        /**
+         * @brief Indicates whether the link was lost while maintaining the connection,
+         *        and is waiting to be restored.
+         *
+         * @return Whether the link is lost.
+         */
+        bool isLinkLost() const
+        {
+            return _isLinkLost;
+        }
+
         //! @}
         //! \name Connected getters
         //! Valid only for connected peripherals.
@@ -230,21 +292,21 @@ namespace Systemic::BluetoothLE
          *
          * @return The device id assigned by the system.
          */
-        const winrt::hstring deviceId() const
+        const std::wstring deviceId() const
         {
             auto dev = safeGetDevice();
-            return dev ? dev.DeviceId() : winrt::hstring{};
+            return dev ? dev->deviceId() : std::wstring{};
         }
 
         /**
          * @brief Gets the name of the peripheral.
          *
-         * @return The name of the peripheral, or null if it doesn't have a valid device.
+         * @return The name of the peripheral, or empty if it doesn't have a valid device.
          */
-        const winrt::hstring name() const
+        const std::wstring name() const
         {
             auto dev = safeGetDevice();
-            return dev ? dev.Name() : winrt::hstring{};
+            return dev ? dev->name() : std::wstring{};
         }
 
         /**
@@ -256,7 +318,7 @@ namespace Systemic::BluetoothLE
         {
             // TODO is the lock needed?
             std::lock_guard lock{ _connectOpMtx };
-            return _session ? _session.MaxPduSize() : 0;
+            return _device ? _device->mtu() : 0;
         }
 
         //! @}
@@ -270,7 +332,7 @@ namespace Systemic::BluetoothLE
          * @param uuid The UUID of the service.
          * @return The Service instance.
          */
-        std::shared_ptr<Service> getDiscoveredService(const winrt::guid& uuid) const
+        std::shared_ptr<Service> getDiscoveredService(const BleUuid& uuid) const
         {
             std::lock_guard lock{ _connectOpMtx };
             auto it = _services.find(uuid);
@@ -296,7 +358,7 @@ namespace Systemic::BluetoothLE
 
     private:
         // Get the device object in a thread safe manner
-        BluetoothLEDevice safeGetDevice() const
+        std::shared_ptr<BleDeviceBackend> safeGetDevice() const
         {
             // TODO is the lock needed?
             std::lock_guard lock{ _connectOpMtx };
@@ -306,39 +368,100 @@ namespace Systemic::BluetoothLE
         // Take the lock and release device and session, be sure to call notifyQueuedConnectionEvents() afterwards
         void internalDisconnect(ConnectionEventReason reason, bool fromDevice = false);
 
-        // Notify user code with pending connection event
-        void notifyQueuedConnectionEvents()
+        // Take the lock and flag the link as lost if the connection is maintained, returns false otherwise,
+        // be sure to call notifyQueuedConnectionEvents() afterwards
+        bool internalLinkLost();
+
+        // Take the lock and restore the ready state after a link loss,
+        // be sure to call notifyQueuedConnectionEvents() afterwards
+        void internalLinkRestored();
+
+        // Queue a connection event, must be called with the connection mutex held
+        void queueConnectionEvent(ConnectionEvent ev, ConnectionEventReason reason)
         {
-            // TODO optimize for case with 1 or 2 elements in queue
-            decltype(_connectionEventsQueue) queue{};
+            // There are only a few events per connection and they are notified right away,
+            // but a user callback that blocks may let them pile up: never drop one as the
+            // last event gives the connection status. Once events overflow, the next ones
+            // follow them to keep the order.
+            if (_connectionEventsOverflowSize.load(std::memory_order_acquire)
+                || !_connectionEventsQueue.tryPush({ ev, reason }))
             {
-                std::lock_guard lock{ _connectOpMtx };
-                queue = _connectionEventsQueue;
-                _connectionEventsQueue.clear();
+                std::lock_guard lock{ _connectionEventsOverflowMtx };
+                _connectionEventsOverflow.emplace_back(ev, reason);
+                _connectionEventsOverflowSize.store(_connectionEventsOverflow.size(), std::memory_order_release);
             }
-            if (_onConnectionEvent)
+        }
+
+        // Whether there are connection events waiting to be notified
+        bool hasQueuedConnectionEvents() const
+        {
+            return !_connectionEventsQueue.empty() || _connectionEventsOverflowSize.load(std::memory_order_acquire);
+        }
+
+        // Notify user code with pending connection event
+        void notifyQueuedConnectionEvents()
+        {
+            // Events are notified by one thread at a time so they are delivered in order,
+            // a thread that finds another one notifying leaves its events to that thread
+            // (which may be itself when called from a user callback)
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            while (hasQueuedConnectionEvents())
             {
-                for (auto& [ev, reason] : queue)
+                if (_notifyingConnectionEvents.exchange(true, std::memory_order_acquire))
+                {
+                    return;
+                }
+
+                while (auto event = _connectionEventsQueue.tryPop())
+                {
+                    if (_onConnectionEvent)
+                    {
+                        const auto [ev, reason] = *event;
+                        _onConnectionEvent(ev, reason);
+                    }
+                }
+
+                // The queue is empty, the overflowing events are the next ones
+                // (the events queued in the meantime come after them)
+                std::vector<std::tuple<ConnectionEvent, ConnectionEventReason>> overflow{};
+                if (_connectionEventsOverflowSize.load(std::memory_order_acquire))
+                {
+                    std::lock_guard lock{ _connectionEventsOverflowMtx };
+                    overflow.swap(_connectionEventsOverflow);
+                    _connectionEventsOverflowSize.store(0, std::memory_order_release);
+                }
+                for (const auto& [ev, reason] : overflow)
                 {
-                    _onConnectionEvent(ev, reason);
+                    if (_onConnectionEvent)
+                    {
+                        _onConnectionEvent(ev, reason);
+                    }
                 }
+
+                // Check again for events queued by a thread that found us notifying
+                _notifyingConnectionEvents.store(false, std::memory_order_release);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
             }
         }
 
         // Called by the device when the connection status changes
-        void onDeviceConnectionStatusChanged(BluetoothLEDevice device, winrt::Windows::Foundation::IInspectable _)
+        void onDeviceConnectionStatusChanged(bool isConnected)
         {
-            using namespace winrt::Windows::Devices::Bluetooth;
-
-            if (device.ConnectionStatus() == BluetoothConnectionStatus::Disconnected)
+            if (!isConnected)
             {
-                bool linkLoss = (_session != nullptr) && _session.MaintainConnection();
-                internalDisconnect(linkLoss ? ConnectionEventReason::LinkLoss : ConnectionEventReason::Timeout, true);
+                // Keep the device and session if the system is going to restore the link
+                if (!internalLinkLost())
+                {
+                    internalDisconnect(ConnectionEventReason::Timeout, true);
+                }
                 notifyQueuedConnectionEvents();
             }
             else
             {
-                // Connected event is raised in connectAsync() after it has successfully retrieved the services
+                // Connected event is raised in connectAsync() after it has successfully retrieved the services,
+                // or here when the link is restored
+                internalLinkRestored();
+                notifyQueuedConnectionEvents();
             }
         }
     };
@@ -5,6 +5,9 @@
 
 #pragma once
 
+#include <chrono>
+#include <string>
+#include <vector>
 #include "BleTypes.h"
 
 namespace Systemic::BluetoothLE
@@ -39,9 +42,9 @@ namespace Systemic::BluetoothLE
     private:
         friend Scanner;
 
-        // Initializes a new instance of ManufacturerData with the company id and a WinRT data buffer
-        ManufacturerData(uint16_t companyId, winrt::Windows::Storage::Streams::IBuffer data)
-            : _companyId{ companyId }, _data{ Internal::dataBufferToBytesVector(data) } {}
+        // Initializes a new instance of ManufacturerData with the company id and its data
+        ManufacturerData(uint16_t companyId, std::vector<uint8_t> data)
+            : _companyId{ companyId }, _data{ std::move(data) } {}
     };
 
     /**
@@ -72,9 +75,9 @@ namespace Systemic::BluetoothLE
     private:
         friend Scanner;
 
-        // Initializes a new instance of ServiceData with a WinRT data buffer first containing the service short UUID
-        ServiceData(winrt::Windows::Storage::Streams::IBuffer data)
-            : _shortUuid(0), _data{ Internal::dataBufferToBytesVector(data) }
+        // Initializes a new instance of ServiceData with data first containing the service short UUID
+        ServiceData(std::vector<uint8_t> data)
+            : _shortUuid(0), _data{ std::move(data) }
         {
             if (_data.size() >= 2)
             {
@@ -112,9 +115,9 @@ namespace Systemic::BluetoothLE
     private:
         friend Scanner;
 
-        // Initializes a new instance of AdvertisementData with the advertisement data type and a WinRT data buffer
-        AdvertisementData(uint8_t dataType, winrt::Windows::Storage::Streams::IBuffer data)
-            : _dataType{ dataType }, _data{ Internal::dataBufferToBytesVector(data) } {}
+        // Initializes a new instance of AdvertisementData with the advertisement data type and its data
+        AdvertisementData(uint8_t dataType, std::vector<uint8_t> data)
+            : _dataType{ dataType }, _data{ std::move(data) } {}
     };
 
     /**
@@ -131,7 +134,7 @@ namespace Systemic::BluetoothLE
      */
     class ScannedPeripheral
     {
-        using DateTime = winrt::Windows::Foundation::DateTime;
+        using DateTime = std::chrono::system_clock::time_point;
 
         DateTime _timestamp{};
         bluetooth_address_t _address{};
@@ -139,7 +142,7 @@ namespace Systemic::BluetoothLE
         bool _isConnectable{};
         int _rssi{};
         int _txPowerLevel{};
-        std::vector<winrt::guid> _services{};
+        std::vector<BleUuid> _services{};
         std::vector<ManufacturerData> _manufacturersData{};
         std::vector<ServiceData> _servicesData{};
         std::vector<AdvertisementData> _advertisingData{};
@@ -214,7 +217,7 @@ namespace Systemic::BluetoothLE
          *
          * @return The list of advertised services of the peripheral.
          */
-        const std::vector<winrt::guid>& services() const { return _services; }
+        const std::vector<BleUuid>& services() const { return _services; }
 
         /**
          * @brief Gets the list of manufacturer data contained in the advertisement packet(s).
@@ -256,7 +259,7 @@ namespace Systemic::BluetoothLE
             bool isConnectable,
             int rssi,
             int txPowerLevel,
-            const std::vector<winrt::guid>& services,
+            const std::vector<BleUuid>& services,
             const std::vector<ManufacturerData>& manufacturersData,
             const std::vector<ServiceData>& servicesData,
             const std::vector<AdvertisementData>& advertisingData)
@@ -278,7 +281,7 @@ namespace Systemic::BluetoothLE
             std::wstring& name,
             int rssi,
             int txPowerLevel,
-            const std::vector<winrt::guid>& services,
+            const std::vector<BleUuid>& services,
             const std::vector<ManufacturerData>& manufacturersData,
             const std::vector<ServiceData>& servicesData,
             const std::vector<AdvertisementData>& advertisingData)
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "BleTypes.h"
+#include "BleBackend.h"
 #include "ScannedPeripheral.h"
 
 namespace Systemic::BluetoothLE
@@ -14,22 +15,14 @@ namespace Systemic::BluetoothLE
      * @brief Implements scanning of Bluetooth Low Energy (BLE) peripherals.
      *        It stores and notifies of discovered peripherals with ScannedPeripheral objects.
      *
-     * The Scanner class internally stores a WinRT's \c BluetoothLEAdvertisementWatcher object.
+     * The Scanner class internally stores a BleScanBackend object,
+     * which wraps a WinRT's \c BluetoothLEAdvertisementWatcher object with the default backend.
      * @see https://docs.microsoft.com/en-us/uwp/api/windows.devices.bluetooth.advertisement.bluetoothleadvertisementwatcher
      */
     class Scanner final
     {
-        using BluetoothLEAdvertisementWatcher = winrt::Windows::Devices::Bluetooth::Advertisement::BluetoothLEAdvertisementWatcher;
-        using BluetoothLEAdvertisementReceivedEventArgs = winrt::Windows::Devices::Bluetooth::Advertisement::BluetoothLEAdvertisementReceivedEventArgs;
-        using BluetoothLEAdvertisementWatcherStoppedEventArgs = winrt::Windows::Devices::Bluetooth::Advertisement::BluetoothLEAdvertisementWatcherStoppedEventArgs;
-
-        // Watcher and its event tokens
-        BluetoothLEAdvertisementWatcher _watcher{ nullptr };
-        winrt::event_token _receivedToken{};
-        winrt::event_token _stoppedToken{};
-
         // List of user required services
-        std::vector<winrt::guid> _requestedServices{};
+        std::vector<BleUuid> _requestedServices{};
 
         // Discovered peripherals
         std::mutex _peripheralsMtx{};
@@ -38,6 +31,9 @@ namespace Systemic::BluetoothLE
         // User callback for discovered peripherals
         std::function<void(std::shared_ptr<const ScannedPeripheral>)> _onPeripheralDiscovered{};
 
+        // The running scan, destroyed first
+        std::unique_ptr<BleScanBackend> _scan{};
+
     public:
         /**
          * @brief Initializes a new instance of Scanner and immediately starts scanning
@@ -48,29 +44,23 @@ namespace Systemic::BluetoothLE
          *                             the data from the last DiscoveredPeripheral instance created for the same
          *                             peripheral before being passed to this callback.
          * @param services List of services UUIDs that the peripheral should advertise, may be empty.
+         * @param backend The backend to scan with, null for the default one (see BleBackend::getDefault()).
          */
         Scanner(
             std::function<void(std::shared_ptr<const ScannedPeripheral>)> peripheralDiscovered,
-            std::vector<winrt::guid> services = std::vector<winrt::guid>{})
+            std::vector<BleUuid> services = std::vector<BleUuid>{},
+            std::shared_ptr<BleBackend> backend = nullptr)
             :
-            _watcher{},
             _requestedServices{ services },
             _onPeripheralDiscovered{ peripheralDiscovered }
         {
-            using namespace winrt::Windows::Devices::Bluetooth::Advertisement;
-
-            // We want to receive all advertisement packets
-            _watcher.AllowExtendedAdvertisements(true);
-
-            // Send scan requests packets
-            _watcher.ScanningMode(BluetoothLEScanningMode::Active);
-
-            // We must subscribe to both Received and Stopped for the watcher to work
-            _receivedToken = _watcher.Received({ this, &Scanner::onReceived });
-            _stoppedToken = _watcher.Stopped({ this, &Scanner::onStopped });
+            if (!backend)
+            {
+                backend = BleBackend::getDefault();
+            }
 
             // Starts scanning
-            _watcher.Start();
+            _scan = backend->startScan([this](const AdvertisementPacket& packet) { onReceived(packet); });
         }
 
         /**
@@ -95,99 +85,50 @@ namespace Systemic::BluetoothLE
          */
         ~Scanner()
         {
-            if (_watcher)
-            {
-                _watcher.Received(_receivedToken);
-                _watcher.Stopped(_stoppedToken);
-                _watcher.Stop();
-                _watcher = nullptr;
-            }
+            _scan.reset();
         }
 
     private:
-        // Called by the watcher for each received advertisement packet 
-        void onReceived(
-            BluetoothLEAdvertisementWatcher const& /*watcher*/,
-            BluetoothLEAdvertisementReceivedEventArgs const& args)
+        // Called by the backend for each received advertisement packet
+        void onReceived(const AdvertisementPacket& packet)
         {
-            using namespace winrt::Windows::Devices::Bluetooth::Advertisement;
-
-            std::wstring name{};
-            std::vector<winrt::guid> services{};
+            std::wstring name{ packet.name };
             std::vector<ManufacturerData> manufacturersData{};
             std::vector<ServiceData> servicesData{};
             std::vector<AdvertisementData> advertisingData{};
 
-            auto advertisement = args.Advertisement();
-            if (advertisement)
+            // Get manufacturer-specific data sections
+            manufacturersData.reserve(packet.manufacturersData.size());
+            for (const auto& [companyId, data] : packet.manufacturersData)
             {
-                // Get name
-                name = advertisement.LocalName();
-
-                // Get services
-                auto serv = advertisement.ServiceUuids();
-                if (serv)
-                {
-                    services.reserve(serv.Size());
-                    for (const auto& uuid : serv)
-                    {
-                        services.push_back(uuid);
-                    }
-                }
+                manufacturersData.emplace_back(ManufacturerData{ companyId, data });
+            }
 
-                // Get manufacturer-specific data sections
-                auto manufDataList = advertisement.ManufacturerData();
-                if (manufDataList)
-                {
-                    manufacturersData.reserve(manufDataList.Size());
-                    for (const auto& manuf : manufDataList)
-                    {
-                        manufacturersData.emplace_back(ManufacturerData{ manuf.CompanyId(), manuf.Data() });
-                    }
-                }
+            // Get raw data sections
+            advertisingData.reserve(packet.dataSections.size());
+            for (const auto& [dataType, data] : packet.dataSections)
+            {
+                advertisingData.emplace_back(AdvertisementData{ dataType, data });
 
-                // Get raw data sections
-                auto advDataList = advertisement.DataSections();
-                if (advDataList)
+                // Check if it's a service data
+                if (dataType == 0x16) // Service Data - 16-bit UUID
                 {
-                    advertisingData.reserve(advDataList.Size());
-                    for (const auto& adv : advDataList)
-                    {
-                        advertisingData.emplace_back(AdvertisementData{ adv.DataType(), adv.Data() });
-
-                        // Check if it's a service data
-                        if (adv.DataType() == 0x16) // Service Data - 16-bit UUID
-                        {
-                            servicesData.emplace_back(ServiceData{ adv.Data() });
-                        }
-                    }
+                    servicesData.emplace_back(ServiceData{ data });
                 }
             }
 
-            // Get TX power
-            int txPower = 0;
-            if (args.TransmitPowerLevelInDBm())
-            {
-                txPower = args.TransmitPowerLevelInDBm().Value();
-            }
-
-            switch (args.AdvertisementType())
-            {
-            case BluetoothLEAdvertisementType::ConnectableUndirected:
-            case BluetoothLEAdvertisementType::ConnectableDirected:
-            case BluetoothLEAdvertisementType::ScannableUndirected:
-            case BluetoothLEAdvertisementType::NonConnectableUndirected:
+            if (!packet.isScanResponse)
             {
                 // We got a fresh advertisement packet, create a new DiscoveredPeripheral
                 std::shared_ptr<const ScannedPeripheral> peripheral{
                     new ScannedPeripheral(
-                        args.Timestamp(),
-                        args.BluetoothAddress(),
+                        packet.timestamp,
+                        packet.address,
                         name,
-                        args.IsConnectable(),
-                        args.RawSignalStrengthInDBm(),
-                        txPower,
-                        services,
+                        packet.isConnectable,
+                        packet.rssi,
+                        packet.txPowerLevel,
+                        packet.services,
                         manufacturersData,
                         servicesData,
                         advertisingData) };
@@ -198,26 +139,24 @@ namespace Systemic::BluetoothLE
                 }
                 notify(peripheral);
             }
-            break;
-
-            case BluetoothLEAdvertisementType::ScanResponse:
+            else
             {
                 std::shared_ptr<const ScannedPeripheral> updatedPeripheral{};
                 {
                     std::lock_guard lock{ _peripheralsMtx };
-                    auto it = _peripherals.find(args.BluetoothAddress());
+                    auto it = _peripherals.find(packet.address);
                     if (it != _peripherals.end())
                     {
                         // We got an advertisement packet in response to a scan request send after receiving
                         // an initial advertisement packet, update the existing DiscoveredPeripheral
                         updatedPeripheral.reset(
                             new ScannedPeripheral(
-                                args.Timestamp(),
+                                packet.timestamp,
                                 *it->second,
                                 name,
-                                args.RawSignalStrengthInDBm(),
-                                txPower,
-                                services,
+                                packet.rssi,
+                                packet.txPowerLevel,
+                                packet.services,
                                 manufacturersData,
                                 servicesData,
                                 advertisingData));
@@ -230,8 +169,6 @@ namespace Systemic::BluetoothLE
                     notify(updatedPeripheral);
                 }
             }
-            break;
-            }
         }
 
         // Notify user code if peripheral advertise required services
@@ -244,11 +181,5 @@ namespace Systemic::BluetoothLE
             }
         }
 
-        // Called by the watcher when scanning is stopped
-        void onStopped(
-            BluetoothLEAdvertisementWatcher const& /*watcher*/,
-            BluetoothLEAdvertisementWatcherStoppedEventArgs const& /*args*/)
-        {
-        }
     };
 }
@@ -5,6 +5,8 @@
 
 #pragma once
 
+#include "BleBackend.h"
+
 namespace Systemic::BluetoothLE
 {
     class Peripheral;
@@ -15,20 +17,19 @@ namespace Systemic::BluetoothLE
      *
      * A specific Characteristic may be retrieved by its UUID with getCharacteristic().
      *
-     * The Service class internally stores a WinRT's \c GattDeviceService object.
+     * The Service class internally stores a BleServiceBackend object,
+     * which wraps a WinRT's \c GattDeviceService object with the default backend.
      */
     class Service
     {
-        using GattDeviceService = winrt::Windows::Devices::Bluetooth::GenericAttributeProfile::GattDeviceService;
-
         // Keep a weak pointer to the peripheral so it can be accessed
         std::weak_ptr<Peripheral> _peripheral;
 
         // Service
-        GattDeviceService _service{ nullptr };
+        std::shared_ptr<BleServiceBackend> _service{};
 
         // Characteristics (there may be more than one characteristic instance for a given UUID)
-        std::unordered_map<winrt::guid, std::vector<std::shared_ptr<Characteristic>>> _characteristics{};
+        std::unordered_map<BleUuid, std::vector<std::shared_ptr<Characteristic>>> _characteristics{};
 
     public:
         //! \name Destructor
@@ -43,7 +44,7 @@ namespace Systemic::BluetoothLE
 
             if (_service)
             {
-                _service.Close();
+                _service->close();
                 _service = nullptr;
             }
         }
@@ -59,7 +60,7 @@ namespace Systemic::BluetoothLE
          */
         std::uint16_t handle() const
         {
-            return _service.AttributeHandle();
+            return _service->handle();
         }
 
         /**
@@ -67,9 +68,9 @@ namespace Systemic::BluetoothLE
          *
          * @return The UUID of the service.
          */
-        winrt::guid uuid() const
+        BleUuid uuid() const
         {
-            return _service.Uuid();
+            return _service->uuid();
         }
 
         /**
@@ -102,7 +103,7 @@ namespace Systemic::BluetoothLE
          * @param uuid The UUID of the Characteristic.
          * @return The Characteristic instance.
          */
-        std::shared_ptr<Characteristic> getCharacteristic(const winrt::guid& uuid)
+        std::shared_ptr<Characteristic> getCharacteristic(const BleUuid& uuid)
         {
             auto it = _characteristics.find(uuid);
             bool found = (it != _characteristics.end()) && (!it->second.empty());
@@ -117,7 +118,7 @@ namespace Systemic::BluetoothLE
          * @param uuid The UUID of the Characteristic.
          * @return The Characteristic instances.
          */
-        const std::vector<std::shared_ptr<Characteristic>> getCharacteristics(const winrt::guid& uuid)
+        const std::vector<std::shared_ptr<Characteristic>> getCharacteristics(const BleUuid& uuid)
         {
             return _characteristics.find(uuid)->second;
         }
@@ -147,14 +148,14 @@ namespace Systemic::BluetoothLE
         //! @}
 
     private:
-        friend std::future<BleRequestStatus> Peripheral::connectAsync(std::vector<winrt::guid>, bool);
+        friend class Peripheral;
 
-        // Initializes a new instance of Service for a Peripheral and GattDeviceService,
+        // Initializes a new instance of Service for a Peripheral and a backend service,
         // and with a list of characteristics.
         Service(
             std::weak_ptr<Peripheral> peripheral,
-            GattDeviceService service,
-            std::unordered_map<winrt::guid, std::vector<std::shared_ptr<Characteristic>>> characteristics)
+            std::shared_ptr<BleServiceBackend> service,
+            std::unordered_map<BleUuid, std::vector<std::shared_ptr<Characteristic>>> characteristics)
             :
             _peripheral{ peripheral },
             _service{ service },
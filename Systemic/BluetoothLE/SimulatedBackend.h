@@ -0,0 +1,240 @@
+/**
+ * @file
+ * @brief Definition of the SimulatedBackend class.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BleBackend.h"
+
+namespace Systemic::BluetoothLE
+{
+    /// Options of a SimulatedBackend.
+    struct SimulatedBackendOptions
+    {
+        /// Number of simulated peripherals.
+        size_t peripheralCount{ 1 };
+
+        /// Bluetooth address of the first peripheral, the next ones have consecutive addresses.
+        bluetooth_address_t firstAddress{ 0xC0DE00000001 };
+
+        /// Time between two advertisement packets of a peripheral while scanning.
+        std::chrono::milliseconds advertisementInterval{ 100 };
+
+        /// Time between two calls to SimulatedPeripheralModel::onTick() for a connected peripheral.
+        std::chrono::milliseconds tickInterval{ 1000 };
+
+        /// Time to open a connection to a peripheral.
+        std::chrono::milliseconds connectLatency{ 50 };
+
+        /// Time to complete a GATT request (discovery, read, write or notifications configuration).
+        std::chrono::milliseconds operationLatency{ 10 };
+
+        /// Time between a write and the notifications it triggers.
+        std::chrono::milliseconds notificationLatency{ 5 };
+
+        /// Maximum random delay added to each of the latencies above.
+        std::chrono::milliseconds latencyJitter{ 0 };
+
+        /// The Maximum Transmission Unit (MTU) of the connections.
+        std::uint16_t mtu{ 247 };
+
+        /// The received signal strength of the advertisements, in dBm.
+        int rssi{ -60 };
+
+        /// Seed of the random generators, the same seed gives the same sequence of events for each peripheral.
+        std::uint32_t seed{};
+    };
+
+    /// A characteristic of a simulated peripheral.
+    struct SimulatedCharacteristic
+    {
+        /// The characteristic UUID.
+        BleUuid uuid{};
+
+        /// The standard BLE properties of the characteristic, see CharacteristicProperties.
+        std::uint32_t properties{};
+    };
+
+    /// A primary service of a simulated peripheral.
+    struct SimulatedService
+    {
+        /// The service UUID.
+        BleUuid uuid{};
+
+        /// The characteristics of the service.
+        std::vector<SimulatedCharacteristic> characteristics{};
+    };
+
+    /// A value notified by a simulated peripheral.
+    struct SimulatedNotification
+    {
+        /// The UUID of the notifying characteristic.
+        BleUuid characteristic{};
+
+        /// The notified value.
+        std::vector<std::uint8_t> data{};
+    };
+
+    /**
+     * @brief The behavior of the peripherals of a SimulatedBackend.
+     *
+     * Peripherals are identified by their index, calls are serialized by the backend.
+     */
+    class SimulatedPeripheralModel
+    {
+    public:
+        virtual ~SimulatedPeripheralModel() = default;
+
+        /**
+         * @brief Fills the advertisement packet of a peripheral.
+         *
+         * The timestamp, address, RSSI and connectable flag are already set.
+         * @param index The peripheral index.
+         * @param packet The packet to fill.
+         */
+        virtual void advertise(size_t index, AdvertisementPacket& packet) = 0;
+
+        /**
+         * @brief Gets the services of a peripheral.
+         * @param index The peripheral index.
+         * @return The services, in discovery order.
+         */
+        virtual std::vector<SimulatedService> services(size_t index) = 0;
+
+        /**
+         * @brief Called when a peripheral gets connected or disconnected.
+         * @param index The peripheral index.
+         * @param isConnected Whether the peripheral is now connected.
+         */
+        virtual void onConnectionChanged(size_t index, bool isConnected) {}
+
+        /**
+         * @brief Called when a characteristic of a peripheral is written.
+         * @param index The peripheral index.
+         * @param characteristic The UUID of the written characteristic.
+         * @param data The written value, only valid during the call.
+         * @return The values notified in response.
+         */
+        virtual std::vector<SimulatedNotification> onWrite(size_t index, const BleUuid& characteristic, ByteSpan data) = 0;
+
+        /**
+         * @brief Called periodically for each connected peripheral, see SimulatedBackendOptions::tickInterval.
+         * @param index The peripheral index.
+         * @return The values notified by the peripheral.
+         */
+        virtual std::vector<SimulatedNotification> onTick(size_t index) { return {}; }
+    };
+
+    /// Counters of a SimulatedBackend, see SimulatedBackend::stats().
+    struct SimulatedBackendStats
+    {
+        /// Number of advertisement packets sent.
+        std::uint64_t advertisements{};
+
+        /// Number of successful connections.
+        std::uint64_t connections{};
+
+        /// Number of characteristic writes.
+        std::uint64_t writes{};
+
+        /// Total size of the written values, in bytes.
+        std::uint64_t bytesWritten{};
+
+        /// Number of notifications delivered.
+        std::uint64_t notifications{};
+
+        /// Total size of the notified values, in bytes.
+        std::uint64_t bytesNotified{};
+    };
+
+    /**
+     * @brief A backend running simulated peripherals, to run the library without
+     *        a Bluetooth adapter nor actual peripherals.
+     *
+     * The peripherals behavior is given by a SimulatedPeripheralModel, the backend
+     * takes care of advertising, connections, latencies and notifications delivery.
+     * Requests complete and notifications are delivered on the TimerQueue thread.
+     *
+     * Use BleBackend::setDefault() to have new Scanner and Peripheral instances use it.
+     * It builds on Windows and on the platforms without a Bluetooth backend, see BleBackend.
+     *
+     * This class is thread safe.
+     */
+    class SimulatedBackend final
+        : public BleBackend, public std::enable_shared_from_this<SimulatedBackend>
+    {
+        // Implementation classes, defined in the source file
+        struct VirtualPeripheral;
+        class Characteristic;
+        class Service;
+        class Device;
+        class Scan;
+
+        const SimulatedBackendOptions _options;
+        const std::shared_ptr<SimulatedPeripheralModel> _model;
+
+        // The simulated peripherals, the list never changes
+        std::vector<std::shared_ptr<VirtualPeripheral>> _peripherals{};
+
+        // Serializes the calls to the model
+        std::mutex _modelMutex{};
+
+        // Counters
+        std::atomic<std::uint64_t> _advertisements{};
+        std::atomic<std::uint64_t> _connections{};
+        std::atomic<std::uint64_t> _writes{};
+        std::atomic<std::uint64_t> _bytesWritten{};
+        std::atomic<std::uint64_t> _notifications{};
+        std::atomic<std::uint64_t> _bytesNotified{};
+
+    public:
+        /**
+         * @brief Creates a new simulated backend.
+         * @param options The simulation options.
+         * @param model The behavior of the peripherals.
+         * @return The new backend.
+         */
+        static std::shared_ptr<SimulatedBackend> create(SimulatedBackendOptions options, std::shared_ptr<SimulatedPeripheralModel> model);
+
+        /// Gets the simulation options.
+        const SimulatedBackendOptions& options() const { return _options; }
+
+        /// Gets the address of the peripheral with the given index.
+        bluetooth_address_t address(size_t index) const { return _options.firstAddress + index; }
+
+        /**
+         * @brief Simulates a peripheral getting out of reach or back in reach.
+         *
+         * A peripheral out of reach doesn't advertise and its connection is lost.
+         * @param address The Bluetooth address of the peripheral.
+         * @param isInReach Whether the peripheral is in reach.
+         */
+        void setInReach(bluetooth_address_t address, bool isInReach);
+
+        /// Gets the counters of the simulation.
+        SimulatedBackendStats stats() const;
+
+        Systemic::Internal::AwaitableResult<std::shared_ptr<BleDeviceBackend>> requestOpenDevice(bluetooth_address_t address) override;
+
+        std::unique_ptr<BleScanBackend> startScan(std::function<void(const AdvertisementPacket&)> onAdvertisement) override;
+
+    private:
+        SimulatedBackend(SimulatedBackendOptions options, std::shared_ptr<SimulatedPeripheralModel> model);
+
+        std::shared_ptr<VirtualPeripheral> findPeripheral(bluetooth_address_t address) const;
+        std::chrono::milliseconds latency(VirtualPeripheral& peripheral, std::chrono::milliseconds base);
+        bool advertise(VirtualPeripheral& peripheral, AdvertisementPacket& packet);
+        std::vector<SimulatedService> services(VirtualPeripheral& peripheral);
+        void write(VirtualPeripheral& peripheral, const BleUuid& characteristic, ByteSpan data);
+        void onConnectionChanged(VirtualPeripheral& peripheral, bool isConnected);
+        void scheduleTick();
+        void notify(VirtualPeripheral& peripheral, std::vector<SimulatedNotification> notifications);
+    };
+}
@@ -0,0 +1,38 @@
+/**
+ * @file
+ * @brief Definition of the WinRTBackend class.
+ */
+
+#pragma once
+
+#include "BleBackend.h"
+
+namespace Systemic::BluetoothLE
+{
+    /**
+     * @brief The BleBackend implementation using the WinRT Bluetooth APIs, this is the default backend.
+     *
+     * Devices are accessed with WinRT's \c BluetoothLEDevice and \c GattSession objects,
+     * and advertisements are received with a \c BluetoothLEAdvertisementWatcher object.
+     * @see https://docs.microsoft.com/en-us/uwp/api/windows.devices.bluetooth
+     */
+    class WinRTBackend final : public BleBackend
+    {
+        WinRTBackend() = default;
+
+    public:
+        /**
+         * @brief Gets the WinRT backend instance.
+         * @return The backend instance.
+         */
+        static const std::shared_ptr<WinRTBackend>& instance()
+        {
+            static const std::shared_ptr<WinRTBackend> backend{ new WinRTBackend{} };
+            return backend;
+        }
+
+        Systemic::Internal::AwaitableResult<std::shared_ptr<BleDeviceBackend>> requestOpenDevice(bluetooth_address_t address) override;
+
+        std::unique_ptr<BleScanBackend> startScan(std::function<void(const AdvertisementPacket&)> onAdvertisement) override;
+    };
+}
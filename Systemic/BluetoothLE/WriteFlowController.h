@@ -0,0 +1,281 @@
+/**
+ * @file
+ * @brief Definition of the WriteFlowController class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "Systemic/Internal/AwaitableResult.h"
+
+namespace Systemic::BluetoothLE
+{
+    /// Statistics of the writes without response of a characteristic, see WriteFlowController.
+    struct WriteFlowStats
+    {
+        /// Current maximum number of writes in flight.
+        size_t window{};
+
+        /// Number of writes in flight.
+        size_t inFlight{};
+
+        /// Number of writes waiting for a credit.
+        size_t queued{};
+
+        /// Number of completed writes.
+        uint64_t writesSucceeded{};
+
+        /// Number of failed writes.
+        uint64_t writesFailed{};
+
+        /// Number of bytes successfully written.
+        uint64_t bytesWritten{};
+
+        /// Average number of bytes written per second, since the first write.
+        double throughput{};
+
+        /// Number of writes that had to wait for a credit.
+        uint64_t stallCount{};
+
+        /// Total time spent by the writes waiting for a credit.
+        std::chrono::microseconds totalStallTime{};
+
+        /// Longest time spent by a write waiting for a credit.
+        std::chrono::microseconds maxStallTime{};
+
+        /// Smoothed time taken by a write to complete.
+        std::chrono::microseconds averageLatency{};
+
+        /// Shortest time taken by a write to complete.
+        std::chrono::microseconds minLatency{};
+    };
+
+    /**
+     * @brief Paces the writes without response of a characteristic with a credit window.
+     *
+     * A write takes a credit before starting and returns it once the system has accepted
+     * the data, so the number of writes in flight never exceeds the window. Extra writes
+     * wait for a credit in the order they asked for it.
+     *
+     * The window is adapted to the link: it grows by one credit after a window's worth of
+     * writes completed at close to the lowest observed latency, shrinks by one credit
+     * when the latency shows that writes are queuing up, and is halved on a failure.
+     *
+     * This class is thread safe.
+     */
+    class WriteFlowController
+    {
+    public:
+        /// Clock used for measuring latencies.
+        using Clock = std::chrono::steady_clock;
+
+        /// A credit to await before writing, see acquire().
+        using Credit = Systemic::Internal::AwaitableResult<bool>;
+
+        /// Initial number of writes in flight.
+        static constexpr size_t defaultInitialWindow = 4;
+
+        /// Minimum number of writes in flight.
+        static constexpr size_t defaultMinWindow = 1;
+
+        /// Maximum number of writes in flight.
+        static constexpr size_t defaultMaxWindow = 32;
+
+    private:
+        struct QueuedCredit
+        {
+            Credit credit{};
+            Clock::time_point queuedTime{};
+        };
+
+        const size_t _minWindow;
+        const size_t _maxWindow;
+        size_t _window;
+        size_t _inFlight{};
+        size_t _successesSinceIncrease{};
+        std::deque<QueuedCredit> _queuedCredits{};
+        std::vector<Credit> _availabilityWaiters{};
+        WriteFlowStats _stats{};
+        Clock::duration _averageLatency{};
+        Clock::duration _minLatency{ Clock::duration::max() };
+        Clock::time_point _firstWriteTime{};
+        mutable std::mutex _mutex{};
+
+    public:
+        /**
+         * @brief Initializes a new instance.
+         * @param initialWindow Initial number of writes in flight.
+         * @param minWindow Minimum number of writes in flight, at least one.
+         * @param maxWindow Maximum number of writes in flight.
+         */
+        explicit WriteFlowController(
+            size_t initialWindow = defaultInitialWindow,
+            size_t minWindow = defaultMinWindow,
+            size_t maxWindow = defaultMaxWindow)
+            : _minWindow{ std::max<size_t>(minWindow, 1) }
+            , _maxWindow{ std::max(maxWindow, _minWindow) }
+            , _window{ std::clamp(initialWindow, _minWindow, _maxWindow) } {}
+
+        WriteFlowController(const WriteFlowController&) = delete;
+        WriteFlowController& operator=(const WriteFlowController&) = delete;
+
+        /**
+         * @brief Requests a credit for starting a write.
+         *
+         * The returned credit is already completed if the window allows for another write.
+         * @return The credit to await. Once completed, the caller must call release().
+         */
+        Credit acquire()
+        {
+            Credit credit{};
+            {
+                std::lock_guard lock{ _mutex };
+                if (_firstWriteTime == Clock::time_point{})
+                {
+                    _firstWriteTime = Clock::now();
+                }
+                if (_inFlight >= _window || !_queuedCredits.empty())
+                {
+                    ++_stats.stallCount;
+                    _queuedCredits.push_back(QueuedCredit{ credit, Clock::now() });
+                    return credit;
+                }
+                ++_inFlight;
+            }
+            credit.trySetResult(true);
+            return credit;
+        }
+
+        /**
+         * @brief Waits until a write may start without waiting for a credit.
+         *
+         * This doesn't take a credit, it lets a single writer keep its messages
+         * until they can be written right away.
+         * @return The result to await, completed once a credit is available.
+         */
+        Credit waitAvailable()
+        {
+            Credit available{};
+            {
+                std::lock_guard lock{ _mutex };
+                if (_inFlight >= _window || !_queuedCredits.empty())
+                {
+                    _availabilityWaiters.push_back(available);
+                    return available;
+                }
+            }
+            available.trySetResult(true);
+            return available;
+        }
+
+        /**
+         * @brief Returns the credit of a completed write and adapts the window.
+         * @param latency Time taken by the write to complete.
+         * @param size Number of bytes written.
+         * @param success Whether the write succeeded.
+         */
+        void release(Clock::duration latency, size_t size, bool success)
+        {
+            std::vector<Credit> granted{};
+            std::vector<Credit> available{};
+            {
+                std::lock_guard lock{ _mutex };
+                if (_inFlight)
+                {
+                    --_inFlight;
+                }
+
+                if (success)
+                {
+                    ++_stats.writesSucceeded;
+                    _stats.bytesWritten += size;
+                    adaptToLatency(latency);
+                }
+                else
+                {
+                    ++_stats.writesFailed;
+                    _window = std::max(_window / 2, _minWindow);
+                    _successesSinceIncrease = 0;
+                }
+
+                // Start the queued writes that the window allows for
+                const auto now = Clock::now();
+                while (_inFlight < _window && !_queuedCredits.empty())
+                {
+                    auto& queued = _queuedCredits.front();
+                    const auto stall = std::chrono::duration_cast<std::chrono::microseconds>(now - queued.queuedTime);
+                    _stats.totalStallTime += stall;
+                    _stats.maxStallTime = std::max(_stats.maxStallTime, stall);
+                    granted.push_back(std::move(queued.credit));
+                    _queuedCredits.pop_front();
+                    ++_inFlight;
+                }
+
+                if (_inFlight < _window && _queuedCredits.empty())
+                {
+                    available.swap(_availabilityWaiters);
+                }
+            }
+
+            for (auto& credit : granted)
+            {
+                credit.trySetResult(true);
+            }
+            for (auto& waiter : available)
+            {
+                waiter.trySetResult(true);
+            }
+        }
+
+        /**
+         * @brief Gets a snapshot of the flow statistics.
+         * @return The flow statistics.
+         */
+        WriteFlowStats stats() const
+        {
+            using std::chrono::duration_cast;
+            using std::chrono::microseconds;
+
+            std::lock_guard lock{ _mutex };
+            auto stats = _stats;
+            stats.window = _window;
+            stats.inFlight = _inFlight;
+            stats.queued = _queuedCredits.size();
+            stats.averageLatency = duration_cast<microseconds>(_averageLatency);
+            stats.minLatency = _minLatency == Clock::duration::max() ? microseconds{} : duration_cast<microseconds>(_minLatency);
+            if (_firstWriteTime != Clock::time_point{})
+            {
+                const auto elapsed = std::chrono::duration<double>(Clock::now() - _firstWriteTime).count();
+                stats.throughput = elapsed > 0 ? _stats.bytesWritten / elapsed : 0;
+            }
+            return stats;
+        }
+
+    private:
+        // Must be called with the lock held
+        void adaptToLatency(Clock::duration latency)
+        {
+            // Exponentially weighted moving average, with a weight of 1/8 for the new sample
+            _averageLatency = _averageLatency == Clock::duration{} ? latency : _averageLatency + (latency - _averageLatency) / 8;
+            _minLatency = std::min(_minLatency, latency);
+
+            if (latency > 4 * _minLatency)
+            {
+                // Writes are queuing up in the system
+                _window = std::max(_window - 1, _minWindow);
+                _successesSinceIncrease = 0;
+            }
+            else if (latency <= 2 * _minLatency && ++_successesSinceIncrease >= _window)
+            {
+                _window = std::min(_window + 1, _maxWindow);
+                _successesSinceIncrease = 0;
+            }
+        }
+    };
+}
@@ -0,0 +1,278 @@
+/**
+ * @file
+ * @brief Definition of the AwaitableResult internal class.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <type_traits>
+#include "Coroutines.h"
+#include "TimerQueue.h"
+
+namespace Systemic::Internal
+{
+    /**
+     * @brief A result set by a callback and awaited by a coroutine, with a timeout.
+     *
+     * Unlike waiting on a std::future, awaiting the result doesn't block a thread.
+     * The awaiting coroutine is resumed either by the thread setting the result or,
+     * on timeout, by the TimerQueue thread.
+     *
+     * Only the first of trySetResult(), trySetException() or the timeout completes the result,
+     * later attempts are ignored.
+     *
+     * A function returning an AwaitableResult may also be a coroutine, see promise_type.
+     *
+     * Copies share the same result. This class is thread safe.
+     * @tparam T The type of the result, must be default constructible.
+     */
+    template <typename T>
+    class AwaitableResult
+    {
+        struct State
+        {
+            std::mutex mutex{};
+            T value{};
+            std::exception_ptr error{};
+            bool completed{};
+            std::function<void()> resume{};
+            TimerQueue::TimerId timerId{};
+        };
+
+        std::shared_ptr<State> _state{ std::make_shared<State>() };
+
+    public:
+        /// Awaiter returned by waitAsync().
+        class Awaiter
+        {
+            std::shared_ptr<State> _state;
+            TimerQueue::Clock::duration _timeout;
+
+        public:
+            Awaiter(std::shared_ptr<State> state, TimerQueue::Clock::duration timeout)
+                : _state{ std::move(state) }, _timeout{ timeout } {}
+
+            bool await_ready() const
+            {
+                std::lock_guard lock{ _state->mutex };
+                return _state->completed;
+            }
+
+            template <typename Handle>
+            bool await_suspend(Handle handle)
+            {
+                // Keep the state alive, the coroutine frame may be destroyed as soon as the mutex is released
+                const auto state = _state;
+                std::lock_guard lock{ state->mutex };
+                if (state->completed)
+                {
+                    return false;
+                }
+                state->resume = [handle]() mutable { handle.resume(); };
+                if (_timeout != TimerQueue::Clock::duration::max())
+                {
+                    state->timerId = TimerQueue::instance().schedule(_timeout, [state]() { complete(state, nullptr, nullptr); });
+                }
+                return true;
+            }
+
+            T await_resume()
+            {
+                std::lock_guard lock{ _state->mutex };
+                if (_state->error)
+                {
+                    std::rethrow_exception(_state->error);
+                }
+                return std::move(_state->value);
+            }
+        };
+
+        /**
+         * @brief Makes a function returning an AwaitableResult a coroutine.
+         *
+         * The coroutine starts right away and runs on the calling thread until it first
+         * suspends. The value given to co_return, or the exception leaving the coroutine,
+         * completes the result once the coroutine local variables are destroyed, so the
+         * awaiting coroutine doesn't resume while a lock held by this one is still taken.
+         */
+        struct promise_type
+        {
+            // Awaiter that destroys the finished coroutine and then completes its result
+            struct Complete
+            {
+                bool await_ready() const noexcept { return false; }
+
+                template <typename Handle>
+                void await_suspend(Handle handle) const noexcept
+                {
+                    auto& promise = handle.promise();
+                    const auto result = promise.result;
+                    auto value = std::move(promise.value);
+                    auto error = std::move(promise.error);
+                    handle.destroy();
+                    if (error)
+                    {
+                        result.trySetException(std::move(error));
+                    }
+                    else
+                    {
+                        result.trySetResult(std::move(value));
+                    }
+                }
+
+                void await_resume() const noexcept {}
+            };
+
+            AwaitableResult result{};
+            T value{};
+            std::exception_ptr error{};
+
+            AwaitableResult get_return_object() const { return result; }
+            NoSuspend initial_suspend() const noexcept { return {}; }
+            Complete final_suspend() const noexcept { return {}; }
+            void return_value(T returnValue) { value = std::move(returnValue); }
+            void unhandled_exception() { error = std::current_exception(); }
+        };
+
+        /**
+         * @brief Sets the result and resumes the awaiting coroutine, if any.
+         * @param value The result value.
+         * @return Whether the result was set, false if it was already completed or timed out.
+         * @note The awaiting coroutine runs on the calling thread until its next suspension.
+         */
+        bool trySetResult(T value) const
+        {
+            return complete(_state, &value, nullptr);
+        }
+
+        /**
+         * @brief Completes the result with an exception, which is rethrown to the awaiting coroutine.
+         * @param error The exception.
+         * @return Whether the exception was set, false if the result was already completed or timed out.
+         * @note The awaiting coroutine runs on the calling thread until its next suspension.
+         */
+        bool trySetException(std::exception_ptr error) const
+        {
+            return complete(_state, nullptr, std::move(error));
+        }
+
+        /**
+         * @brief Returns an awaitable object that completes with the result,
+         *        or with a default constructed value on timeout.
+         * @param timeout Time to wait for the result.
+         * @return The awaitable object.
+         * @note The result may only be awaited once.
+         */
+        Awaiter waitAsync(TimerQueue::Clock::duration timeout) const
+        {
+            return Awaiter{ _state, timeout };
+        }
+
+        /**
+         * @brief Returns an awaitable object that completes with the result, without a timeout.
+         * @return The awaitable object.
+         * @note The result may only be awaited once.
+         */
+        Awaiter waitAsync() const
+        {
+            return Awaiter{ _state, TimerQueue::Clock::duration::max() };
+        }
+
+        /// Indicates whether both objects share the same result.
+        bool operator==(const AwaitableResult& other) const { return _state == other._state; }
+
+        /// Indicates whether the objects have different results.
+        bool operator!=(const AwaitableResult& other) const { return _state != other._state; }
+
+    private:
+        // Completes with the value or the error, or with the default value on timeout if both are null
+        static bool complete(const std::shared_ptr<State>& state, T* value, std::exception_ptr error)
+        {
+            const bool isTimeout = !value && !error;
+            std::function<void()> resume{};
+            TimerQueue::TimerId timerId{};
+            {
+                std::lock_guard lock{ state->mutex };
+                if (state->completed)
+                {
+                    return false;
+                }
+                state->completed = true;
+                if (value)
+                {
+                    state->value = std::move(*value);
+                }
+                state->error = std::move(error);
+                resume = std::move(state->resume);
+                timerId = state->timerId;
+            }
+
+            // Resume outside of the lock
+            if (!isTimeout && timerId)
+            {
+                TimerQueue::instance().cancel(timerId);
+            }
+            if (resume)
+            {
+                resume();
+            }
+            return true;
+        }
+    };
+
+    // Awaits the result and sets the promise with its value or exception
+    template <typename T, typename R>
+    DetachedTask forwardResult(AwaitableResult<T> result, std::promise<R> promise)
+    {
+        try
+        {
+            if constexpr (std::is_void_v<R>)
+            {
+                co_await result.waitAsync();
+                promise.set_value();
+            }
+            else
+            {
+                promise.set_value(co_await result.waitAsync());
+            }
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+        }
+    }
+
+    /**
+     * @brief Gets a std::future completed with the given result.
+     * @param result The result, it is awaited by this call.
+     * @return A future with the result value, or its exception.
+     */
+    template <typename T>
+    std::future<T> toFuture(AwaitableResult<T> result)
+    {
+        std::promise<T> promise{};
+        auto future = promise.get_future();
+        forwardResult(std::move(result), std::move(promise));
+        return future;
+    }
+
+    /**
+     * @brief Gets a std::future completed along with the given result, its value is discarded.
+     * @param result The result, it is awaited by this call.
+     * @return A future that completes with the result, or with its exception.
+     */
+    template <typename T>
+    std::future<void> toVoidFuture(AwaitableResult<T> result)
+    {
+        std::promise<void> promise{};
+        auto future = promise.get_future();
+        forwardResult(std::move(result), std::move(promise));
+        return future;
+    }
+}
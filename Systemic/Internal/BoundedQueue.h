@@ -0,0 +1,152 @@
+/**
+ * @file
+ * @brief Definition of the BoundedQueue internal class.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <optional>
+
+namespace Systemic::Internal
+{
+    /**
+     * @brief A fixed capacity lock-free FIFO queue.
+     *
+     * Any number of threads may push and pop items concurrently.
+     * Each cell carries a sequence number telling whether it is ready to be written
+     * or read for a given position, so threads only compete on the position counters.
+     *
+     * This class is thread safe.
+     * @tparam T The item type, must be default constructible and movable.
+     */
+    template <typename T>
+    class BoundedQueue
+    {
+        struct Cell
+        {
+            std::atomic<size_t> sequence{};
+            T item{};
+        };
+
+        const size_t _mask;
+        const std::unique_ptr<Cell[]> _cells;
+        alignas(64) std::atomic<size_t> _enqueuePos{};
+        alignas(64) std::atomic<size_t> _dequeuePos{};
+
+        static size_t roundUpToPowerOfTwo(size_t value)
+        {
+            size_t result = 2;
+            while (result < value)
+            {
+                result <<= 1;
+            }
+            return result;
+        }
+
+    public:
+        /**
+         * @brief Initializes a new queue.
+         * @param capacity Minimum number of items the queue may hold, rounded up to a power of two.
+         */
+        explicit BoundedQueue(size_t capacity)
+            : _mask{ roundUpToPowerOfTwo(capacity) - 1 }, _cells{ new Cell[_mask + 1] }
+        {
+            for (size_t i = 0; i <= _mask; ++i)
+            {
+                _cells[i].sequence.store(i, std::memory_order_relaxed);
+            }
+        }
+
+        BoundedQueue(const BoundedQueue&) = delete;
+        BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+        /**
+         * @brief Gets the maximum number of items the queue may hold.
+         * @return The queue capacity.
+         */
+        size_t capacity() const
+        {
+            return _mask + 1;
+        }
+
+        /**
+         * @brief Gets an approximation of the number of queued items.
+         * @return The number of items, which may already be outdated.
+         */
+        size_t size() const
+        {
+            const auto enqueuePos = _enqueuePos.load(std::memory_order_relaxed);
+            const auto dequeuePos = _dequeuePos.load(std::memory_order_relaxed);
+            return enqueuePos > dequeuePos ? enqueuePos - dequeuePos : 0;
+        }
+
+        /**
+         * @brief Adds an item at the end of the queue.
+         * @param item The item to add, left untouched if the queue is full.
+         * @return Whether the item was added, false if the queue is full.
+         */
+        bool tryPush(T& item)
+        {
+            auto pos = _enqueuePos.load(std::memory_order_relaxed);
+            while (true)
+            {
+                auto& cell = _cells[pos & _mask];
+                const auto sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos);
+                if (diff == 0)
+                {
+                    if (_enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        cell.item = std::move(item);
+                        cell.sequence.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = _enqueuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        /**
+         * @brief Removes the item at the front of the queue.
+         * @return The removed item, if the queue wasn't empty.
+         */
+        std::optional<T> tryPop()
+        {
+            auto pos = _dequeuePos.load(std::memory_order_relaxed);
+            while (true)
+            {
+                auto& cell = _cells[pos & _mask];
+                const auto sequence = cell.sequence.load(std::memory_order_acquire);
+                const auto diff = static_cast<std::ptrdiff_t>(sequence) - static_cast<std::ptrdiff_t>(pos + 1);
+                if (diff == 0)
+                {
+                    if (_dequeuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        std::optional<T> item{ std::move(cell.item) };
+                        cell.item = T{};
+                        cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+                        return item;
+                    }
+                }
+                else if (diff < 0)
+                {
+                    return std::nullopt;
+                }
+                else
+                {
+                    pos = _dequeuePos.load(std::memory_order_relaxed);
+                }
+            }
+        }
+    };
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief Definition of the ByteSpan class.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cassert>
+#include <vector>
+
+namespace Systemic
+{
+    /**
+     * @brief A read only and non owning view on a contiguous sequence of bytes.
+     *
+     * This is a minimal stand-in for C++20 std::span<const uint8_t> as the library
+     * is built with C++17. It's cheap to copy and should be passed by value.
+     *
+     * @note The viewed memory must outlive the ByteSpan instance.
+     */
+    class ByteSpan
+    {
+        const std::uint8_t* _data{};
+        std::size_t _size{};
+
+    public:
+        /// Initializes an empty ByteSpan.
+        constexpr ByteSpan() noexcept = default;
+
+        /**
+         * @brief Initializes a ByteSpan viewing the given memory.
+         * @param data Pointer to the first byte.
+         * @param size Number of bytes.
+         */
+        constexpr ByteSpan(const std::uint8_t* data, std::size_t size) noexcept
+            : _data{ data }, _size{ size }
+        {
+        }
+
+        /**
+         * @brief Initializes a ByteSpan viewing the content of the given vector.
+         * @param data The vector of bytes, it shouldn't be modified while being viewed.
+         */
+        ByteSpan(const std::vector<std::uint8_t>& data) noexcept
+            : _data{ data.data() }, _size{ data.size() }
+        {
+        }
+
+        /// Gets a pointer to the first byte.
+        constexpr const std::uint8_t* data() const noexcept { return _data; }
+
+        /// Gets the number of bytes.
+        constexpr std::size_t size() const noexcept { return _size; }
+
+        /// Indicates whether the view is empty.
+        constexpr bool empty() const noexcept { return _size == 0; }
+
+        /// Gets an iterator to the first byte.
+        constexpr const std::uint8_t* begin() const noexcept { return _data; }
+
+        /// Gets an iterator past the last byte.
+        constexpr const std::uint8_t* end() const noexcept { return _data + _size; }
+
+        /// Gets the byte at the given index.
+        const std::uint8_t& operator[](std::size_t index) const
+        {
+            assert(index < _size);
+            return _data[index];
+        }
+
+        /**
+         * @brief Gets a view on a portion of this view.
+         * @param offset Index of the first byte of the sub-view, clamped to the size.
+         * @param count Maximum number of bytes of the sub-view.
+         * @return The sub-view.
+         */
+        constexpr ByteSpan subspan(std::size_t offset, std::size_t count = SIZE_MAX) const noexcept
+        {
+            const auto start = offset < _size ? offset : _size;
+            const auto remaining = _size - start;
+            return ByteSpan{ _data + start, count < remaining ? count : remaining };
+        }
+
+        /// Copies the viewed bytes into a new vector.
+        std::vector<std::uint8_t> toVector() const
+        {
+            return std::vector<std::uint8_t>{ begin(), end() };
+        }
+    };
+}
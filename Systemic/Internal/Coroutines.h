@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @brief Coroutine helpers that don't depend on the compiler or the platform.
+ */
+
+#pragma once
+
+// The coroutines support is experimental before C++20
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#else
+#include <experimental/coroutine>
+#endif
+
+#ifdef _WIN32
+#include <winrt/base.h>
+#else
+#include "ThreadPool.h"
+#endif
+
+namespace Systemic::Internal
+{
+    /// Awaiter that doesn't suspend the coroutine.
+    struct NoSuspend
+    {
+        bool await_ready() const noexcept { return true; }
+        template <typename Handle>
+        void await_suspend(Handle) const noexcept {}
+        void await_resume() const noexcept {}
+    };
+
+    /**
+     * @brief Return type of a coroutine that runs on its own, without being awaited.
+     *
+     * The coroutine starts right away and runs on the calling thread until it first
+     * suspends. Its frame is released once it completes.
+     * An exception leaving the coroutine is discarded, as with a discarded std::future.
+     */
+    struct DetachedTask
+    {
+        /// Makes a function returning a DetachedTask a coroutine.
+        struct promise_type
+        {
+            DetachedTask get_return_object() const noexcept { return {}; }
+            NoSuspend initial_suspend() const noexcept { return {}; }
+            NoSuspend final_suspend() const noexcept { return {}; }
+            void return_void() const noexcept {}
+            void unhandled_exception() const noexcept {}
+        };
+    };
+
+#ifdef _WIN32
+
+    /**
+     * @brief Returns an awaitable object that resumes the coroutine on a background thread.
+     * @return The awaitable object, it resumes on the system thread pool.
+     */
+    inline auto resumeBackground()
+    {
+        return winrt::resume_background();
+    }
+
+#else
+
+    /// Awaiter returned by resumeBackground().
+    struct BackgroundAwaiter
+    {
+        bool await_ready() const noexcept { return false; }
+
+        template <typename Handle>
+        void await_suspend(Handle handle) const
+        {
+            ThreadPool::instance().post([handle]() mutable { handle.resume(); });
+        }
+
+        void await_resume() const noexcept {}
+    };
+
+    /**
+     * @brief Returns an awaitable object that resumes the coroutine on a background thread.
+     * @return The awaitable object, it resumes on the ThreadPool.
+     */
+    inline BackgroundAwaiter resumeBackground()
+    {
+        return {};
+    }
+
+#endif
+}
@@ -31,6 +31,16 @@ namespace Systemic
             return std::vector<T>{ _list.begin(), _list.end() };
         }
 
+        /**
+         * @brief Indicates whether the list is empty.
+         * @return Whether the list is empty.
+         */
+        bool empty() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _list.empty();
+        }
+
         /**
          * @brief Adds the given item to the list and returns its index.
          * @param item The item to add.
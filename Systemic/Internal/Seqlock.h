@@ -0,0 +1,135 @@
+/**
+ * @file
+ * @brief Definition of the Seqlock internal class.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace Systemic::Internal
+{
+    /**
+     * @brief Holds a value that is read without locking and updated by copy.
+     *
+     * Readers never take a lock and never delay writers. A read retries only when it overlaps
+     * with an update, which is short since it just copies the value. Writers are serialized
+     * with a mutex.
+     *
+     * The value is stored as atomic words so concurrent reads and writes are well defined.
+     *
+     * This class is thread safe.
+     * @tparam T The type of value, must be trivially copyable.
+     */
+    template <typename T>
+    class Seqlock
+    {
+        static_assert(std::is_trivially_copyable_v<T>, "Seqlock value must be trivially copyable");
+        static_assert(std::is_default_constructible_v<T>, "Seqlock value must be default constructible");
+
+        using Word = std::uintptr_t;
+        static constexpr size_t wordCount = (sizeof(T) + sizeof(Word) - 1) / sizeof(Word);
+
+        // Odd while an update is in progress
+        std::atomic<std::uint64_t> _sequence{};
+        std::array<std::atomic<Word>, wordCount> _words{};
+        std::mutex _writeMutex{};
+
+    public:
+        /**
+         * @brief Initializes a new instance with the given value.
+         * @param value The initial value.
+         */
+        explicit Seqlock(const T& value = T{})
+        {
+            storeWords(value);
+        }
+
+        Seqlock(const Seqlock&) = delete;
+        Seqlock& operator=(const Seqlock&) = delete;
+
+        /**
+         * @brief Gets a consistent copy of the value.
+         * @return The value.
+         */
+        T load() const
+        {
+            Word words[wordCount];
+            while (true)
+            {
+                const auto sequence = _sequence.load(std::memory_order_acquire);
+                if (sequence & 1)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                for (size_t i = 0; i < wordCount; ++i)
+                {
+                    words[i] = _words[i].load(std::memory_order_relaxed);
+                }
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (_sequence.load(std::memory_order_relaxed) == sequence)
+                {
+                    break;
+                }
+            }
+
+            T value{};
+            std::memcpy(&value, words, sizeof(T));
+            return value;
+        }
+
+        /**
+         * @brief Replaces the value.
+         * @param value The new value.
+         */
+        void store(const T& value)
+        {
+            std::lock_guard lock{ _writeMutex };
+            write(value);
+        }
+
+        /**
+         * @brief Modifies the value with the given function.
+         *
+         * Other writers are blocked while the function runs, readers are not.
+         * @param modify Function called with a copy of the value to modify.
+         * @return The modified value.
+         */
+        template <typename F>
+        T update(F&& modify)
+        {
+            std::lock_guard lock{ _writeMutex };
+            T value = load();
+            modify(value);
+            write(value);
+            return value;
+        }
+
+    private:
+        void write(const T& value)
+        {
+            const auto sequence = _sequence.load(std::memory_order_relaxed);
+            _sequence.store(sequence + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            storeWords(value);
+            _sequence.store(sequence + 2, std::memory_order_release);
+        }
+
+        void storeWords(const T& value)
+        {
+            Word words[wordCount]{};
+            std::memcpy(words, &value, sizeof(T));
+            for (size_t i = 0; i < wordCount; ++i)
+            {
+                _words[i].store(words[i], std::memory_order_relaxed);
+            }
+        }
+    };
+}
@@ -0,0 +1,92 @@
+/**
+ * @file
+ * @brief Definition of the SpscQueue internal class.
+ */
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+namespace Systemic::Internal
+{
+    /**
+     * @brief A fixed capacity lock-free FIFO queue for a single producer and a single consumer.
+     *
+     * Items are stored inline, so the queue never allocates memory.
+     * At any given time, at most one thread may push items and at most one thread
+     * may pop items, the caller being responsible for serializing producers and consumers.
+     * Different threads may take turns as the producer or the consumer as long as
+     * they synchronize with each other (for example through a mutex).
+     *
+     * @tparam T The item type, must be default constructible and movable.
+     * @tparam Capacity The maximum number of items, must be a power of two.
+     */
+    template <typename T, size_t Capacity>
+    class SpscQueue
+    {
+        static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+        std::array<T, Capacity> _items{};
+        alignas(64) std::atomic<size_t> _head{}; // Next position to pop, written by the consumer
+        alignas(64) std::atomic<size_t> _tail{}; // Next position to push, written by the producer
+
+    public:
+        SpscQueue() = default;
+        SpscQueue(const SpscQueue&) = delete;
+        SpscQueue& operator=(const SpscQueue&) = delete;
+
+        /**
+         * @brief Gets the maximum number of items the queue may hold.
+         * @return The queue capacity.
+         */
+        static constexpr size_t capacity()
+        {
+            return Capacity;
+        }
+
+        /**
+         * @brief Indicates whether the queue is empty.
+         * @return Whether the queue is empty, which may already be outdated.
+         */
+        bool empty() const
+        {
+            return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @brief Adds an item at the end of the queue, must only be called by the producer.
+         * @param item The item to add.
+         * @return Whether the item was added, false if the queue is full.
+         */
+        bool tryPush(T item)
+        {
+            const auto tail = _tail.load(std::memory_order_relaxed);
+            if (tail - _head.load(std::memory_order_acquire) >= Capacity)
+            {
+                return false;
+            }
+            _items[tail & (Capacity - 1)] = std::move(item);
+            _tail.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief Removes the item at the front of the queue, must only be called by the consumer.
+         * @return The removed item, if the queue wasn't empty.
+         */
+        std::optional<T> tryPop()
+        {
+            const auto head = _head.load(std::memory_order_relaxed);
+            if (head == _tail.load(std::memory_order_acquire))
+            {
+                return std::nullopt;
+            }
+            std::optional<T> item{ std::move(_items[head & (Capacity - 1)]) };
+            _head.store(head + 1, std::memory_order_release);
+            return item;
+        }
+    };
+}
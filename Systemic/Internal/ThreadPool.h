@@ -0,0 +1,112 @@
+/**
+ * @file
+ * @brief Definition of the ThreadPool internal class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace Systemic::Internal
+{
+    /**
+     * @brief Runs callbacks on background threads, for platforms without a system thread pool.
+     *
+     * Threads are started on demand, up to a maximum count, and exit after having been idle
+     * for a few seconds.
+     *
+     * This class is thread safe.
+     */
+    class ThreadPool
+    {
+        // How long a thread waits for work before exiting
+        static constexpr std::chrono::seconds idleTimeout{ 10 };
+
+        std::mutex _mutex{};
+        std::condition_variable _cv{};
+        std::deque<std::function<void()>> _work{};
+        const size_t _maxThreads;
+        size_t _threadCount{};
+        size_t _idleCount{};
+
+        ThreadPool()
+            : _maxThreads{ std::max<size_t>(4, 2 * std::thread::hardware_concurrency()) } {}
+
+    public:
+        ThreadPool(const ThreadPool&) = delete;
+        ThreadPool& operator=(const ThreadPool&) = delete;
+
+        /**
+         * @brief Gets the thread pool shared by the library.
+         * @return The thread pool instance.
+         * @note The instance is never destroyed so callbacks may be posted at any time,
+         *       including during program exit.
+         */
+        static ThreadPool& instance()
+        {
+            static ThreadPool* pool = new ThreadPool{};
+            return *pool;
+        }
+
+        /**
+         * @brief Runs the given callback on a background thread.
+         * @param callback The callback to run.
+         */
+        void post(std::function<void()> callback)
+        {
+            bool startThread = false;
+            {
+                std::lock_guard lock{ _mutex };
+                _work.push_back(std::move(callback));
+                if (_idleCount < _work.size() && _threadCount < _maxThreads)
+                {
+                    ++_threadCount;
+                    startThread = true;
+                }
+            }
+            if (startThread)
+            {
+                std::thread{ [this]() { run(); } }.detach();
+            }
+            else
+            {
+                _cv.notify_one();
+            }
+        }
+
+    private:
+        void run()
+        {
+            std::unique_lock lock{ _mutex };
+            while (true)
+            {
+                if (_work.empty())
+                {
+                    ++_idleCount;
+                    const bool hasWork = _cv.wait_for(lock, idleTimeout, [this]() { return !_work.empty(); });
+                    --_idleCount;
+                    if (!hasWork)
+                    {
+                        --_threadCount;
+                        return;
+                    }
+                }
+
+                // Run callback without holding the lock
+                auto callback = std::move(_work.front());
+                _work.pop_front();
+
+                lock.unlock();
+                callback();
+                lock.lock();
+            }
+        }
+    };
+}
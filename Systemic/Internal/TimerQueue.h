@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @brief Definition of the TimerQueue internal class.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+namespace Systemic::Internal
+{
+    /**
+     * @brief Runs callbacks at given times, using a single background thread for all of them.
+     *
+     * Callbacks are run on the timer thread and should complete quickly.
+     *
+     * This class is thread safe.
+     */
+    class TimerQueue
+    {
+    public:
+        /// Identifies a scheduled callback.
+        using TimerId = std::uint64_t;
+
+        /// Clock used for scheduling.
+        using Clock = std::chrono::steady_clock;
+
+    private:
+        std::mutex _mutex{};
+        std::condition_variable _cv{};
+        std::multimap<Clock::time_point, TimerId> _deadlines{};
+        std::unordered_map<TimerId, std::pair<Clock::time_point, std::function<void()>>> _callbacks{};
+        TimerId _lastId{};
+        bool _started{};
+
+        TimerQueue() = default;
+
+    public:
+        TimerQueue(const TimerQueue&) = delete;
+        TimerQueue& operator=(const TimerQueue&) = delete;
+
+        /**
+         * @brief Gets the timer queue shared by the library.
+         * @return The timer queue instance.
+         * @note The instance is never destroyed so timers may be scheduled and canceled
+         *       at any time, including during program exit.
+         */
+        static TimerQueue& instance()
+        {
+            static TimerQueue* queue = new TimerQueue{};
+            return *queue;
+        }
+
+        /**
+         * @brief Schedules a callback to be run after the given delay.
+         * @param delay Time to wait before running the callback.
+         * @param callback The callback to run.
+         * @return The timer id, to be used for canceling the callback.
+         */
+        TimerId schedule(Clock::duration delay, std::function<void()> callback)
+        {
+            const auto deadline = Clock::now() + delay;
+            TimerId id{};
+            {
+                std::lock_guard lock{ _mutex };
+                if (!_started)
+                {
+                    _started = true;
+                    std::thread{ [this]() { run(); } }.detach();
+                }
+                id = ++_lastId;
+                _callbacks.emplace(id, std::make_pair(deadline, std::move(callback)));
+                _deadlines.emplace(deadline, id);
+            }
+            _cv.notify_one();
+            return id;
+        }
+
+        /**
+         * @brief Cancels a scheduled callback.
+         * @param id The timer id returned by schedule().
+         * @return Whether the callback was canceled before being run.
+         */
+        bool cancel(TimerId id)
+        {
+            std::lock_guard lock{ _mutex };
+            auto it = _callbacks.find(id);
+            if (it == _callbacks.end())
+            {
+                return false;
+            }
+            auto [first, last] = _deadlines.equal_range(it->second.first);
+            for (; first != last; ++first)
+            {
+                if (first->second == id)
+                {
+                    _deadlines.erase(first);
+                    break;
+                }
+            }
+            _callbacks.erase(it);
+            return true;
+        }
+
+    private:
+        void run()
+        {
+            std::unique_lock lock{ _mutex };
+            while (true)
+            {
+                if (_deadlines.empty())
+                {
+                    _cv.wait(lock);
+                    continue;
+                }
+
+                const auto next = _deadlines.begin();
+                if (next->first > Clock::now())
+                {
+                    // Wait on a copy, the entry may be canceled while the lock is released
+                    const auto deadline = next->first;
+                    _cv.wait_until(lock, deadline);
+                    continue;
+                }
+
+                // Run callback without holding the lock
+                auto it = _callbacks.find(next->second);
+                auto callback = std::move(it->second.second);
+                _callbacks.erase(it);
+                _deadlines.erase(next);
+
+                lock.unlock();
+                callback();
+                lock.lock();
+            }
+        }
+    };
+}
@@ -8,6 +8,7 @@
 #include <cstdint>
 #include <vector>
 #include <algorithm> // sort, includes
+#include "ByteSpan.h"
 
 namespace Systemic::BluetoothLE::Internal
 {
@@ -27,6 +28,8 @@ namespace Systemic::BluetoothLE::Internal
         return std::includes(superset.begin(), superset.end(), subset.begin(), subset.end());
     }
 
+#ifdef _WIN32
+
     /**
      * @brief Converts a WinRT IBuffer to a std::vector<uint8_t>.
      *
@@ -45,6 +48,18 @@ namespace Systemic::BluetoothLE::Internal
         return outData;
     }
 
+    /**
+     * @brief Gets a view on the content of a WinRT IBuffer, without copying it.
+     *
+     * @param buffer The buffer, it must outlive the returned view.
+     * @return A ByteSpan viewing the data of the buffer.
+     */
+    inline
+        ByteSpan dataBufferToByteSpan(const winrt::Windows::Storage::Streams::IBuffer& buffer)
+    {
+        return ByteSpan{ buffer.data(), buffer.Length() };
+    }
+
     /**
      * @brief Converts a std::vector<uint8_t> to a WinRT IBuffer.
      *
@@ -62,4 +77,6 @@ namespace Systemic::BluetoothLE::Internal
         dataWriter.WriteBytes(data);
         return dataWriter.DetachBuffer();
     }
+
+#endif
 }
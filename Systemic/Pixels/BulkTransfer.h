@@ -0,0 +1,101 @@
+/**
+ * @file
+ * @brief Types used for bulk data transfers with a Pixel.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <chrono>
+#include <functional>
+
+namespace Systemic::Pixels
+{
+    /// Settings for a bulk data transfer, see Pixel::ensureDataSetAsync().
+    struct BulkTransferOptions
+    {
+        /// Maximum number of data packets sent but not yet acknowledged by the Pixel.
+        int windowSize{ 4 };
+
+        /// Time to wait for a packet acknowledgment before sending it again.
+        std::chrono::milliseconds ackTimeout{ 500 };
+
+        /// Maximum number of times a packet may be sent again before the transfer is aborted.
+        int maxRetries{ 3 };
+
+        /// Time to wait for the Pixel to acknowledge the transfer setup.
+        std::chrono::milliseconds setupTimeout{ 2000 };
+
+        /// Time to wait for the Pixel to notify it stored the data, once all of it was acknowledged.
+        std::chrono::milliseconds finishTimeout{ 5000 };
+    };
+
+    /// Progress and statistics of a bulk data transfer.
+    struct BulkTransferProgress
+    {
+        /// Total number of bytes to transfer.
+        size_t totalBytes{};
+
+        /// Number of bytes acknowledged by the Pixel.
+        size_t acknowledgedBytes{};
+
+        /// Number of bytes of data per packet, based on the connection MTU.
+        size_t packetSize{};
+
+        /// Number of data packets sent, including retransmissions.
+        size_t packetsSent{};
+
+        /// Number of data packets that were sent again after a missing acknowledgment.
+        size_t retransmissions{};
+
+        /// Time since the transfer started.
+        std::chrono::steady_clock::duration elapsed{};
+
+        /**
+         * @brief Gets the average throughput since the transfer started.
+         * @return The throughput in bytes per second.
+         */
+        double bytesPerSecond() const
+        {
+            const auto seconds = std::chrono::duration<double>(elapsed).count();
+            return seconds > 0 ? acknowledgedBytes / seconds : 0;
+        }
+
+        /**
+         * @brief Gets the transfer progress.
+         * @return The progress, between 0 and 1.
+         */
+        float progress() const
+        {
+            return totalBytes ? static_cast<float>(acknowledgedBytes) / totalBytes : 1.f;
+        }
+    };
+
+    /// The possible results of a bulk data transfer.
+    enum class BulkTransferResult
+    {
+        /// All the data was acknowledged by the Pixel.
+        Success,
+
+        /// The data is empty or too large.
+        InvalidData,
+
+        /// The Pixel is not ready.
+        NotReady,
+
+        /// The Pixel didn't acknowledge or refused the transfer setup.
+        SetupFailed,
+
+        /// Sending a packet failed.
+        SendFailed,
+
+        /// A packet was not acknowledged after the maximum number of retries.
+        Timeout,
+
+        /// The Pixel didn't notify that it stored the data.
+        NotFinished,
+    };
+
+    /// Signature of a bulk transfer progress listener.
+    using BulkTransferProgressListener = std::function<void(const BulkTransferProgress&)>;
+}
@@ -0,0 +1,242 @@
+/**
+ * @file
+ * @brief Definition of the ConnectionManager class.
+ */
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <unordered_map>
+#include <vector>
+#include "Systemic/Internal/AwaitableResult.h"
+#include "Systemic/Internal/TimerQueue.h"
+#include "Pixel.h"
+
+namespace Systemic::Pixels
+{
+    /// Options for a ConnectionManager.
+    struct ConnectionManagerOptions
+    {
+        /// Maximum number of connection attempts running at the same time.
+        size_t maxConcurrentConnects = 2;
+
+        /// Number of failed connection attempts after which a die is given up, zero for no limit.
+        int maxAttempts = 5;
+
+        /// Delay before the first retry.
+        std::chrono::milliseconds initialBackoff{ 500 };
+
+        /// Maximum delay between two attempts.
+        std::chrono::milliseconds maxBackoff{ 30000 };
+
+        /// Factor by which the delay grows after each failed attempt.
+        double backoffMultiplier = 2;
+
+        /// Relative amount of randomness applied to the delay, from 0 to 1.
+        double jitter = 0.25;
+
+        /// Whether to connect the dice with auto-reconnect, see Pixel::connectAsync().
+        bool autoReconnect = false;
+
+        /// Fast identification setting of the Pixels created from scanned data, see Pixel::setFastIdentifyMaxAge().
+        std::chrono::milliseconds fastIdentifyMaxAge{};
+    };
+
+    /// Latency statistics of one stage of the connection process.
+    struct ConnectionStageStats
+    {
+        /// Number of measurements.
+        uint64_t count{};
+
+        /// Average duration.
+        std::chrono::steady_clock::duration average{};
+
+        /// Longest duration.
+        std::chrono::steady_clock::duration max{};
+
+        /// Sum of the durations.
+        std::chrono::steady_clock::duration total{};
+
+        /**
+         * @brief Adds a measurement.
+         * @param duration The measured duration.
+         */
+        void add(std::chrono::steady_clock::duration duration)
+        {
+            ++count;
+            total += duration;
+            average = total / count;
+            if (duration > max)
+            {
+                max = duration;
+            }
+        }
+    };
+
+    /// Statistics of a ConnectionManager.
+    struct ConnectionManagerStats
+    {
+        /// Number of connection attempts started.
+        uint64_t attempts{};
+
+        /// Number of successful connection attempts.
+        uint64_t successes{};
+
+        /// Number of failed connection attempts.
+        uint64_t failures{};
+
+        /// Number of dice given up after too many failed attempts.
+        uint64_t gaveUp{};
+
+        /// Number of dice waiting to be connected, including those waiting for a retry.
+        size_t pendingCount{};
+
+        /// Number of dice being connected.
+        size_t connectingCount{};
+
+        /// Number of dice that were successfully connected.
+        size_t connectedCount{};
+
+        /// Time spent waiting for a connection slot once a die may be connected.
+        ConnectionStageStats queueWait{};
+
+        /// Time spent connecting to the device and discovering its services.
+        ConnectionStageStats connect{};
+
+        /// Time spent subscribing for notifications and identifying the die.
+        ConnectionStageStats identify{};
+
+        /// Total time of the successful connection attempts, queue wait excluded.
+        ConnectionStageStats total{};
+    };
+
+    /**
+     * @brief Connects a set of Pixels while limiting the number of concurrent connection attempts.
+     *
+     * Dice are connected by order of decreasing advertised signal strength, so the dice that
+     * are the most likely to connect quickly don't wait for the others. A failed attempt is
+     * retried after an exponentially growing delay with some randomness, so dice that are out
+     * of range don't keep the Bluetooth adapter busy and retries of different dice are spread
+     * over time.
+     *
+     * Each connection stage is timed, see stats().
+     *
+     * This class is thread safe.
+     */
+    class ConnectionManager : public std::enable_shared_from_this<ConnectionManager>
+    {
+        using Clock = std::chrono::steady_clock;
+
+        enum class EntryState
+        {
+            Pending,
+            Connecting,
+            Connected,
+            Stopped,
+        };
+
+        struct Entry
+        {
+            std::shared_ptr<Pixel> pixel{};
+            int rssi{};
+            EntryState state{ EntryState::Stopped };
+            int failedAttempts{};
+            Clock::time_point readyTime{};
+            Internal::TimerQueue::TimerId retryTimerId{};
+        };
+
+        const ConnectionManagerOptions _options;
+        const std::shared_ptr<PixelDelegate> _delegate;
+        std::unordered_map<bluetooth_address_t, Entry> _entries{};
+        std::vector<Internal::AwaitableResult<bool>> _idleWaiters{};
+        ConnectionManagerStats _stats{};
+        std::mt19937 _random{ std::random_device{}() };
+        mutable std::mutex _mutex{};
+
+    public:
+        /**
+         * @brief Initializes a new instance of ConnectionManager.
+         * @param options The connection options.
+         * @param delegate The delegate given to the Pixel instances created by this manager.
+         * @return A ConnectionManager instance in a shared pointer.
+         */
+        static std::shared_ptr<ConnectionManager> create(
+            const ConnectionManagerOptions& options = {},
+            std::shared_ptr<PixelDelegate> delegate = nullptr)
+        {
+            return std::shared_ptr<ConnectionManager>(new ConnectionManager{ options, delegate });
+        }
+
+        /**
+         * @brief Cancels the pending retries.
+         */
+        ~ConnectionManager();
+
+        /**
+         * @brief Adds a scanned die and queues its connection.
+         *
+         * If the die was already added, its signal strength is updated and it is queued
+         * again if it is disconnected and not being retried.
+         * @param scannedPixel The scanned Pixel data identifying the die.
+         * @return The Pixel instance for the die.
+         */
+        std::shared_ptr<Pixel> add(const ScannedPixel& scannedPixel);
+
+        /**
+         * @brief Adds a Pixel and queues its connection.
+         * @param pixel The Pixel to connect.
+         * @param rssi The signal strength used to order the connections, in dBm.
+         */
+        void add(const std::shared_ptr<Pixel>& pixel, int rssi = 0);
+
+        /**
+         * @brief Stops managing a Pixel, its connection isn't changed.
+         * @param pixel The Pixel to remove.
+         * @return Whether the Pixel was managed by this instance.
+         */
+        bool remove(const std::shared_ptr<Pixel>& pixel);
+
+        /**
+         * @brief Gets the managed Pixels.
+         * @return The Pixels.
+         */
+        std::vector<std::shared_ptr<Pixel>> pixels() const;
+
+        /**
+         * @brief Waits until no connection is pending, the dice being either connected
+         *        or given up.
+         * @return A future that completes once idle.
+         */
+        std::future<void> waitIdleAsync();
+
+        /**
+         * @brief Gets the connection statistics.
+         * @return A copy of the statistics.
+         */
+        ConnectionManagerStats stats() const;
+
+    private:
+        ConnectionManager(const ConnectionManagerOptions& options, std::shared_ptr<PixelDelegate> delegate)
+            : _options{ options }, _delegate{ delegate } {}
+
+        // Must be called with the lock held
+        void queue(Entry& entry, int rssi);
+
+        // Starts as many pending connections as allowed
+        void schedule();
+
+        // Runs one connection attempt
+        Internal::DetachedTask connectAsync(std::shared_ptr<Pixel> pixel);
+
+        // Must be called with the lock held
+        std::chrono::milliseconds nextBackoff(int failedAttempts);
+
+        // Must be called with the lock held, returns the waiters to complete
+        std::vector<Internal::AwaitableResult<bool>> takeIdleWaitersIfIdle();
+    };
+}
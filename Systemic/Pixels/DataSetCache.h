@@ -0,0 +1,151 @@
+/**
+ * @file
+ * @brief Definition of the DataSetCache class.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <unordered_map>
+#include <vector>
+#include "Systemic/Internal/ByteSpan.h"
+
+namespace Systemic::Pixels
+{
+    /// The possible results of Pixel::ensureDataSetAsync().
+    enum class DataSetUploadResult
+    {
+        /// The Pixel already holds the data set, nothing was transferred.
+        UpToDate,
+
+        /// The data set was uploaded to the Pixel.
+        Uploaded,
+
+        /// The Pixel is not ready.
+        NotReady,
+
+        /// The data set transfer failed.
+        TransferFailed,
+
+        /// The data set was transferred but the Pixel didn't report a new data set hash.
+        VerificationFailed,
+    };
+
+    /**
+     * @brief A content addressed cache of the data sets uploaded to Pixels dice.
+     *
+     * Each uploaded data set is stored along with the data set hash reported by the die
+     * once the transfer completed. This let Pixel::ensureDataSetAsync() skip the transfer
+     * when a die reports the same hash as the one obtained for the data to upload.
+     *
+     * A same cache instance is typically shared by all the Pixel instances.
+     *
+     * This class is thread safe.
+     */
+    class DataSetCache
+    {
+        struct Entry
+        {
+            uint32_t dataSetHash{};
+            std::shared_ptr<const std::vector<uint8_t>> data{};
+        };
+
+        std::unordered_map<uint64_t, Entry> _entries{};
+        mutable std::mutex _mutex{};
+
+    public:
+        /**
+         * @brief Gets a cache instance shared by the whole application.
+         * @return The shared cache instance.
+         */
+        static const std::shared_ptr<DataSetCache>& shared()
+        {
+            static const std::shared_ptr<DataSetCache> cache{ new DataSetCache{} };
+            return cache;
+        }
+
+        /**
+         * @brief Computes the hash used to identify some data set content in the cache.
+         *
+         * This is a 64 bits FNV-1a hash of the data, it is unrelated to the hash
+         * computed by the Pixels firmware.
+         *
+         * @param data The data set content.
+         * @return The content hash.
+         */
+        static uint64_t computeContentHash(ByteSpan data)
+        {
+            uint64_t hash = 0xcbf29ce484222325ull;
+            for (const auto byte : data)
+            {
+                hash ^= byte;
+                hash *= 0x100000001b3ull;
+            }
+            return hash;
+        }
+
+        /**
+         * @brief Gets the data set hash reported by a Pixel after uploading the data set
+         *        with the given content hash.
+         * @param contentHash The content hash, see computeContentHash().
+         * @return The data set hash, if the data set is in the cache.
+         */
+        std::optional<uint32_t> findDataSetHash(uint64_t contentHash) const
+        {
+            std::lock_guard lock{ _mutex };
+            auto it = _entries.find(contentHash);
+            return it != _entries.end() ? std::optional<uint32_t>{ it->second.dataSetHash } : std::nullopt;
+        }
+
+        /**
+         * @brief Gets the data set content for the data set hash reported by a Pixel.
+         * @param dataSetHash The data set hash.
+         * @return The data set content, or null if not in the cache.
+         */
+        std::shared_ptr<const std::vector<uint8_t>> findData(uint32_t dataSetHash) const
+        {
+            std::lock_guard lock{ _mutex };
+            for (const auto& [_, entry] : _entries)
+            {
+                if (entry.dataSetHash == dataSetHash)
+                {
+                    return entry.data;
+                }
+            }
+            return nullptr;
+        }
+
+        /**
+         * @brief Adds or replaces a data set in the cache.
+         * @param contentHash The content hash, see computeContentHash().
+         * @param dataSetHash The data set hash reported by the Pixel that received the data.
+         * @param data The data set content.
+         */
+        void add(uint64_t contentHash, uint32_t dataSetHash, std::vector<uint8_t> data)
+        {
+            auto shared = std::make_shared<const std::vector<uint8_t>>(std::move(data));
+            std::lock_guard lock{ _mutex };
+            _entries[contentHash] = Entry{ dataSetHash, std::move(shared) };
+        }
+
+        /**
+         * @brief Gets the number of data sets in the cache.
+         * @return The number of data sets.
+         */
+        size_t size() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _entries.size();
+        }
+
+        /// Removes all the data sets from the cache.
+        void clear()
+        {
+            std::lock_guard lock{ _mutex };
+            _entries.clear();
+        }
+    };
+}
@@ -0,0 +1,492 @@
+/**
+ * @file
+ * @brief Definition of the DelegateDispatcher and DispatchedPixelDelegate classes.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include "Systemic/Internal/BoundedQueue.h"
+#include "Pixel.h"
+
+namespace Systemic::Pixels
+{
+    /// What a DelegateDispatcher does with a new event when its queue is full.
+    enum class DispatchOverflowPolicy
+    {
+        /// Drop the oldest queued event to make room for the new one.
+        DropOldest,
+
+        /// Keep only the latest value of state change events (status, RSSI, battery, etc.)
+        /// until the queue has been drained. Other events, such as rolls, wait for room in the queue
+        /// and for the kept values to be dispatched, so they don't overtake them.
+        /// A kept value is dispatched at the position of its latest update.
+        /// As with Block, the thread running DelegateDispatcher::drain() never waits.
+        Coalesce,
+
+        /// Wait for room in the queue. The thread running DelegateDispatcher::drain() never waits,
+        /// the events it posts that don't fit in the queue are dispatched after the queued ones.
+        Block,
+    };
+
+    /// Counters of a DelegateDispatcher.
+    struct DelegateDispatcherStats
+    {
+        /// Number of events posted.
+        uint64_t eventsPosted{};
+
+        /// Number of events dispatched to the delegate.
+        uint64_t eventsDispatched{};
+
+        /// Number of events dropped because the queue was full.
+        uint64_t eventsDropped{};
+
+        /// Number of events replaced by a newer event of the same kind because the queue was full.
+        uint64_t eventsCoalesced{};
+
+        /// Number of times a thread posting an event had to wait for room in the queue.
+        uint64_t producerWaits{};
+
+        /// Number of events currently waiting to be dispatched.
+        size_t queueSize{};
+
+        /// Average time between posting and dispatching an event.
+        std::chrono::microseconds averageLatency{};
+
+        /// Longest time between posting and dispatching an event.
+        std::chrono::microseconds maxLatency{};
+    };
+
+    /**
+     * @brief Runs callbacks posted from any thread on a thread chosen by the user.
+     *
+     * Events are stored in a bounded lock-free queue and run by drain(). Events from a same
+     * thread are dispatched in the order they were posted. When the queue is full,
+     * the overflow policy decides which events are kept, see DispatchOverflowPolicy::Coalesce
+     * for the order of coalesced events.
+     *
+     * An executor may be given on creation. It is called with a task that drains the queue
+     * whenever events are waiting and no drain is scheduled yet, for example to post that task
+     * to a UI thread dispatcher. Without an executor, drain() must be called regularly.
+     *
+     * This class is thread safe.
+     */
+    class DelegateDispatcher : public std::enable_shared_from_this<DelegateDispatcher>
+    {
+    public:
+        /// Signature of an executor, it must eventually run the given task on the thread of its choice.
+        using Executor = std::function<void(std::function<void()> task)>;
+
+        /// Clock used for measuring latency.
+        using Clock = std::chrono::steady_clock;
+
+        /// Coalescing kind for events that should never be coalesced.
+        static constexpr int notCoalescable = -1;
+
+    private:
+        struct Event
+        {
+            std::function<void()> callback{};
+            const void* source{};
+            int kind{ notCoalescable };
+            Clock::time_point postedTime{};
+        };
+
+        Internal::BoundedQueue<Event> _queue;
+        const DispatchOverflowPolicy _policy;
+        const Executor _executor;
+
+        // Coalesced events, and events posted by the draining thread that didn't fit in the queue,
+        // waiting for the queue to be drained, in posting order, with an index of the coalesced
+        // events by source and kind
+        std::list<Event> _overflow{};
+        std::map<std::pair<const void*, int>, std::list<Event>::iterator> _overflowIndex{};
+        std::atomic<size_t> _overflowSize{};
+        std::mutex _overflowMutex{};
+
+        // Drain state
+        std::mutex _drainMutex{};
+        std::atomic<bool> _drainScheduled{};
+        std::mutex _roomMutex{};
+        std::condition_variable _roomCv{};
+
+        // Counters
+        std::atomic<uint64_t> _eventsPosted{};
+        std::atomic<uint64_t> _eventsDispatched{};
+        std::atomic<uint64_t> _eventsDropped{};
+        std::atomic<uint64_t> _eventsCoalesced{};
+        std::atomic<uint64_t> _producerWaits{};
+        std::atomic<uint64_t> _totalLatencyUs{};
+        std::atomic<uint64_t> _maxLatencyUs{};
+
+        DelegateDispatcher(size_t capacity, DispatchOverflowPolicy policy, Executor executor)
+            : _queue{ capacity }, _policy{ policy }, _executor{ std::move(executor) } {}
+
+    public:
+        /**
+         * @brief Creates a new dispatcher.
+         * @param capacity Minimum number of events the queue may hold, rounded up to a power of two.
+         * @param policy What to do with new events when the queue is full.
+         * @param executor Optional executor scheduling calls to drain(), see class description.
+         * @return The new dispatcher.
+         */
+        static std::shared_ptr<DelegateDispatcher> create(
+            size_t capacity = 256,
+            DispatchOverflowPolicy policy = DispatchOverflowPolicy::DropOldest,
+            Executor executor = nullptr)
+        {
+            return std::shared_ptr<DelegateDispatcher>(new DelegateDispatcher{ capacity, policy, std::move(executor) });
+        }
+
+        DelegateDispatcher(const DelegateDispatcher&) = delete;
+        DelegateDispatcher& operator=(const DelegateDispatcher&) = delete;
+
+        /// Gets the overflow policy.
+        DispatchOverflowPolicy policy() const
+        {
+            return _policy;
+        }
+
+        /**
+         * @brief Queues a callback to be run by drain().
+         * @param callback The callback.
+         * @param source Object the event is about, used for coalescing.
+         * @param kind Kind of event, used for coalescing, or notCoalescable.
+         */
+        void post(std::function<void()> callback, const void* source = nullptr, int kind = notCoalescable)
+        {
+            Event event{ std::move(callback), source, kind, Clock::now() };
+            _eventsPosted.fetch_add(1, std::memory_order_relaxed);
+
+            const bool coalescable = _policy == DispatchOverflowPolicy::Coalesce && kind != notCoalescable;
+
+            // Keep the latest values in order once events started to be coalesced,
+            // and the events of the draining thread in order once they started to overflow
+            bool overflowed = false;
+            if (_overflowSize.load(std::memory_order_acquire))
+            {
+                if (coalescable)
+                {
+                    overflowed = coalesce(event);
+                }
+                else if (_policy != DispatchOverflowPolicy::DropOldest && isDraining())
+                {
+                    overflowed = appendOverflow(event);
+                }
+            }
+
+            if (!overflowed)
+            {
+                bool waited = false;
+                while (mustWaitForOverflow(coalescable) || !_queue.tryPush(event))
+                {
+                    if (coalescable && coalesce(event))
+                    {
+                        break;
+                    }
+                    if (_policy == DispatchOverflowPolicy::DropOldest)
+                    {
+                        if (_queue.tryPop())
+                        {
+                            _eventsDropped.fetch_add(1, std::memory_order_relaxed);
+                        }
+                        continue;
+                    }
+                    if (isDraining())
+                    {
+                        // Never wait from the draining thread, it would wait for itself
+                        appendOverflow(event);
+                        break;
+                    }
+
+                    if (!waited)
+                    {
+                        waited = true;
+                        _producerWaits.fetch_add(1, std::memory_order_relaxed);
+                    }
+                    scheduleDrain();
+                    std::unique_lock lock{ _roomMutex };
+                    _roomCv.wait(lock, [this, coalescable]()
+                        {
+                            return !mustWaitForOverflow(coalescable) && _queue.size() < _queue.capacity();
+                        });
+                }
+            }
+
+            scheduleDrain();
+        }
+
+        /**
+         * @brief Runs queued callbacks on the calling thread.
+         *
+         * Only one thread drains at a time, a concurrent call returns immediately.
+         * @param maxEvents Maximum number of callbacks to run from the queue.
+         * @return The number of callbacks that were run.
+         */
+        size_t drain(size_t maxEvents = std::numeric_limits<size_t>::max())
+        {
+            std::unique_lock lock{ _drainMutex, std::try_to_lock };
+            if (!lock)
+            {
+                return 0;
+            }
+
+            struct DrainingScope
+            {
+                const DelegateDispatcher* previous;
+                DrainingScope(const DelegateDispatcher* dispatcher) : previous{ drainingDispatcher() } { drainingDispatcher() = dispatcher; }
+                ~DrainingScope() { drainingDispatcher() = previous; }
+            } scope{ this };
+
+            size_t count = 0;
+            while (count < maxEvents)
+            {
+                if (auto event = _queue.tryPop())
+                {
+                    if (_policy != DispatchOverflowPolicy::DropOldest)
+                    {
+                        notifyRoom();
+                    }
+                    dispatch(*event);
+                    ++count;
+                }
+                else if (_overflowSize.load(std::memory_order_acquire))
+                {
+                    // Queue is empty, now run the coalesced events
+                    std::list<Event> overflow{};
+                    {
+                        std::lock_guard overflowLock{ _overflowMutex };
+                        overflow.swap(_overflow);
+                        _overflowIndex.clear();
+                        _overflowSize.store(0, std::memory_order_release);
+                    }
+
+                    // Events waiting for the coalesced ones are queued after them
+                    notifyRoom();
+                    for (auto& overflowEvent : overflow)
+                    {
+                        dispatch(overflowEvent);
+                        ++count;
+                    }
+                }
+                else
+                {
+                    break;
+                }
+            }
+            return count;
+        }
+
+        /**
+         * @brief Gets a snapshot of the dispatcher counters.
+         * @return The dispatcher counters.
+         */
+        DelegateDispatcherStats stats() const
+        {
+            DelegateDispatcherStats stats{};
+            stats.eventsPosted = _eventsPosted.load(std::memory_order_relaxed);
+            stats.eventsDispatched = _eventsDispatched.load(std::memory_order_relaxed);
+            stats.eventsDropped = _eventsDropped.load(std::memory_order_relaxed);
+            stats.eventsCoalesced = _eventsCoalesced.load(std::memory_order_relaxed);
+            stats.producerWaits = _producerWaits.load(std::memory_order_relaxed);
+            stats.queueSize = _queue.size() + _overflowSize.load(std::memory_order_relaxed);
+            if (stats.eventsDispatched)
+            {
+                stats.averageLatency = std::chrono::microseconds(_totalLatencyUs.load(std::memory_order_relaxed) / stats.eventsDispatched);
+            }
+            stats.maxLatency = std::chrono::microseconds(_maxLatencyUs.load(std::memory_order_relaxed));
+            return stats;
+        }
+
+    private:
+        static const DelegateDispatcher*& drainingDispatcher()
+        {
+            static thread_local const DelegateDispatcher* dispatcher{};
+            return dispatcher;
+        }
+
+        bool isDraining() const
+        {
+            return drainingDispatcher() == this;
+        }
+
+        // Whether a non coalescable event must wait for the coalesced events to be dispatched
+        // so it doesn't overtake them, the draining thread never waits
+        bool mustWaitForOverflow(bool coalescable) const
+        {
+            return _policy == DispatchOverflowPolicy::Coalesce && !coalescable
+                && _overflowSize.load(std::memory_order_acquire) && !isDraining();
+        }
+
+        bool coalesce(Event& event)
+        {
+            std::lock_guard lock{ _overflowMutex };
+            auto [it, inserted] = _overflowIndex.try_emplace(std::make_pair(event.source, event.kind));
+            if (inserted)
+            {
+                _overflowSize.fetch_add(1, std::memory_order_release);
+            }
+            else
+            {
+                // Replace the previous value, which moves behind the events posted in the meantime.
+                // Keep the time of the oldest event so latency reflects how stale the value is
+                event.postedTime = it->second->postedTime;
+                _overflow.erase(it->second);
+                _eventsCoalesced.fetch_add(1, std::memory_order_relaxed);
+            }
+            _overflow.push_back(std::move(event));
+            it->second = std::prev(_overflow.end());
+            return true;
+        }
+
+        bool appendOverflow(Event& event)
+        {
+            std::lock_guard lock{ _overflowMutex };
+            _overflow.push_back(std::move(event));
+            _overflowSize.fetch_add(1, std::memory_order_release);
+            return true;
+        }
+
+        // Wakes up the threads waiting for room, notifying under the lock so a thread
+        // that just found the queue full can't miss it
+        void notifyRoom()
+        {
+            std::lock_guard lock{ _roomMutex };
+            _roomCv.notify_all();
+        }
+
+        void dispatch(Event& event)
+        {
+            const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - event.postedTime);
+            const auto latencyUs = static_cast<uint64_t>(std::max<int64_t>(latency.count(), 0));
+            _totalLatencyUs.fetch_add(latencyUs, std::memory_order_relaxed);
+            auto maxLatency = _maxLatencyUs.load(std::memory_order_relaxed);
+            while (latencyUs > maxLatency && !_maxLatencyUs.compare_exchange_weak(maxLatency, latencyUs, std::memory_order_relaxed));
+            _eventsDispatched.fetch_add(1, std::memory_order_relaxed);
+
+            if (event.callback)
+            {
+                event.callback();
+            }
+        }
+
+        void scheduleDrain()
+        {
+            if (_executor && !_drainScheduled.exchange(true, std::memory_order_acq_rel))
+            {
+                _executor([weakSelf = weak_from_this()]()
+                    {
+                        if (auto self = weakSelf.lock())
+                        {
+                            self->_drainScheduled.store(false, std::memory_order_release);
+                            self->drain();
+                            if (self->_queue.size() || self->_overflowSize.load(std::memory_order_acquire))
+                            {
+                                self->scheduleDrain();
+                            }
+                        }
+                    });
+            }
+        }
+    };
+
+    /**
+     * @brief A PixelDelegate that forwards the events it receives to another delegate
+     *        through a DelegateDispatcher.
+     *
+     * Pass an instance to Pixel::create() so that a slow delegate doesn't delay the
+     * delivery of notifications from the die. A same dispatcher may be shared by several Pixels.
+     */
+    class DispatchedPixelDelegate : public PixelDelegate
+    {
+        // Coalescing kinds of the state change events
+        enum Kind
+        {
+            StatusKind,
+            FirmwareDateKind,
+            RssiKind,
+            BatteryLevelKind,
+            ChargingStateKind,
+        };
+
+        const std::shared_ptr<PixelDelegate> _delegate;
+        const std::shared_ptr<DelegateDispatcher> _dispatcher;
+
+    public:
+        /**
+         * @brief Initializes a new instance.
+         * @param delegate The delegate that receives the events on the dispatcher thread.
+         * @param dispatcher The dispatcher running the events.
+         */
+        DispatchedPixelDelegate(std::shared_ptr<PixelDelegate> delegate, std::shared_ptr<DelegateDispatcher> dispatcher)
+            : _delegate{ std::move(delegate) }, _dispatcher{ std::move(dispatcher) } {}
+
+        /// Gets the dispatcher.
+        const std::shared_ptr<DelegateDispatcher>& dispatcher() const
+        {
+            return _dispatcher;
+        }
+
+        virtual void onStatusChanged(std::shared_ptr<Pixel> pixel, PixelStatus status) override
+        {
+            const void* source = pixel.get();
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), status]() { delegate->onStatusChanged(pixel, status); }, source, StatusKind);
+        }
+
+        virtual void onFirmwareDateChanged(std::shared_ptr<Pixel> pixel, std::chrono::system_clock::time_point firmwareDate) override
+        {
+            const void* source = pixel.get();
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), firmwareDate]() { delegate->onFirmwareDateChanged(pixel, firmwareDate); }, source, FirmwareDateKind);
+        }
+
+        virtual void onRssiChanged(std::shared_ptr<Pixel> pixel, int rssi) override
+        {
+            const void* source = pixel.get();
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), rssi]() { delegate->onRssiChanged(pixel, rssi); }, source, RssiKind);
+        }
+
+        virtual void onBatteryLevelChanged(std::shared_ptr<Pixel> pixel, int batteryLevel) override
+        {
+            const void* source = pixel.get();
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), batteryLevel]() { delegate->onBatteryLevelChanged(pixel, batteryLevel); }, source, BatteryLevelKind);
+        }
+
+        virtual void onChargingStateChanged(std::shared_ptr<Pixel> pixel, bool isCharging) override
+        {
+            const void* source = pixel.get();
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), isCharging]() { delegate->onChargingStateChanged(pixel, isCharging); }, source, ChargingStateKind);
+        }
+
+        virtual void onRollStateChanged(std::shared_ptr<Pixel> pixel, PixelRollState state, int face) override
+        {
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), state, face]() { delegate->onRollStateChanged(pixel, state, face); });
+        }
+
+        virtual void onRolled(std::shared_ptr<Pixel> pixel, int face) override
+        {
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), face]() { delegate->onRolled(pixel, face); });
+        }
+
+        virtual void onMessageReceived(std::shared_ptr<Pixel> pixel, std::shared_ptr<const Messages::PixelMessage> message) override
+        {
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), message = std::move(message)]() { delegate->onMessageReceived(pixel, message); });
+        }
+
+        virtual void onFastIdentifyFailed(std::shared_ptr<Pixel> pixel, bool isMismatch) override
+        {
+            _dispatcher->post([delegate = _delegate, pixel = std::move(pixel), isMismatch]() { delegate->onFastIdentifyFailed(pixel, isMismatch); });
+        }
+    };
+}
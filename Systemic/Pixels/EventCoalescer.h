@@ -0,0 +1,256 @@
+/**
+ * @file
+ * @brief Definition of the EventCoalescer class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include "Systemic/Internal/Coroutines.h"
+#include "Systemic/Internal/TimerQueue.h"
+
+namespace Systemic::Pixels
+{
+    /// The kinds of Pixel events that may be coalesced, see Pixel::setCoalescingWindow().
+    enum class PixelEventKind
+    {
+        /// PixelDelegate::onRssiChanged().
+        Rssi,
+
+        /// PixelDelegate::onBatteryLevelChanged().
+        BatteryLevel,
+
+        /// PixelDelegate::onChargingStateChanged().
+        ChargingState,
+
+        /// PixelDelegate::onRollStateChanged(), except for the "on face" state.
+        RollState,
+    };
+
+    /// Number of kinds of Pixel events that may be coalesced.
+    constexpr size_t pixelEventKindCount = 4;
+
+    /**
+     * @brief Limits the rate at which events of a given kind are delivered.
+     *
+     * Each kind of event has a coalescing window, zero by default meaning that events are
+     * delivered immediately. Otherwise an event is delivered immediately if the previous one
+     * was delivered at least one window ago. Later events are held until the window ends,
+     * and only the latest of them is then delivered, from a background thread.
+     * An event is never delivered after a newer event of the same kind.
+     *
+     * This class is thread safe.
+     */
+    class EventCoalescer
+    {
+        using Clock = Internal::TimerQueue::Clock;
+
+        struct Slot
+        {
+            Clock::duration window{};
+            Clock::time_point lastDelivery{};
+            std::function<void()> pending{};
+            Internal::TimerQueue::TimerId timerId{};
+            uint64_t timerGeneration{};
+            uint64_t sequence{};            // Incremented for each event, only the latest one is delivered
+            uint64_t pendingSequence{};     // Sequence number of the held event
+            std::recursive_mutex delivery{}; // Held while delivering an event, a delivery may notify again
+        };
+
+        struct State
+        {
+            std::array<Slot, pixelEventKindCount> slots{};
+            std::mutex mutex{};
+        };
+
+        // Shared with the timers that may outlive this instance
+        const std::shared_ptr<State> _state{ std::make_shared<State>() };
+
+    public:
+        EventCoalescer() = default;
+        EventCoalescer(const EventCoalescer&) = delete;
+        EventCoalescer& operator=(const EventCoalescer&) = delete;
+
+        /// Cancels the pending events.
+        ~EventCoalescer()
+        {
+            std::lock_guard lock{ _state->mutex };
+            for (auto& slot : _state->slots)
+            {
+                if (slot.timerId)
+                {
+                    Internal::TimerQueue::instance().cancel(slot.timerId);
+                }
+                slot.pending = nullptr;
+            }
+        }
+
+        /**
+         * @brief Gets the coalescing window of a kind of event.
+         * @param kind The kind of event.
+         * @return The coalescing window, zero if events are delivered immediately.
+         */
+        std::chrono::milliseconds window(PixelEventKind kind) const
+        {
+            std::lock_guard lock{ _state->mutex };
+            return std::chrono::duration_cast<std::chrono::milliseconds>(slot(kind).window);
+        }
+
+        /**
+         * @brief Sets the coalescing window of a kind of event.
+         *
+         * A held event is delivered immediately if the window is set to zero.
+         * @param kind The kind of event.
+         * @param window The coalescing window, zero to deliver events immediately.
+         */
+        void setWindow(PixelEventKind kind, std::chrono::milliseconds window)
+        {
+            std::function<void()> pending{};
+            uint64_t sequence{};
+            {
+                std::lock_guard lock{ _state->mutex };
+                auto& s = slot(kind);
+                s.window = std::max(window, std::chrono::milliseconds{});
+                if (s.window == Clock::duration{})
+                {
+                    sequence = s.pendingSequence;
+                    pending = takePending(s);
+                }
+            }
+            if (pending)
+            {
+                deliverIfLatest(*_state, kind, sequence, pending);
+            }
+        }
+
+        /**
+         * @brief Delivers an event now or when the coalescing window for its kind ends.
+         * @param kind The kind of event.
+         * @param deliver Delivers the event, may be dropped if superseded by a newer event.
+         */
+        void notify(PixelEventKind kind, std::function<void()> deliver)
+        {
+            uint64_t sequence{};
+            {
+                std::lock_guard lock{ _state->mutex };
+                auto& s = slot(kind);
+                sequence = ++s.sequence;
+                const auto now = Clock::now();
+                const bool canDeliver = s.window == Clock::duration{}
+                    || (!s.timerId && now - s.lastDelivery >= s.window);
+                if (!canDeliver)
+                {
+                    // Hold the latest event until the end of the window
+                    s.pending = std::move(deliver);
+                    s.pendingSequence = sequence;
+                    if (!s.timerId)
+                    {
+                        const auto generation = ++s.timerGeneration;
+                        s.timerId = Internal::TimerQueue::instance().schedule(
+                            s.lastDelivery + s.window - now,
+                            [weakState = std::weak_ptr<State>{ _state }, kind, generation]() { onWindowEnd(weakState, kind, generation); });
+                    }
+                    return;
+                }
+                s.lastDelivery = now;
+            }
+            deliverIfLatest(*_state, kind, sequence, deliver);
+        }
+
+        /**
+         * @brief Delivers an event immediately and drops the held event of the same kind, if any.
+         * @param kind The kind of event.
+         * @param deliver Delivers the event.
+         */
+        void notifyNow(PixelEventKind kind, std::function<void()> deliver)
+        {
+            uint64_t sequence{};
+            {
+                std::lock_guard lock{ _state->mutex };
+                auto& s = slot(kind);
+                sequence = ++s.sequence;
+                takePending(s);
+                s.lastDelivery = Clock::now();
+            }
+            deliverIfLatest(*_state, kind, sequence, deliver);
+        }
+
+    private:
+        Slot& slot(PixelEventKind kind) const
+        {
+            return _state->slots[static_cast<size_t>(kind)];
+        }
+
+        static std::function<void()> takePending(Slot& slot)
+        {
+            if (slot.timerId)
+            {
+                Internal::TimerQueue::instance().cancel(slot.timerId);
+                slot.timerId = {};
+            }
+            auto pending = std::move(slot.pending);
+            slot.pending = nullptr;
+            return pending;
+        }
+
+        // Delivers the event unless a newer event of the same kind was notified since,
+        // deliveries of a kind are serialized so a newer event is never delivered first
+        static void deliverIfLatest(State& state, PixelEventKind kind, uint64_t sequence, const std::function<void()>& deliver)
+        {
+            auto& s = state.slots[static_cast<size_t>(kind)];
+            std::lock_guard deliveryLock{ s.delivery };
+            {
+                std::lock_guard lock{ state.mutex };
+                if (s.sequence != sequence)
+                {
+                    return;
+                }
+            }
+            deliver();
+        }
+
+        static void onWindowEnd(const std::weak_ptr<State>& weakState, PixelEventKind kind, uint64_t generation)
+        {
+            std::function<void()> pending{};
+            uint64_t sequence{};
+            if (auto state = weakState.lock())
+            {
+                std::lock_guard lock{ state->mutex };
+                auto& s = state->slots[static_cast<size_t>(kind)];
+                if (s.timerGeneration != generation)
+                {
+                    // This timer was canceled while it was about to run
+                    return;
+                }
+                s.timerId = {};
+                sequence = s.pendingSequence;
+                pending = std::move(s.pending);
+                s.pending = nullptr;
+                if (pending)
+                {
+                    s.lastDelivery = Clock::now();
+                }
+            }
+            if (pending)
+            {
+                // Don't hold up the other timers while delivering
+                deliverExpiredAsync(weakState, kind, sequence, std::move(pending));
+            }
+        }
+
+        static Internal::DetachedTask deliverExpiredAsync(std::weak_ptr<State> weakState, PixelEventKind kind, uint64_t sequence, std::function<void()> pending)
+        {
+            co_await Internal::resumeBackground();
+            if (auto state = weakState.lock())
+            {
+                deliverIfLatest(*state, kind, sequence, pending);
+            }
+        }
+    };
+}
@@ -0,0 +1,220 @@
+/**
+ * @file
+ * @brief Definition of the MessageFramer class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+#include "Systemic/Internal/ByteSpan.h"
+
+namespace Systemic::Pixels
+{
+    /**
+     * @brief Fits Pixel messages in BLE packets sized for the connection MTU.
+     *
+     * A Pixel message is normally sent as is, one message per write or notification.
+     * When framing is supported on both sides, a packet starting with frameMarker
+     * (which is not a valid message type) is a frame of one of the following kinds:
+     * - Packed: several small messages, each prefixed with its size on one byte.
+     * - Fragment: a part of a message that is too large for a single packet,
+     *   along with the fragment index and the number of fragments.
+     *
+     * The static functions build the frames to write, an instance reassembles
+     * the received frames, it must be used by a single thread at a time.
+     */
+    class MessageFramer
+    {
+        std::vector<uint8_t> _buffer{};
+        uint8_t _nextIndex{};
+        uint8_t _fragmentCount{};
+
+    public:
+        /// First byte of a frame.
+        static constexpr uint8_t frameMarker = 0xFF;
+
+        /// Kind of frame, second byte of a frame.
+        enum class FrameKind : uint8_t
+        {
+            /// Several complete messages.
+            Packed = 1,
+
+            /// A fragment of a large message.
+            Fragment = 2,
+        };
+
+        /// Size of the header of a packed frame: marker and kind.
+        static constexpr size_t packedHeaderSize = 2;
+
+        /// Size of the header of a fragment: marker, kind, index and count.
+        static constexpr size_t fragmentHeaderSize = 4;
+
+        /// Maximum size of a message that may be packed.
+        static constexpr size_t maxPackedMessageSize = 0xFF;
+
+        /// Size of the ATT header of a write or notification.
+        static constexpr size_t attHeaderSize = 3;
+
+        /// The default BLE MTU, valid for any connection.
+        static constexpr uint16_t defaultMtu = 23;
+
+        /**
+         * @brief Gets the maximum amount of data that fits in a single write or notification.
+         * @param mtu The connection MTU, the default MTU is used if zero or lower.
+         * @return The maximum packet size.
+         */
+        static size_t maxPacketSize(uint16_t mtu)
+        {
+            return std::max(mtu, defaultMtu) - attHeaderSize;
+        }
+
+        /**
+         * @brief Indicates whether a packet is a frame rather than a single message.
+         * @param packet The packet data.
+         * @return Whether the packet is a frame.
+         */
+        static bool isFrame(ByteSpan packet)
+        {
+            return packet.size() >= packedHeaderSize && packet[0] == frameMarker;
+        }
+
+        /**
+         * @brief Splits a message into fragments fitting in the given packet size.
+         * @param message The serialized message.
+         * @param packetSize The maximum packet size, see maxPacketSize().
+         * @return The fragments to write in order, empty if the message is too large
+         *         to be fragmented (more than 255 fragments).
+         */
+        static std::vector<std::vector<uint8_t>> fragment(ByteSpan message, size_t packetSize)
+        {
+            std::vector<std::vector<uint8_t>> fragments{};
+            if (packetSize <= fragmentHeaderSize)
+            {
+                return fragments;
+            }
+
+            const size_t dataSize = packetSize - fragmentHeaderSize;
+            const size_t count = (message.size() + dataSize - 1) / dataSize;
+            if (count == 0 || count > 0xFF)
+            {
+                return fragments;
+            }
+
+            fragments.reserve(count);
+            for (size_t i = 0; i < count; ++i)
+            {
+                const size_t offset = i * dataSize;
+                const size_t size = std::min(dataSize, message.size() - offset);
+                auto& fragment = fragments.emplace_back();
+                fragment.reserve(fragmentHeaderSize + size);
+                fragment.push_back(frameMarker);
+                fragment.push_back(static_cast<uint8_t>(FrameKind::Fragment));
+                fragment.push_back(static_cast<uint8_t>(i));
+                fragment.push_back(static_cast<uint8_t>(count));
+                fragment.insert(fragment.end(), message.begin() + offset, message.begin() + offset + size);
+            }
+            return fragments;
+        }
+
+        /**
+         * @brief Indicates whether a message may be appended to a packed frame.
+         * @param frameSize The current size of the frame, zero if not started yet.
+         * @param messageSize The size of the message to append.
+         * @param packetSize The maximum packet size, see maxPacketSize().
+         * @return Whether the message fits in the frame.
+         */
+        static bool canPack(size_t frameSize, size_t messageSize, size_t packetSize)
+        {
+            const size_t size = std::max(frameSize, packedHeaderSize) + 1 + messageSize;
+            return messageSize > 0 && messageSize <= maxPackedMessageSize && size <= packetSize;
+        }
+
+        /**
+         * @brief Appends a message to a packed frame, check that it fits with canPack() first.
+         * @param frame The frame, the header is added if empty.
+         * @param message The serialized message.
+         */
+        static void pack(std::vector<uint8_t>& frame, ByteSpan message)
+        {
+            if (frame.empty())
+            {
+                frame.push_back(frameMarker);
+                frame.push_back(static_cast<uint8_t>(FrameKind::Packed));
+            }
+            frame.push_back(static_cast<uint8_t>(message.size()));
+            frame.insert(frame.end(), message.begin(), message.end());
+        }
+
+        /**
+         * @brief Processes a received packet and calls the given function with each
+         *        complete message it contains or completes.
+         *
+         * A packet that is not a frame is a message on its own. A fragment that doesn't
+         * follow the previous one drops the message being reassembled.
+         * @param packet The packet data.
+         * @param onMessage Called with the data of each complete message.
+         */
+        template <typename F>
+        void receive(ByteSpan packet, F&& onMessage)
+        {
+            if (!isFrame(packet))
+            {
+                onMessage(packet);
+                return;
+            }
+
+            switch (static_cast<FrameKind>(packet[1]))
+            {
+            case FrameKind::Packed:
+            {
+                size_t offset = packedHeaderSize;
+                while (offset < packet.size())
+                {
+                    const size_t size = packet[offset++];
+                    if (size == 0 || offset + size > packet.size())
+                    {
+                        // Malformed frame
+                        break;
+                    }
+                    onMessage(packet.subspan(offset, size));
+                    offset += size;
+                }
+                break;
+            }
+            case FrameKind::Fragment:
+            {
+                if (packet.size() <= fragmentHeaderSize)
+                {
+                    break;
+                }
+                const uint8_t index = packet[2];
+                const uint8_t count = packet[3];
+                if (index == 0)
+                {
+                    _buffer.clear();
+                    _fragmentCount = count;
+                    _nextIndex = 0;
+                }
+                if (index != _nextIndex || count != _fragmentCount)
+                {
+                    // Missed a fragment
+                    _buffer.clear();
+                    _nextIndex = _fragmentCount = 0;
+                    break;
+                }
+
+                _buffer.insert(_buffer.end(), packet.begin() + fragmentHeaderSize, packet.end());
+                if (++_nextIndex == _fragmentCount)
+                {
+                    onMessage(ByteSpan{ _buffer.data(), _buffer.size() });
+                    _buffer.clear();
+                    _nextIndex = _fragmentCount = 0;
+                }
+                break;
+            }
+            }
+        }
+    };
+}
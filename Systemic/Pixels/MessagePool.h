@@ -0,0 +1,216 @@
+/**
+ * @file
+ * @brief Definition of the MessagePool class and its allocator.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <new>
+#include <cstddef>
+#include <cstdint>
+
+namespace Systemic::Pixels::Messages
+{
+    /// Allocation counters of a MessagePool.
+    struct MessagePoolStats
+    {
+        /// Number of allocations served by the pool.
+        std::uint64_t poolAllocations{};
+
+        /// Number of allocations that fell back to the heap (pool exhausted or oversized request).
+        std::uint64_t heapAllocations{};
+
+        /// Number of deallocations (pooled or not).
+        std::uint64_t deallocations{};
+
+        /// Number of pool blocks currently in use.
+        std::size_t blocksInUse{};
+    };
+
+    /**
+     * @brief A lock-free pool of fixed size memory blocks used to allocate the messages
+     *        received from Pixels dice.
+     *
+     * All the blocks are allocated once, when the pool is first used. Freed blocks are put back
+     * in a lock-free list and recycled by the next allocation. When the pool is exhausted,
+     * or when an allocation is larger than a block, memory is taken from the heap instead.
+     *
+     * Use the stats() method to check that the pool is correctly sized, e.g. that the
+     * heap allocations counter stops increasing once messages are flowing.
+     *
+     * This class is thread safe.
+     */
+    class MessagePool
+    {
+    public:
+        /// Size in bytes of a block, large enough for any message plus a shared_ptr control block
+        /// (checked against the registered messages in MessageSerialization.h).
+        static constexpr std::size_t blockSize = 160;
+
+        /// Upper bound of the size that std::allocate_shared() adds to an object for its control block:
+        /// a vtable pointer and two reference counts, padded to the maximum alignment.
+        static constexpr std::size_t controlBlockOverhead = 2 * alignof(std::max_align_t);
+
+        /// Number of blocks in the pool.
+        static constexpr std::uint32_t blockCount = 512;
+
+    private:
+        static constexpr std::uint32_t nil = blockCount;
+
+        struct alignas(std::max_align_t) Block
+        {
+            unsigned char bytes[blockSize];
+        };
+
+        // Blocks storage and free list links (kept outside of the blocks so they may always be read safely)
+        const std::unique_ptr<Block[]> _blocks;
+        const std::unique_ptr<std::atomic<std::uint32_t>[]> _next;
+
+        // Head of the free list, the upper 32 bits are a tag incremented on each change to prevent ABA issues
+        std::atomic<std::uint64_t> _head{};
+
+        // Counters
+        std::atomic<std::uint64_t> _poolAllocations{};
+        std::atomic<std::uint64_t> _heapAllocations{};
+        std::atomic<std::uint64_t> _deallocations{};
+        std::atomic<std::size_t> _blocksInUse{};
+
+        MessagePool()
+            : _blocks{ new Block[blockCount] }, _next{ new std::atomic<std::uint32_t>[blockCount] }
+        {
+            for (std::uint32_t i = 0; i < blockCount; ++i)
+            {
+                _next[i].store(i + 1, std::memory_order_relaxed);
+            }
+            _head.store(0, std::memory_order_release);
+        }
+
+    public:
+        MessagePool(const MessagePool&) = delete;
+        MessagePool& operator=(const MessagePool&) = delete;
+
+        /**
+         * @brief Gets the pool shared by all Pixel instances.
+         * @return The global message pool.
+         * @note The instance is never destroyed so messages may safely be released
+         *       at any time, including during program exit.
+         */
+        static MessagePool& instance()
+        {
+            static MessagePool* pool = new MessagePool{};
+            return *pool;
+        }
+
+        /**
+         * @brief Allocates memory, from the pool if possible.
+         * @param size Number of bytes to allocate.
+         * @return Pointer to the allocated memory.
+         */
+        void* allocate(std::size_t size)
+        {
+            if (size <= blockSize)
+            {
+                auto head = _head.load(std::memory_order_acquire);
+                while (static_cast<std::uint32_t>(head) != nil)
+                {
+                    const auto index = static_cast<std::uint32_t>(head);
+                    const auto next = _next[index].load(std::memory_order_relaxed);
+                    const auto newHead = ((head >> 32) + 1) << 32 | next;
+                    if (_head.compare_exchange_weak(head, newHead, std::memory_order_acq_rel, std::memory_order_acquire))
+                    {
+                        _poolAllocations.fetch_add(1, std::memory_order_relaxed);
+                        _blocksInUse.fetch_add(1, std::memory_order_relaxed);
+                        return _blocks[index].bytes;
+                    }
+                }
+            }
+
+            _heapAllocations.fetch_add(1, std::memory_order_relaxed);
+            return ::operator new(size);
+        }
+
+        /**
+         * @brief Releases memory returned by allocate().
+         * @param ptr Pointer to the memory to release.
+         */
+        void deallocate(void* ptr)
+        {
+            _deallocations.fetch_add(1, std::memory_order_relaxed);
+
+            const auto block = static_cast<Block*>(ptr);
+            if (block >= _blocks.get() && block < _blocks.get() + blockCount)
+            {
+                const auto index = static_cast<std::uint32_t>(block - _blocks.get());
+                auto head = _head.load(std::memory_order_relaxed);
+                std::uint64_t newHead;
+                do
+                {
+                    _next[index].store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+                    newHead = ((head >> 32) + 1) << 32 | index;
+                } while (!_head.compare_exchange_weak(head, newHead, std::memory_order_release, std::memory_order_relaxed));
+
+                _blocksInUse.fetch_sub(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                ::operator delete(ptr);
+            }
+        }
+
+        /**
+         * @brief Gets a snapshot of the allocation counters.
+         * @return The allocation counters.
+         */
+        MessagePoolStats stats() const
+        {
+            MessagePoolStats stats{};
+            stats.poolAllocations = _poolAllocations.load(std::memory_order_relaxed);
+            stats.heapAllocations = _heapAllocations.load(std::memory_order_relaxed);
+            stats.deallocations = _deallocations.load(std::memory_order_relaxed);
+            stats.blocksInUse = _blocksInUse.load(std::memory_order_relaxed);
+            return stats;
+        }
+    };
+
+    /**
+     * @brief Stateless allocator taking its memory from the global MessagePool instance.
+     *
+     * Meant to be used with std::allocate_shared() to create messages.
+     * @tparam T The type of object to allocate.
+     */
+    template <typename T>
+    struct MessagePoolAllocator
+    {
+        /// The type of object to allocate.
+        using value_type = T;
+
+        /// Initializes a new allocator.
+        MessagePoolAllocator() noexcept = default;
+
+        /// Initializes a new allocator from an allocator of another type.
+        template <typename U>
+        MessagePoolAllocator(const MessagePoolAllocator<U>&) noexcept {}
+
+        /// Allocates memory for n objects of type T.
+        T* allocate(std::size_t n)
+        {
+            return static_cast<T*>(MessagePool::instance().allocate(n * sizeof(T)));
+        }
+
+        /// Releases memory returned by allocate().
+        void deallocate(T* ptr, std::size_t /*n*/) noexcept
+        {
+            MessagePool::instance().deallocate(ptr);
+        }
+
+        /// All instances are interchangeable.
+        template <typename U>
+        bool operator==(const MessagePoolAllocator<U>&) const noexcept { return true; }
+
+        /// All instances are interchangeable.
+        template <typename U>
+        bool operator!=(const MessagePoolAllocator<U>&) const noexcept { return false; }
+    };
+}
@@ -5,14 +5,181 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 #include <vector>
+#include <new>
+#include <cstring>
+#include <utility> // index_sequence
 #include <type_traits>
 
+#include "Systemic/Internal/ByteSpan.h"
 #include "Messages.h"
+#include "MessagePool.h"
 
 namespace Systemic::Pixels::Messages::Serialization
 {
+    namespace Internal
+    {
+        // Gets the class listed in MessageClasses for the given message type, defaults to PixelMessage
+        template <MessageType Type, typename List>
+        struct MessageClassOf
+        {
+            using type = PixelMessage;
+        };
+
+        template <MessageType Type, typename T, typename... Ts>
+        struct MessageClassOf<Type, MessageClassList<T, Ts...>>
+        {
+            using type = std::conditional_t<T::messageType == Type, T,
+                typename MessageClassOf<Type, MessageClassList<Ts...>>::type>;
+        };
+
+        // Storage type for any of the listed message classes
+        template <typename List>
+        struct MessageStorageOf;
+
+        template <typename... Ts>
+        struct MessageStorageOf<MessageClassList<Ts...>>
+        {
+            using type = std::aligned_union_t<0, PixelMessage, Ts...>;
+        };
+
+        // Checks that the listed message classes can be registered
+        template <typename List>
+        struct AreValidMessageClasses;
+
+        template <typename... Ts>
+        struct AreValidMessageClasses<MessageClassList<Ts...>>
+        {
+            // Each class must be a byte packed PixelMessage with some data, and be the only one for its type
+            static constexpr bool value = (true && ... && (
+                std::is_base_of_v<PixelMessage, Ts> &&
+                alignof(Ts) == 1 &&
+                sizeof(Ts) > sizeof(PixelMessage) &&
+                static_cast<std::size_t>(Ts::messageType) < messageTypeCount &&
+                std::is_same_v<typename MessageClassOf<Ts::messageType, MessageClassList<Ts...>>::type, Ts>));
+        };
+
+        static_assert(AreValidMessageClasses<MessageClasses>::value,
+            "MessageClasses must list byte packed PixelMessage classes with a unique message type");
+    }
+
+    /**
+     * @brief Storage suitable for holding a copy of any message that can be deserialized
+     *        by deserializeMessage(ByteSpan, MessageStorage&).
+     *
+     * It's typically allocated on the stack so that messages can be decoded without
+     * any heap allocation.
+     */
+    using MessageStorage = typename Internal::MessageStorageOf<MessageClasses>::type;
+
+    static_assert(sizeof(MessageStorage) + MessagePool::controlBlockOverhead <= MessagePool::blockSize,
+        "MessagePool blocks are too small for the largest registered message and its shared_ptr control block");
+
+    /// Information about a message type, as stored in the messageRegistry table.
+    struct MessageTypeInfo
+    {
+        /// The message type.
+        MessageType type;
+
+        /// The message name.
+        const char* name;
+
+        /// Size in bytes of the serialized message, zero for an invalid type.
+        std::size_t size;
+
+        /// Decodes a message of this type into a newly allocated object (size must have been validated).
+        std::shared_ptr<const PixelMessage>(*decode)(ByteSpan data);
+
+        /// Decodes a message of this type into the given storage (size must have been validated).
+        const PixelMessage* (*decodeInto)(ByteSpan data, MessageStorage& storage);
+    };
+
+    namespace Internal
+    {
+        template <typename T>
+        std::shared_ptr<const PixelMessage> decodeMessage(ByteSpan data)
+        {
+            if constexpr (std::is_same_v<T, PixelMessage>)
+            {
+                return std::allocate_shared<PixelMessage>(MessagePoolAllocator<PixelMessage>{}, static_cast<MessageType>(data[0]));
+            }
+            else
+            {
+                auto msg = std::allocate_shared<T>(MessagePoolAllocator<T>{});
+                memcpy(msg.get(), data.data(), sizeof(T));
+                return msg;
+            }
+        }
+
+        template <typename T>
+        const PixelMessage* decodeMessageInto(ByteSpan data, MessageStorage& storage)
+        {
+            static_assert(sizeof(T) <= sizeof(MessageStorage));
+            if constexpr (std::is_same_v<T, PixelMessage>)
+            {
+                return new (&storage) PixelMessage{ static_cast<MessageType>(data[0]) };
+            }
+            else
+            {
+                auto msg = new (&storage) T{};
+                memcpy(msg, data.data(), sizeof(T));
+                return msg;
+            }
+        }
+
+        template <MessageType Type>
+        constexpr MessageTypeInfo makeMessageTypeInfo()
+        {
+            using T = typename MessageClassOf<Type, MessageClasses>::type;
+            const auto name = messageNames[static_cast<std::size_t>(Type)].name;
+            if constexpr (Type == MessageType::None)
+            {
+                return MessageTypeInfo{ Type, name, 0, nullptr, nullptr };
+            }
+            else
+            {
+                return MessageTypeInfo{ Type, name, sizeof(T), &decodeMessage<T>, &decodeMessageInto<T> };
+            }
+        }
+
+        template <std::size_t... Is>
+        constexpr std::array<MessageTypeInfo, sizeof...(Is)> makeMessageRegistry(std::index_sequence<Is...>)
+        {
+            return { { makeMessageTypeInfo<static_cast<MessageType>(Is)>()... } };
+        }
+    }
+
+    /**
+     * @brief Table of all the message types, indexed by MessageType.
+     *
+     * It is built at compile time from the MessageClasses list, messages without
+     * a dedicated class are registered as a PixelMessage with no data.
+     */
+    inline constexpr auto messageRegistry = Internal::makeMessageRegistry(std::make_index_sequence<messageTypeCount>{});
+
+    /**
+     * @brief Gets the registered information for a message type.
+     * @param type The message type.
+     * @return The message type information, or null for MessageType::None and unknown types.
+     */
+    inline const MessageTypeInfo* getMessageTypeInfo(MessageType type)
+    {
+        const auto index = static_cast<std::size_t>(type);
+        return (index < messageRegistry.size() && messageRegistry[index].size) ? &messageRegistry[index] : nullptr;
+    }
+
+    namespace Internal
+    {
+        // Returns the type information for the message stored in the data if it has the expected size
+        inline const MessageTypeInfo* validateMessage(ByteSpan data)
+        {
+            const MessageTypeInfo* info = data.empty() ? nullptr : getMessageTypeInfo(static_cast<MessageType>(data[0]));
+            return (info && info->size == data.size()) ? info : nullptr;
+        }
+    }
+
     /**
      * @brief Serialize a PixelMessage instance to binary data so it can be send to a Pixels die.
      * @tparam T The type of PixelMessage.
@@ -27,19 +194,85 @@ namespace Systemic::Pixels::Messages::Serialization
         memcpy(outData.data(), &message, sizeof(T));
     }
 
+    /**
+     * @brief Gets the type of the message stored in some binary data received from a Pixels die.
+     * @param data The binary data.
+     * @return The message type, or MessageType::None if the data is empty.
+     */
+    inline MessageType getMessageType(ByteSpan data)
+    {
+        return data.empty() ? MessageType::None : static_cast<MessageType>(data[0]);
+    }
+
+    /**
+     * @brief Gets a typed view on some binary data received from a Pixels die, without copying it.
+     * @tparam T The expected type of PixelMessage.
+     * @param data The binary data.
+     * @return A pointer to the message aliasing the given data, or null if the data
+     *         doesn't hold a message of the expected type.
+     * @note The returned pointer is only valid for as long as the viewed data.
+     *       Messages are byte packed so there is no alignment requirement.
+     */
+    template <typename T, std::enable_if_t<std::is_base_of_v<Systemic::Pixels::Messages::PixelMessage, T>, int> = 0>
+    inline const T* viewMessage(ByteSpan data)
+    {
+        static_assert(alignof(T) == 1, "Pixel messages must be byte packed");
+        if (data.size() == sizeof(T) && static_cast<MessageType>(data[0]) == T::messageType)
+        {
+            return reinterpret_cast<const T*>(data.data());
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Deserialize some binary data received from a Pixels die into a caller provided message.
+     * @tparam T The expected type of PixelMessage.
+     * @param data The binary data.
+     * @param outMessage The message to copy the data into, left untouched on failure.
+     * @return Whether the data was holding a message of the expected type.
+     */
+    template <typename T, std::enable_if_t<std::is_base_of_v<Systemic::Pixels::Messages::PixelMessage, T>, int> = 0>
+    inline bool deserializeMessage(ByteSpan data, T& outMessage)
+    {
+        if (data.size() == sizeof(T) && static_cast<MessageType>(data[0]) == outMessage.type)
+        {
+            memcpy(&outMessage, data.data(), data.size());
+            return true;
+        }
+        return false;
+    }
+
+    /**
+     * @brief Deserialize some binary data received from a Pixels die into the given storage.
+     *
+     * No memory is allocated, which makes this function suitable for processing
+     * messages as they are received.
+     *
+     * @param data The binary data.
+     * @param storage The storage in which the message is constructed.
+     * @return A pointer to the message stored in the given storage, or null if the data
+     *         isn't a valid message.
+     */
+    inline const PixelMessage* deserializeMessage(ByteSpan data, MessageStorage& storage)
+    {
+        const auto info = Internal::validateMessage(data);
+        return info ? info->decodeInto(data, storage) : nullptr;
+    }
+
     /**
      * @brief Deserialize some binary data received from a Pixels die to a PixelMessage.
      * @tparam T The expected type of PixelMessage.
      * @param data The binary data.
      * @return The PixelMessage deserialized from the given binary data.
      * @note It's usually best to call the non template overload.
+     *       The message is allocated from the global MessagePool.
      */
     template <typename T, std::enable_if_t<std::is_base_of_v<Systemic::Pixels::Messages::PixelMessage, T>, int> = 0>
-    inline std::shared_ptr<const T> deserializeMessage(const std::vector<uint8_t>& data)
+    inline std::shared_ptr<const T> deserializeMessage(ByteSpan data)
     {
         if (data.size() == sizeof(T))
         {
-            auto msg = std::shared_ptr<T>(new T{});
+            auto msg = std::allocate_shared<T>(MessagePoolAllocator<T>{});
             memcpy(msg.get(), data.data(), data.size());
             return msg;
         }
@@ -50,33 +283,12 @@ namespace Systemic::Pixels::Messages::Serialization
      * @brief Deserialize some binary data received from a Pixels die to a PixelMessage.
      * @param data The binary data.
      * @return The PixelMessage deserialized from the given binary data.
+     * @note The returned message is allocated from the global MessagePool,
+     *       see deserializeMessage(ByteSpan, MessageStorage&) for a non allocating version.
      */
-    inline std::shared_ptr<const PixelMessage> deserializeMessage(const std::vector<uint8_t>& data)
+    inline std::shared_ptr<const PixelMessage> deserializeMessage(ByteSpan data)
     {
-        if (!data.empty())
-        {
-            const auto type = static_cast<MessageType>(data[0]);
-            switch (type)
-            {
-            case MessageType::IAmADie:
-                return deserializeMessage<IAmADie>(data);
-            case MessageType::RollState:
-                return deserializeMessage<RollState>(data);
-            case MessageType::Blink:
-                return deserializeMessage<Blink>(data);
-            case MessageType::BatteryLevel:
-                return deserializeMessage<BatteryLevel>(data);
-            case MessageType::RequestRssi:
-                return deserializeMessage<RequestRssi>(data);
-            case MessageType::Rssi:
-                return deserializeMessage<Rssi>(data);
-            }
-
-            if (data.size() == 1 && type != MessageType::None)
-            {
-                return std::shared_ptr<PixelMessage>(new PixelMessage{ type });
-            }
-        }
-        return nullptr;
+        const auto info = Internal::validateMessage(data);
+        return info ? info->decode(data) : nullptr;
     }
 }
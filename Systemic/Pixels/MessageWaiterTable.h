@@ -0,0 +1,145 @@
+/**
+ * @file
+ * @brief Definition of the MessageWaiterTable class.
+ */
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Messages.h"
+
+namespace Systemic::Pixels
+{
+    /**
+     * @brief A table of callbacks waiting for Pixel messages, indexed by message type.
+     *
+     * Finding the callbacks for a received message is a direct lookup, and messages
+     * of a type that no one is waiting for cost a single check. Each type keeps
+     * an immutable list of callbacks that is replaced when a callback is added or removed,
+     * so notifying doesn't copy the list or hold a lock while running the callbacks.
+     *
+     * This class is thread safe.
+     */
+    class MessageWaiterTable
+    {
+    public:
+        /// Signature of a message callback.
+        using Callback = std::function<void(const std::shared_ptr<const Messages::PixelMessage>&)>;
+
+        /// Identifies a registered callback.
+        struct Token
+        {
+            /// The message type the callback is waiting for.
+            Messages::MessageType type{};
+
+            /// Unique id of the callback, zero for an invalid token.
+            uint64_t id{};
+        };
+
+    private:
+        struct Entry
+        {
+            uint64_t id{};
+            Callback callback{};
+        };
+        using EntryList = std::vector<Entry>;
+
+        std::array<std::shared_ptr<const EntryList>, Messages::messageTypeCount> _slots{};
+        uint64_t _lastId{};
+        mutable std::mutex _mutex{};
+
+    public:
+        /**
+         * @brief Registers a callback to be invoked for each received message of a given type.
+         * @param type The message type.
+         * @param callback The callback.
+         * @return The token to be used for removing the callback.
+         */
+        Token add(Messages::MessageType type, Callback callback)
+        {
+            const auto index = static_cast<size_t>(type);
+            if (index >= _slots.size() || !callback)
+            {
+                return Token{};
+            }
+
+            std::lock_guard lock{ _mutex };
+            auto entries = _slots[index] ? std::make_shared<EntryList>(*_slots[index]) : std::make_shared<EntryList>();
+            const auto id = ++_lastId;
+            entries->push_back(Entry{ id, std::move(callback) });
+            _slots[index] = std::move(entries);
+            return Token{ type, id };
+        }
+
+        /**
+         * @brief Unregisters a callback.
+         * @param token The token returned by add().
+         */
+        void remove(const Token& token)
+        {
+            const auto index = static_cast<size_t>(token.type);
+            if (index >= _slots.size() || !token.id)
+            {
+                return;
+            }
+
+            std::lock_guard lock{ _mutex };
+            if (const auto& current = _slots[index])
+            {
+                auto entries = std::make_shared<EntryList>();
+                entries->reserve(current->size());
+                for (const auto& entry : *current)
+                {
+                    if (entry.id != token.id)
+                    {
+                        entries->push_back(entry);
+                    }
+                }
+                _slots[index] = entries->empty() ? nullptr : std::move(entries);
+            }
+        }
+
+        /**
+         * @brief Indicates whether there is at least one callback for the given message type.
+         * @param type The message type.
+         * @return Whether a callback is waiting for this message type.
+         */
+        bool hasWaiters(Messages::MessageType type) const
+        {
+            const auto index = static_cast<size_t>(type);
+            std::lock_guard lock{ _mutex };
+            return index < _slots.size() && _slots[index];
+        }
+
+        /**
+         * @brief Invokes the callbacks registered for the type of the given message.
+         *
+         * The callbacks are run on the calling thread, they may add or remove callbacks.
+         * @param message The received message.
+         */
+        void notify(const std::shared_ptr<const Messages::PixelMessage>& message) const
+        {
+            const auto index = static_cast<size_t>(message->type);
+            std::shared_ptr<const EntryList> entries{};
+            {
+                std::lock_guard lock{ _mutex };
+                if (index < _slots.size())
+                {
+                    entries = _slots[index];
+                }
+            }
+            if (entries)
+            {
+                for (const auto& entry : *entries)
+                {
+                    entry.callback(message);
+                }
+            }
+        }
+    };
+}
@@ -6,6 +6,8 @@
 #pragma once
 
 #include <cstdint>
+#include <cstddef>
+#include <iterator> // size
 #include "PixelTypes.h"
 
 namespace Systemic::Pixels::Messages
@@ -143,8 +145,11 @@ namespace Systemic::Pixels::Messages
         /// The charging state of the battery.
         PixelBatteryState batteryState{};
 
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::IAmADie;
+
         /// Initializes a new instance of IAmADie.
-        IAmADie() : PixelMessage(MessageType::IAmADie) {}
+        IAmADie() : PixelMessage(messageType) {}
     };
 
     /// Message send by a Pixel to notify of its rolling state.
@@ -157,8 +162,209 @@ namespace Systemic::Pixels::Messages
         /// Index of the face facing up (if applicable).
         uint8_t faceIndex{};
 
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::RollState;
+
         /// Initializes a new instance of RollState.
-        RollState() : PixelMessage(MessageType::RollState) {}
+        RollState() : PixelMessage(messageType) {}
+    };
+
+    /// Message send by a Pixel to report its sensors and power measurements, see RequestTelemetry.
+    struct Telemetry
+        : public PixelMessage
+    {
+        // Accelerometer
+
+        /// Acceleration on the X axis, in thousandth of g.
+        int16_t accXTimes1000{};
+
+        /// Acceleration on the Y axis, in thousandth of g.
+        int16_t accYTimes1000{};
+
+        /// Acceleration on the Z axis, in thousandth of g.
+        int16_t accZTimes1000{};
+
+        /// Confidence in the face facing up, in thousandth.
+        int16_t faceConfidenceTimes1000{};
+
+        /// Time of the measurements, in milliseconds since the Pixel started.
+        uint32_t timeMs{};
+
+        /// Current roll state.
+        PixelRollState rollState{};
+
+        /// Index of the face facing up (if applicable).
+        uint8_t faceIndex{};
+
+        // Battery and power
+
+        /// The battery charge level in percent.
+        uint8_t batteryLevelPercent{};
+
+        /// The charging state of the battery.
+        PixelBatteryState batteryState{};
+
+        /// The battery voltage, in fiftieth of volt.
+        uint8_t voltageTimes50{};
+
+        /// The charging coil voltage, in fiftieth of volt.
+        uint8_t vCoilTimes50{};
+
+        // Signal
+
+        /// The RSSI value, in dBm.
+        int8_t rssi{};
+
+        /// The Bluetooth channel used for the connection.
+        uint8_t channelIndex{};
+
+        // Temperatures
+
+        /// The microcontroller temperature, in hundredth of degree Celsius.
+        int16_t mcuTemperatureTimes100{};
+
+        /// The battery temperature, in hundredth of degree Celsius.
+        int16_t batteryTemperatureTimes100{};
+
+        // Charger
+
+        /// Whether the battery charger is charging.
+        uint8_t internalChargeState{};
+
+        /// Whether charging was disabled.
+        uint8_t forceDisableChargingState{};
+
+        /// Current drawn by the LEDs, in milliamperes.
+        uint8_t ledCurrent{};
+
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::Telemetry;
+
+        /// Initializes a new instance of Telemetry.
+        Telemetry() : PixelMessage(messageType) {}
+    };
+
+    /// Message send to a Pixel to initiate a bulk data transfer.
+    struct BulkSetup
+        : public PixelMessage
+    {
+        /// Total size in bytes of the data to transfer.
+        uint16_t size{};
+
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::BulkSetup;
+
+        /// Initializes a new instance of BulkSetup.
+        BulkSetup() : PixelMessage(messageType) {}
+    };
+
+    /// Message send to a Pixel with a chunk of data of a bulk data transfer.
+    struct BulkData
+        : public PixelMessage
+    {
+        /// Maximum number of bytes of data carried by a single message.
+        static constexpr uint8_t maxDataSize = 100;
+
+        /// Number of bytes of the message before the data.
+        static constexpr size_t headerSize = 4;
+
+        /// Number of valid bytes in data.
+        uint8_t size{};
+
+        /// Offset of this chunk of data in the transferred data.
+        uint16_t offset{};
+
+        /// The chunk of data, only the first "size" bytes need to be send.
+        uint8_t data[maxDataSize]{};
+
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::BulkData;
+
+        /// Initializes a new instance of BulkData.
+        BulkData() : PixelMessage(messageType) {}
+    };
+
+    /// Message send by a Pixel to acknowledge the reception of a chunk of data of a bulk data transfer.
+    struct BulkDataAck
+        : public PixelMessage
+    {
+        /// Offset of the received chunk of data.
+        uint16_t offset{};
+
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::BulkDataAck;
+
+        /// Initializes a new instance of BulkDataAck.
+        BulkDataAck() : PixelMessage(messageType) {}
+    };
+
+    /**
+     * @brief Message send to a Pixel to start the transfer of an animation set.
+     *
+     * Once acknowledged, the animation set data is uploaded with a bulk data transfer
+     * and the Pixel sends a TransferAnimSetFinished message after storing it.
+     */
+    struct TransferAnimSet
+        : public PixelMessage
+    {
+        /// Size in bytes of the color palette.
+        uint16_t paletteSize{};
+
+        /// Number of RGB key frames.
+        uint16_t rgbKeyFrameCount{};
+
+        /// Number of RGB tracks.
+        uint16_t rgbTrackCount{};
+
+        /// Number of key frames.
+        uint16_t keyFrameCount{};
+
+        /// Number of tracks.
+        uint16_t trackCount{};
+
+        /// Number of animations.
+        uint16_t animationCount{};
+
+        /// Total size in bytes of the animations.
+        uint16_t animationSize{};
+
+        /// Number of conditions.
+        uint16_t conditionCount{};
+
+        /// Total size in bytes of the conditions.
+        uint16_t conditionSize{};
+
+        /// Number of actions.
+        uint16_t actionCount{};
+
+        /// Total size in bytes of the actions.
+        uint16_t actionSize{};
+
+        /// Number of rules.
+        uint16_t ruleCount{};
+
+        /// Brightness applied to the animations.
+        uint8_t brightness{};
+
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::TransferAnimSet;
+
+        /// Initializes a new instance of TransferAnimSet.
+        TransferAnimSet() : PixelMessage(messageType) {}
+    };
+
+    /// Message send by a Pixel in response to a TransferAnimSet message.
+    struct TransferAnimSetAck
+        : public PixelMessage
+    {
+        /// Whether the Pixel accepted the transfer, zero if it doesn't have enough memory.
+        uint8_t result{};
+
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::TransferAnimSetAck;
+
+        /// Initializes a new instance of TransferAnimSetAck.
+        TransferAnimSetAck() : PixelMessage(messageType) {}
     };
 
     /// Message send to a Pixel to have it blink its LEDs.
@@ -183,8 +389,11 @@ namespace Systemic::Pixels::Messages
         /// Whether to indefinitely loop the animation.
         uint8_t loop{};
 
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::Blink;
+
         /// Initializes a new instance of Blink.
-        Blink() : PixelMessage(MessageType::Blink) {}
+        Blink() : PixelMessage(messageType) {}
     };
 
     /// Message send by a Pixel to notify of its battery level and state.
@@ -197,8 +406,11 @@ namespace Systemic::Pixels::Messages
         /// The charging state of the battery.
         PixelBatteryState state{};
 
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::BatteryLevel;
+
         /// Initializes a new instance of BatteryLevel.
-        BatteryLevel() : PixelMessage(MessageType::BatteryLevel) {}
+        BatteryLevel() : PixelMessage(messageType) {}
     };
 
     /// Available modes for telemetry requests.
@@ -224,8 +436,11 @@ namespace Systemic::Pixels::Messages
         /// Minimum interval in milliseconds between two updates (0 for no cap on rate).
         uint16_t minInterval{};
 
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::RequestRssi;
+
         /// Initializes a new instance of RequestRssi.
-        RequestRssi() : PixelMessage(MessageType::RequestRssi) {}
+        RequestRssi() : PixelMessage(messageType) {}
     };
 
     /// Message send by a Pixel to notify of its measured RSSI.
@@ -235,12 +450,149 @@ namespace Systemic::Pixels::Messages
         /// The RSSI value, in dBm.
         int8_t value{};
 
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::Rssi;
+
         /// Initializes a new instance of Rssi.
-        Rssi() : PixelMessage(MessageType::Rssi) {}
+        Rssi() : PixelMessage(messageType) {}
+    };
+
+    /// Message send by a Pixel to notify of its internal temperatures.
+    struct Temperature
+        : public PixelMessage
+    {
+        /// The microcontroller temperature, in hundredth of degree Celsius.
+        int16_t mcuTemperatureTimes100{};
+
+        /// The battery temperature, in hundredth of degree Celsius.
+        int16_t batteryTemperatureTimes100{};
+
+        /// The message type of this class.
+        static constexpr MessageType messageType = MessageType::Temperature;
+
+        /// Initializes a new instance of Temperature.
+        Temperature() : PixelMessage(messageType) {}
     };
 
 #pragma pack(pop)
 
+    /// A compile time list of message classes.
+    template <typename... Ts>
+    struct MessageClassList {};
+
+    /**
+     * @brief The list of all the message classes defined above.
+     *
+     * Messages in this list are automatically decoded by the serialization functions,
+     * any other message type is decoded as a PixelMessage if it has no data.
+     * A new message class only needs to be added here.
+     */
+    using MessageClasses = MessageClassList<IAmADie, RollState, Telemetry, BulkSetup, BulkData, BulkDataAck, TransferAnimSet, TransferAnimSetAck, Blink, BatteryLevel, RequestRssi, Rssi, Temperature>;
+
+    /// Number of values in the MessageType enumeration.
+    constexpr std::size_t messageTypeCount = static_cast<std::size_t>(MessageType::BlinkIdAck) + 1;
+
+    /// A message type with its name, see messageNames.
+    struct MessageTypeName
+    {
+        /// The message type.
+        MessageType type;
+
+        /// The name of the message type.
+        const char* name;
+    };
+
+    /// Names of the Pixel messages, indexed by MessageType.
+    constexpr MessageTypeName messageNames[] =
+    {
+        { MessageType::None, "None" },
+        { MessageType::WhoAreYou, "WhoAreYou" },
+        { MessageType::IAmADie, "IAmADie" },
+        { MessageType::RollState, "RollState" },
+        { MessageType::Telemetry, "Telemetry" },
+        { MessageType::BulkSetup, "BulkSetup" },
+        { MessageType::BulkSetupAck, "BulkSetupAck" },
+        { MessageType::BulkData, "BulkData" },
+        { MessageType::BulkDataAck, "BulkDataAck" },
+        { MessageType::TransferAnimSet, "TransferAnimSet" },
+        { MessageType::TransferAnimSetAck, "TransferAnimSetAck" },
+        { MessageType::TransferAnimSetFinished, "TransferAnimSetFinished" },
+        { MessageType::TransferSettings, "TransferSettings" },
+        { MessageType::TransferSettingsAck, "TransferSettingsAck" },
+        { MessageType::TransferSettingsFinished, "TransferSettingsFinished" },
+        { MessageType::TransferTestAnimSet, "TransferTestAnimSet" },
+        { MessageType::TransferTestAnimSetAck, "TransferTestAnimSetAck" },
+        { MessageType::TransferTestAnimSetFinished, "TransferTestAnimSetFinished" },
+        { MessageType::DebugLog, "DebugLog" },
+        { MessageType::PlayAnim, "PlayAnim" },
+        { MessageType::PlayAnimEvent, "PlayAnimEvent" },
+        { MessageType::StopAnim, "StopAnim" },
+        { MessageType::RemoteAction, "RemoteAction" },
+        { MessageType::RequestRollState, "RequestRollState" },
+        { MessageType::RequestAnimSet, "RequestAnimSet" },
+        { MessageType::RequestSettings, "RequestSettings" },
+        { MessageType::RequestTelemetry, "RequestTelemetry" },
+        { MessageType::ProgramDefaultAnimSet, "ProgramDefaultAnimSet" },
+        { MessageType::ProgramDefaultAnimSetFinished, "ProgramDefaultAnimSetFinished" },
+        { MessageType::Blink, "Blink" },
+        { MessageType::BlinkAck, "BlinkAck" },
+        { MessageType::RequestDefaultAnimSetColor, "RequestDefaultAnimSetColor" },
+        { MessageType::DefaultAnimSetColor, "DefaultAnimSetColor" },
+        { MessageType::RequestBatteryLevel, "RequestBatteryLevel" },
+        { MessageType::BatteryLevel, "BatteryLevel" },
+        { MessageType::RequestRssi, "RequestRssi" },
+        { MessageType::Rssi, "Rssi" },
+        { MessageType::Calibrate, "Calibrate" },
+        { MessageType::CalibrateFace, "CalibrateFace" },
+        { MessageType::NotifyUser, "NotifyUser" },
+        { MessageType::NotifyUserAck, "NotifyUserAck" },
+        { MessageType::TestHardware, "TestHardware" },
+        { MessageType::TestLedLoopback, "TestLedLoopback" },
+        { MessageType::LedLoopback, "LedLoopback" },
+        { MessageType::SetTopLevelState, "SetTopLevelState" },
+        { MessageType::ProgramDefaultParameters, "ProgramDefaultParameters" },
+        { MessageType::ProgramDefaultParametersFinished, "ProgramDefaultParametersFinished" },
+        { MessageType::SetDesignAndColor, "SetDesignAndColor" },
+        { MessageType::SetDesignAndColorAck, "SetDesignAndColorAck" },
+        { MessageType::SetCurrentBehavior, "SetCurrentBehavior" },
+        { MessageType::SetCurrentBehaviorAck, "SetCurrentBehaviorAck" },
+        { MessageType::SetName, "SetName" },
+        { MessageType::SetNameAck, "SetNameAck" },
+        { MessageType::Sleep, "Sleep" },
+        { MessageType::ExitValidation, "ExitValidation" },
+        { MessageType::TransferInstantAnimSet, "TransferInstantAnimSet" },
+        { MessageType::TransferInstantAnimSetAck, "TransferInstantAnimSetAck" },
+        { MessageType::TransferInstantAnimSetFinished, "TransferInstantAnimSetFinished" },
+        { MessageType::PlayInstantAnim, "PlayInstantAnim" },
+        { MessageType::StopAllAnims, "StopAllAnims" },
+        { MessageType::RequestTemperature, "RequestTemperature" },
+        { MessageType::Temperature, "Temperature" },
+        { MessageType::EnableCharging, "EnableCharging" },
+        { MessageType::DisableCharging, "DisableCharging" },
+        { MessageType::Discharge, "Discharge" },
+        { MessageType::BlinkId, "BlinkId" },
+        { MessageType::BlinkIdAck, "BlinkIdAck" },
+    };
+
+    namespace Internal
+    {
+        // Checks that each entry of messageNames is stored at the index of its message type
+        constexpr bool areMessageNamesIndexedByType()
+        {
+            for (std::size_t i = 0; i < std::size(messageNames); ++i)
+            {
+                if (static_cast<std::size_t>(messageNames[i].type) != i)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    static_assert(std::size(messageNames) == messageTypeCount, "A message type is missing a name");
+    static_assert(Internal::areMessageNamesIndexedByType(), "messageNames must be in the same order as MessageType");
+
     /**
      * @brief Returns the name of a Pixel message.
      * @param type The message type to get the name for.
@@ -248,143 +600,7 @@ namespace Systemic::Pixels::Messages
     */
     inline const char* getMessageName(MessageType type)
     {
-        switch (type)
-        {
-        case MessageType::None:
-            return "None";
-        case MessageType::WhoAreYou:
-            return "WhoAreYou";
-        case MessageType::IAmADie:
-            return "IAmADie";
-        case MessageType::RollState:
-            return "RollState";
-        case MessageType::Telemetry:
-            return "Telemetry";
-        case MessageType::BulkSetup:
-            return "BulkSetup";
-        case MessageType::BulkSetupAck:
-            return "BulkSetupAck";
-        case MessageType::BulkData:
-            return "BulkData";
-        case MessageType::BulkDataAck:
-            return "BulkDataAck";
-        case MessageType::TransferAnimSet:
-            return "TransferAnimSet";
-        case MessageType::TransferAnimSetAck:
-            return "TransferAnimSetAck";
-        case MessageType::TransferAnimSetFinished:
-            return "TransferAnimSetFinished";
-        case MessageType::TransferSettings:
-            return "TransferSettings";
-        case MessageType::TransferSettingsAck:
-            return "TransferSettingsAck";
-        case MessageType::TransferSettingsFinished:
-            return "TransferSettingsFinished";
-        case MessageType::TransferTestAnimSet:
-            return "TransferTestAnimSet";
-        case MessageType::TransferTestAnimSetAck:
-            return "TransferTestAnimSetAck";
-        case MessageType::TransferTestAnimSetFinished:
-            return "TransferTestAnimSetFinished";
-        case MessageType::DebugLog:
-            return "DebugLog";
-        case MessageType::PlayAnim:
-            return "PlayAnim";
-        case MessageType::PlayAnimEvent:
-            return "PlayAnimEvent";
-        case MessageType::StopAnim:
-            return "StopAnim";
-        case MessageType::RemoteAction:
-            return "RemoteAction";
-        case MessageType::RequestRollState:
-            return "RequestRollState";
-        case MessageType::RequestAnimSet:
-            return "RequestAnimSet";
-        case MessageType::RequestSettings:
-            return "RequestSettings";
-        case MessageType::RequestTelemetry:
-            return "RequestTelemetry";
-        case MessageType::ProgramDefaultAnimSet:
-            return "ProgramDefaultAnimSet";
-        case MessageType::ProgramDefaultAnimSetFinished:
-            return "ProgramDefaultAnimSetFinished";
-        case MessageType::Blink:
-            return "Blink";
-        case MessageType::BlinkAck:
-            return "BlinkAck";
-        case MessageType::RequestDefaultAnimSetColor:
-            return "RequestDefaultAnimSetColor";
-        case MessageType::DefaultAnimSetColor:
-            return "DefaultAnimSetColor";
-        case MessageType::RequestBatteryLevel:
-            return "RequestBatteryLevel";
-        case MessageType::BatteryLevel:
-            return "BatteryLevel";
-        case MessageType::RequestRssi:
-            return "RequestRssi";
-        case MessageType::Rssi:
-            return "Rssi";
-        case MessageType::Calibrate:
-            return "Calibrate";
-        case MessageType::CalibrateFace:
-            return "CalibrateFace";
-        case MessageType::NotifyUser:
-            return "NotifyUser";
-        case MessageType::NotifyUserAck:
-            return "NotifyUserAck";
-        case MessageType::TestHardware:
-            return "TestHardware";
-        case MessageType::TestLedLoopback:
-            return "TestLedLoopback";
-        case MessageType::LedLoopback:
-            return "LedLoopback";
-        case MessageType::SetTopLevelState:
-            return "SetTopLevelState";
-        case MessageType::ProgramDefaultParameters:
-            return "ProgramDefaultParameters";
-        case MessageType::ProgramDefaultParametersFinished:
-            return "ProgramDefaultParametersFinished";
-        case MessageType::SetDesignAndColor:
-            return "SetDesignAndColor";
-        case MessageType::SetDesignAndColorAck:
-            return "SetDesignAndColorAck";
-        case MessageType::SetCurrentBehavior:
-            return "SetCurrentBehavior";
-        case MessageType::SetCurrentBehaviorAck:
-            return "SetCurrentBehaviorAck";
-        case MessageType::SetName:
-            return "SetName";
-        case MessageType::SetNameAck:
-            return "SetNameAck";
-        case MessageType::Sleep:
-            return "Sleep";
-        case MessageType::ExitValidation:
-            return "ExitValidation";
-        case MessageType::TransferInstantAnimSet:
-            return "TransferInstantAnimSet";
-        case MessageType::TransferInstantAnimSetAck:
-            return "TransferInstantAnimSetAck";
-        case MessageType::TransferInstantAnimSetFinished:
-            return "TransferInstantAnimSetFinished";
-        case MessageType::PlayInstantAnim:
-            return "PlayInstantAnim";
-        case MessageType::StopAllAnims:
-            return "StopAllAnims";
-        case MessageType::RequestTemperature:
-            return "RequestTemperature";
-        case MessageType::Temperature:
-            return "Temperature";
-        case MessageType::EnableCharging:
-            return "EnableCharging";
-        case MessageType::DisableCharging:
-            return "DisableCharging";
-        case MessageType::Discharge:
-            return "Discharge";
-        case MessageType::BlinkId:
-            return "BlinkId";
-        case MessageType::BlinkIdAck:
-            return "BlinkIdAck";
-        }
-        return "";
+        const auto index = static_cast<std::size_t>(type);
+        return index < messageTypeCount ? messageNames[index].name : "";
     }
 };
@@ -14,9 +14,21 @@
 #include <chrono>
 #include <mutex>
 #include <future>
+#include "Systemic/Internal/AwaitableResult.h"
 #include "Systemic/Internal/GuardedList.h"
+#include "Systemic/Internal/Seqlock.h"
+#include "Systemic/BluetoothLE/WriteFlowController.h"
 #include "ScannedPixel.h"
 #include "MessageSerialization.h"
+#include "BulkTransfer.h"
+#include "DataSetCache.h"
+#include "MessageWaiterTable.h"
+#include "RequestMultiplexer.h"
+#include "WriteScheduler.h"
+#include "MessageFramer.h"
+#include "EventCoalescer.h"
+#include "RollHistory.h"
+#include "RollStatistics.h"
 
 namespace Systemic::BluetoothLE
 {
@@ -36,7 +48,87 @@ namespace Systemic::Pixels
         Disconnecting,
     };
 
+    /**
+     * @brief A consistent copy of the state of a Pixel, see Pixel::snapshot().
+     *
+     * The Pixel name is not included as it never changes, see Pixel::name().
+     */
+    struct PixelSnapshot
+    {
+        /// The Bluetooth address for the Pixel.
+        bluetooth_address_t address{};
+
+        /// The unique Pixel id of the device.
+        pixel_id_t pixelId{};
+
+        /// The number of LEDs of the Pixel.
+        int ledCount{};
+
+        /// The Pixel design and color.
+        PixelDesignAndColor designAndColor{};
+
+        /// The firmware build date of the Pixel.
+        PixelInfo::Date firmwareDate{};
+
+        /// The last RSSI value measured by this Pixel.
+        int rssi{};
+
+        /// The Pixel battery level (percentage).
+        int batteryLevel{};
+
+        /// Whether the Pixel battery is charging or not.
+        bool isCharging{};
+
+        /// The Pixel roll state.
+        PixelRollState rollState{};
+
+        /// The Pixel face value that is currently facing up.
+        int currentFace{};
+
+        /// The hash of the data set stored on the Pixel.
+        uint32_t dataSetHash{};
+
+        /// The Pixel connection status.
+        PixelStatus status{};
+
+        /// Incremented each time the state changes.
+        uint32_t version{};
+    };
+
+    /// Durations of the stages of a connection attempt, see Pixel::lastConnectTimings().
+    struct PixelConnectTimings
+    {
+        /// Time taken to connect to the device and discover its services.
+        std::chrono::steady_clock::duration connect{};
+
+        /// Time taken to subscribe for notifications and identify the die.
+        std::chrono::steady_clock::duration identify{};
+
+        /// Total time of the connection attempt.
+        std::chrono::steady_clock::duration total{};
+    };
+
+    /// Statistics of the link losses of a Pixel connected with auto-reconnect, see Pixel::linkStats().
+    struct PixelLinkStats
+    {
+        /// Number of times the link was lost.
+        uint32_t linkLossCount{};
+
+        /// Number of times the link was restored and the die identified again.
+        uint32_t restoredCount{};
+
+        /// Duration of the last outage, from the link loss until the die was ready again.
+        std::chrono::steady_clock::duration lastOutage{};
+
+        /// Duration of the longest outage.
+        std::chrono::steady_clock::duration longestOutage{};
+
+        /// Total duration of the outages.
+        std::chrono::steady_clock::duration totalOutage{};
+    };
+
     class Pixel;
+    class PixelGroup;
 
 #pragma warning(push)
 #pragma warning(disable : 4100) // unreferenced formal parameter
@@ -68,6 +160,10 @@ namespace Systemic::Pixels
 
         /// Called when the Pixel instance received a message from the actual die.
         virtual void onMessageReceived(std::shared_ptr<Pixel> pixel, std::shared_ptr<const Messages::PixelMessage> message) {}
+
+        /// Called when a Pixel declared ready by fast identification turned out to be another die
+        /// (isMismatch is true) or didn't identify itself in time. The Pixel is then disconnected.
+        virtual void onFastIdentifyFailed(std::shared_ptr<Pixel> pixel, bool isMismatch) {}
     };
 
 #pragma warning(pop)
@@ -85,24 +181,55 @@ namespace Systemic::Pixels
     class Pixel : public std::enable_shared_from_this<Pixel>, public PixelInfo
     {
         using StatusCallback = std::function<void(PixelStatus)>;
-        using MessageCallback = std::function<void(std::shared_ptr<const Messages::PixelMessage>)>;
 
         // Constant data
         const std::shared_ptr<Systemic::BluetoothLE::Peripheral> _peripheral;
         const std::shared_ptr<PixelDelegate> _delegate;
 
+        // Name and advertisement time never change, the rest of the data is updated
+        // by the notification thread and read without locking by any thread
+        const std::wstring _name;
+        const std::chrono::steady_clock::time_point _advertisementTime;
+        Internal::Seqlock<PixelSnapshot> _snapshot;
+
         // Mutable data
-        ScannedPixelData _data;
         PixelStatus _status{};
         std::shared_ptr<Systemic::BluetoothLE::Characteristic> _notifyCharacteristic{};
         std::shared_ptr<Systemic::BluetoothLE::Characteristic> _writeCharacteristic{};
+        uint32_t _notifySubscription{};
+        std::chrono::steady_clock::time_point _linkLossTime{};
+        std::chrono::milliseconds _fastIdentifyMaxAge{};
+        bool _framingEnabled{};
+        std::vector<std::vector<uint8_t>> _activeTelemetryRequests{};
 
         // Mutex for modifying the above data
-        std::recursive_mutex _mutex{};
+        mutable std::recursive_mutex _mutex{};
 
-        // Internal lists of status and message notifications
+        // Internal list of status notifications and table of message notifications
         GuardedList<StatusCallback> _internalStatusCbs;
-        GuardedList<MessageCallback> _internalMsgCbs;
+        MessageWaiterTable _msgWaiters;
+
+        // Requests waiting for a response, and mutex for registering and sending them in the same order
+        RequestMultiplexer _requests;
+        std::mutex _requestsOrderMutex{};
+
+        // Messages waiting to be written, and reassembly of the received frames (notification thread only)
+        WriteScheduler _writeQueue;
+        MessageFramer _framer;
+
+        // Rate limiting of the delegate notifications
+        EventCoalescer _eventCoalescer;
+
+        // Durations of the last connection attempt and link losses statistics
+        Internal::Seqlock<PixelConnectTimings> _connectTimings;
+        Internal::Seqlock<PixelLinkStats> _linkStats;
+
+        // Roll state changes and statistics, written by the notification thread only
+        RollHistory _rollHistory;
+        RollStatistics _rollStatistics;
+
+        // Sends its commands without waiting on a std::future
+        friend class PixelGroup;
 
     public:
         /// List of possible Pixel connection results.
@@ -169,7 +296,7 @@ namespace Systemic::Pixels
          */
         PixelStatus status() const
         {
-            return _status;
+            return _snapshot.load().status;
         }
 
         /**
@@ -178,75 +305,281 @@ namespace Systemic::Pixels
          */
         bool isReady() const
         {
-            return _status == PixelStatus::Ready;
+            return status() == PixelStatus::Ready;
+        }
+
+        /**
+         * @brief Gets a consistent copy of the Pixel state.
+         *
+         * This doesn't take any lock and may be called at a high rate from any thread.
+         * Prefer it to the individual getters when reading several values.
+         * @return The Pixel state.
+         */
+        PixelSnapshot snapshot() const
+        {
+            return _snapshot.load();
         }
 
         virtual bluetooth_address_t systemId() const override
         {
-            return _data.address;
+            return _snapshot.load().address;
         }
 
         virtual bluetooth_address_t address() const override
         {
-            return _data.address;
+            return _snapshot.load().address;
         }
 
         virtual pixel_id_t pixelId() const override
         {
-            return _data.pixelId;
+            return _snapshot.load().pixelId;
         }
 
         virtual const std::wstring& name() const override
         {
-            return _data.name;
+            return _name;
         }
 
         virtual int ledCount() const override
         {
-            return _data.ledCount;
+            return _snapshot.load().ledCount;
         }
 
         virtual PixelDesignAndColor designAndColor() const override
         {
-            return _data.designAndColor;
+            return _snapshot.load().designAndColor;
         }
 
         virtual Date firmwareDate() const override
         {
-            return _data.firmwareDate;
+            return _snapshot.load().firmwareDate;
         }
 
         virtual int rssi() const override
         {
-            return _data.rssi;
+            return _snapshot.load().rssi;
         }
 
         virtual int batteryLevel() const override
         {
-            return _data.batteryLevel;
+            return _snapshot.load().batteryLevel;
         }
 
         virtual bool isCharging() const override
         {
-            return _data.isCharging;
+            return _snapshot.load().isCharging;
         }
 
         virtual PixelRollState rollState() const override
         {
-            return _data.rollState;
+            return _snapshot.load().rollState;
         }
 
         virtual int currentFace() const override
         {
-            return _data.currentFace;
+            return _snapshot.load().currentFace;
+        }
+
+        /**
+         * @brief Gets the hash of the data set (animations and profile) stored on the Pixel.
+         * @return The hash reported by the Pixel when it last identified itself, or zero.
+         */
+        uint32_t dataSetHash() const
+        {
+            return _snapshot.load().dataSetHash;
+        }
+
+        /**
+         * @brief Gets the maximum number of requests that may wait for a response at the same time.
+         * @return The maximum number of requests in flight.
+         */
+        size_t maxRequestsInFlight() const
+        {
+            return _requests.maxInFlight();
+        }
+
+        /**
+         * @brief Sets the maximum number of requests that may wait for a response at the same time.
+         *
+         * Extra requests are queued and sent as soon as earlier requests complete or time out.
+         * Responses of a same type are matched with the requests in the order they were sent.
+         * @param maxInFlight The maximum number of requests in flight, at least one.
+         */
+        void setMaxRequestsInFlight(size_t maxInFlight)
+        {
+            _requests.setMaxInFlight(maxInFlight);
+        }
+
+        /**
+         * @brief Gets the metrics of the queue of messages to write to the Pixel.
+         *
+         * Messages are written one at a time, by order of WritePriority.
+         * @return A snapshot of the write queue metrics.
+         */
+        WriteQueueStats writeQueueStats() const
+        {
+            return _writeQueue.stats();
+        }
+
+        /**
+         * @brief Gets the throughput and stall metrics of the messages written without acknowledgment.
+         *
+         * Those writes are pipelined, up to a number of writes in flight that is adapted
+         * to the observed latency and failures.
+         * @return A snapshot of the write flow metrics, empty if not connected yet.
+         */
+        Systemic::BluetoothLE::WriteFlowStats writeFlowStats() const;
+
+        /**
+         * @brief Gets the history of the roll state changes of the Pixel.
+         *
+         * The history keeps the most recent roll events received while connected.
+         * It may be queried from any thread without locking, see RollHistory::since()
+         * and RollHistory::last().
+         * @return The roll history.
+         */
+        const RollHistory& rollHistory() const
+        {
+            return _rollHistory;
+        }
+
+        /**
+         * @brief Gets the statistics of the faces rolled by the Pixel since it was last identified
+         *        with a different number of faces, or since resetRollStatistics() was called.
+         *
+         * This doesn't take any lock. Snapshots of several Pixels with the same number of faces
+         * may be combined with RollStatisticsSnapshot::merge().
+         * @return A snapshot of the roll statistics.
+         */
+        RollStatisticsSnapshot rollStatistics() const
+        {
+            return _rollStatistics.snapshot();
+        }
+
+        /// Clears the roll statistics.
+        void resetRollStatistics()
+        {
+            _rollStatistics.reset(_rollStatistics.snapshot().faceCount);
+        }
+
+        /**
+         * @brief Gets the minimum time between two delegate notifications of a given kind.
+         * @param kind The kind of event.
+         * @return The coalescing window, zero if events are notified immediately.
+         */
+        std::chrono::milliseconds coalescingWindow(PixelEventKind kind) const
+        {
+            return _eventCoalescer.window(kind);
+        }
+
+        /**
+         * @brief Sets the minimum time between two delegate notifications of a given kind.
+         *
+         * Within a window, only the latest value is notified, once the window ends.
+         * Those notifications are made from an internal timer thread.
+         * Rolls are never coalesced: PixelDelegate::onRolled() and the "on face" roll state
+         * are always notified immediately.
+         * @param kind The kind of event.
+         * @param window The coalescing window, zero to notify events immediately.
+         */
+        void setCoalescingWindow(PixelEventKind kind, std::chrono::milliseconds window)
+        {
+            _eventCoalescer.setWindow(kind, window);
         }
 
         /**
          * @brief Asynchronously tries to connect to the die.
+         *
+         * With auto-reconnect, the system keeps trying to restore the link after an unexpected
+         * disconnection. The Pixel status is then set to Connecting until the link is back,
+         * at which point the die is subscribed to and identified again, and the active
+         * telemetry requests (such as reportRssiAsync()) are sent again, without going through
+         * the services discovery. The outages are recorded, see linkStats().
+         * @param autoReconnect Whether to automatically reconnect after an unexpected disconnection.
          * @note The request times out after 7 to 20s if device is not reachable.
          * @return A future with the result of the operation.
          */
-        std::future<ConnectResult> connectAsync();
+        std::future<ConnectResult> connectAsync(bool autoReconnect = false);
+
+        /**
+         * @brief Same as connectAsync() but awaiting the result doesn't block a thread.
+         * @param autoReconnect Whether to automatically reconnect after an unexpected disconnection.
+         * @return The result of the operation, to be awaited once.
+         */
+        Systemic::Internal::AwaitableResult<ConnectResult> requestConnect(bool autoReconnect = false);
+
+        /**
+         * @brief Indicates whether messages are framed when written, see setFramingEnabled().
+         * @return Whether framing is enabled.
+         */
+        bool isFramingEnabled() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _framingEnabled;
+        }
+
+        /**
+         * @brief Enables framing of the written messages, see MessageFramer.
+         *
+         * With framing, messages too large for a single packet of the connection MTU
+         * are split in several writes, and queued small messages are packed in a single write.
+         * Only enable it for a firmware that supports framed messages.
+         * Without framing, a message too large for a single packet is written with a
+         * confirmation, so the BLE stack splits it with a long write.
+         *
+         * Framed notifications are always reassembled.
+         * @param enabled Whether to frame the written messages.
+         */
+        void setFramingEnabled(bool enabled)
+        {
+            std::lock_guard lock{ _mutex };
+            _framingEnabled = enabled;
+        }
+
+        /**
+         * @brief Gets the maximum age of the advertisement data for fast identification.
+         * @return The maximum age, zero if fast identification is disabled.
+         */
+        std::chrono::milliseconds fastIdentifyMaxAge() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _fastIdentifyMaxAge;
+        }
+
+        /**
+         * @brief Enables fast identification when connecting.
+         *
+         * By default the die is asked to identify itself before being declared ready,
+         * which takes a round trip. With fast identification, if the advertisement data
+         * this instance was created with isn't older than the given age, the die is trusted
+         * to be the advertised one and is declared ready as soon as it is subscribed to.
+         * It is still asked to identify itself in the background, and is disconnected
+         * with a call to PixelDelegate::onFastIdentifyFailed() if it doesn't match.
+         * @param maxAge The maximum age of the advertisement data, zero to disable fast identification.
+         */
+        void setFastIdentifyMaxAge(std::chrono::milliseconds maxAge)
+        {
+            std::lock_guard lock{ _mutex };
+            _fastIdentifyMaxAge = maxAge;
+        }
+
+        /**
+         * @brief Gets how long the stages of the last connection attempt took.
+         * @return The durations of the connection stages, zero for the stages that didn't run.
+         */
+        PixelConnectTimings lastConnectTimings() const
+        {
+            return _connectTimings.load();
+        }
+
+        /**
+         * @brief Gets the statistics of the link losses that occurred while connected with auto-reconnect.
+         * @return A copy of the statistics.
+         */
+        PixelLinkStats linkStats() const
+        {
+            return _linkStats.load();
+        }
 
         /**
          * @brief Immediately disconnects from the die.
@@ -262,7 +595,7 @@ namespace Systemic::Pixels
         std::future<bool> sendMessageAsync(Messages::MessageType type, bool withoutAck = false)
         {
             std::vector<uint8_t> data{ static_cast<uint8_t>(type) };
-            return sendMessageAsync(data, withoutAck);
+            return sendMessageAsync(std::move(data), withoutAck);
         }
 
         /**
@@ -277,7 +610,7 @@ namespace Systemic::Pixels
         {
             std::vector<uint8_t> data{};
             Messages::Serialization::serializeMessage(message, data);
-            return sendMessageAsync(data, withoutAck);
+            return sendMessageAsync(std::move(data), withoutAck);
         }
 
         /**
@@ -295,33 +628,29 @@ namespace Systemic::Pixels
             Messages::MessageType responseType,
             std::chrono::duration<Rep, Period> timeout = std::chrono::seconds(5))
         {
-            std::promise<std::shared_ptr<const Messages::PixelMessage>> responsePromise{};
-
-            MessageCallback callback{ [&responseType, &responsePromise](auto msg)
-                {
-                    if (msg->type == responseType)
-                    {
-                        responsePromise.set_value(msg);
-                    }
-                } };
-
-            const auto cbIndex = _internalMsgCbs.add(callback);
-
-            const auto sendResult = co_await sendMessageAsync(type);
-
-            std::shared_ptr<const Messages::PixelMessage> response{};
-            if (sendResult)
-            {
-                auto respFuture = responsePromise.get_future();
-                if (respFuture.wait_for(timeout) == std::future_status::ready)
-                {
-                    response = respFuture.get();
-                }
-            }
-
-            _internalMsgCbs.remove(cbIndex);
+            std::vector<uint8_t> data{ static_cast<uint8_t>(type) };
+            return sendAndWaitForResponseAsync(std::move(data), responseType, std::chrono::duration_cast<std::chrono::milliseconds>(timeout));
+        }
 
-            co_return response;
+        /**
+         * @brief Sends a message to the Pixel and wait for a specific reply.
+         * @tparam T Type of the message.
+         * @tparam Rep Duration arithmetic type representing the number of ticks.
+         * @tparam Period Duration type representing the tick period.
+         * @param message Message to send.
+         * @param responseType Type of the response to expect.
+         * @param timeout Timeout before aborting waiting for the response.
+         * @return A message object or nullptr in a shared pointer.
+         */
+        template <typename T, class Rep, class Period, std::enable_if_t<std::is_base_of_v<Messages::PixelMessage, T>, int> = 0>
+        std::future<std::shared_ptr<const Messages::PixelMessage>> sendAndWaitForResponseAsync(
+            const T& message,
+            Messages::MessageType responseType,
+            std::chrono::duration<Rep, Period> timeout)
+        {
+            std::vector<uint8_t> data{};
+            Messages::Serialization::serializeMessage(message, data);
+            return sendAndWaitForResponseAsync(std::move(data), responseType, std::chrono::duration_cast<std::chrono::milliseconds>(timeout));
         }
 
         /**
@@ -366,6 +695,34 @@ namespace Systemic::Pixels
             return reportRssiAsync(activate, std::chrono::seconds(5));
         }
 
+        /**
+         * @brief Uploads a data set to the Pixel, unless it already has it.
+         *
+         * The data set content is looked up in the given cache. If the Pixel reports
+         * the data set hash obtained the last time this same content was uploaded to a die,
+         * the transfer is skipped.
+         * Otherwise the Pixel is sent the animation set description and then the data
+         * using the bulk transfer protocol. The data is split in packets sized for the
+         * connection MTU and several packets are kept in flight at once, as set by the options.
+         * A packet that isn't acknowledged in time is sent again.
+         * Once uploaded, the data is stored in the cache along with the new data set hash
+         * reported by the Pixel.
+         *
+         * @param animSet The description of the animation set, sent to the Pixel before the data.
+         * @param data The data set content, up to 64KB.
+         * @param cache The cache of uploaded data sets, uses DataSetCache::shared() if null.
+         * @param options The transfer settings.
+         * @param onProgress Called each time packets are acknowledged, and once the transfer
+         *                   is over, with the transfer progress and throughput.
+         * @return A future with the result of the operation.
+         */
+        std::future<DataSetUploadResult> ensureDataSetAsync(
+            Messages::TransferAnimSet animSet,
+            std::vector<uint8_t> data,
+            std::shared_ptr<DataSetCache> cache = nullptr,
+            BulkTransferOptions options = {},
+            BulkTransferProgressListener onProgress = nullptr);
+
         /**
          * @brief Requests the Pixel to turn itself off.
          * @return A future with a boolean indicating whether the operation succeeded.
@@ -388,6 +745,95 @@ namespace Systemic::Pixels
             uint32_t rgbColor,
             int count = 1,
             float fade = 1)
+        {
+            // TODO wait for BlinkAck with sendAndWaitForResponseAsync()
+            return sendMessageAsync(makeBlink(duration, rgbColor, count, fade));
+        }
+
+    private:
+        Pixel(const ScannedPixel& scannedPixel, std::shared_ptr<PixelDelegate> delegate);
+        bool updateStatus(PixelStatus expectedStatus, PixelStatus newStatus, PixelStatus* outLastStatus = nullptr);
+        void setStatus(PixelStatus status);
+        static PixelSnapshot makeSnapshot(const ScannedPixelData& data);
+        Systemic::Internal::AwaitableResult<ConnectResult> requestSetup(bool fastIdentify = false);
+        Systemic::Internal::DetachedTask verifyIdentityAsync();
+        Systemic::Internal::DetachedTask restoreLinkAsync();
+        void trackTelemetryRequest(const std::vector<uint8_t>& data);
+        void onValueChanged(ByteSpan data);
+        void onMessageData(ByteSpan data);
+        void processMessage(const Messages::PixelMessage& message);
+        void notifyBatteryLevel(int level);
+        void notifyChargingState(bool isCharging);
+        // Bulk data is only accepted within a transfer session, this opens the session,
+        // uploads the data and waits for the Pixel to be done with it
+        Systemic::Internal::AwaitableResult<BulkTransferResult> requestBulkData(
+            Messages::TransferAnimSet session,
+            std::vector<uint8_t> data,
+            BulkTransferOptions options,
+            BulkTransferProgressListener onProgress);
+        Systemic::Internal::AwaitableResult<DataSetUploadResult> requestDataSet(
+            Messages::TransferAnimSet animSet,
+            std::vector<uint8_t> data,
+            std::shared_ptr<DataSetCache> cache,
+            BulkTransferOptions options,
+            BulkTransferProgressListener onProgress);
+        std::future<bool> sendMessageAsync(std::vector<uint8_t> data, bool withoutAck = false, bool allowCoalescing = true);
+        Systemic::Internal::AwaitableResult<bool> enqueueMessage(std::vector<uint8_t> data, bool withoutAck, bool allowCoalescing);
+        Systemic::Internal::DetachedTask processWriteQueueAsync();
+        Systemic::Internal::DetachedTask writeWithoutAckAsync(std::shared_ptr<Systemic::BluetoothLE::Characteristic> characteristic, WriteScheduler::Write write);
+        std::future<std::shared_ptr<const Messages::PixelMessage>> sendAndWaitForResponseAsync(
+            std::vector<uint8_t> data,
+            Messages::MessageType responseType,
+            std::chrono::milliseconds timeout);
+
+        // Internal version of sendAndWaitForResponseAsync(), awaiting the result doesn't block a thread
+        // (co_await on a std::future that isn't ready does)
+        RequestMultiplexer::PendingResponse requestResponse(
+            std::vector<uint8_t> data,
+            Messages::MessageType responseType,
+            std::chrono::milliseconds timeout);
+        Systemic::Internal::DetachedTask runRequestAsync(
+            RequestMultiplexer::PendingResponse result,
+            std::vector<uint8_t> data,
+            Messages::MessageType responseType,
+            std::chrono::milliseconds timeout);
+
+        template <class Rep, class Period>
+        RequestMultiplexer::PendingResponse requestResponse(
+            Messages::MessageType type,
+            Messages::MessageType responseType,
+            std::chrono::duration<Rep, Period> timeout)
+        {
+            std::vector<uint8_t> data{ static_cast<uint8_t>(type) };
+            return requestResponse(std::move(data), responseType, std::chrono::duration_cast<std::chrono::milliseconds>(timeout));
+        }
+
+        template <typename T, class Rep, class Period, std::enable_if_t<std::is_base_of_v<Messages::PixelMessage, T>, int> = 0>
+        RequestMultiplexer::PendingResponse requestResponse(
+            const T& message,
+            Messages::MessageType responseType,
+            std::chrono::duration<Rep, Period> timeout)
+        {
+            std::vector<uint8_t> data{};
+            Messages::Serialization::serializeMessage(message, data);
+            return requestResponse(std::move(data), responseType, std::chrono::duration_cast<std::chrono::milliseconds>(timeout));
+        }
+
+        // Internal version of sendMessageAsync(), awaiting the result doesn't block a thread
+        template <typename T, std::enable_if_t<std::is_base_of_v<Messages::PixelMessage, T>, int> = 0>
+        Systemic::Internal::AwaitableResult<bool> requestMessage(const T& message, bool withoutAck)
+        {
+            std::vector<uint8_t> data{};
+            Messages::Serialization::serializeMessage(message, data);
+            return enqueueMessage(std::move(data), withoutAck, true);
+        }
+
+        template <class Rep, class Period>
+        static Messages::Blink makeBlink(
+            std::chrono::duration<Rep, Period> duration,
+            uint32_t rgbColor,
+            int count,
+            float fade)
         {
             Messages::Blink msg{};
             down_cast(msg.count, count);
@@ -396,18 +842,9 @@ namespace Systemic::Pixels
             msg.faceMask = 0xFFFF;
             down_cast(msg.fade, 255 * fade);
             msg.loop = 0;
-            // TODO return sendAndWaitForResponseAsync(msg, Messages::MessageType::BlinkAck);
-            return sendMessageAsync(msg);
+            return msg;
         }
 
-    private:
-        Pixel(const ScannedPixel& scannedPixel, std::shared_ptr<PixelDelegate> delegate);
-        bool updateStatus(PixelStatus expectedStatus, PixelStatus newStatus, PixelStatus* outLastStatus = nullptr);
-        std::future<ConnectResult> internalSetupAsync();
-        void onValueChanged(const std::vector<uint8_t>& data);
-        void processMessage(const Messages::PixelMessage& message);
-        std::future<bool> sendMessageAsync(const std::vector<uint8_t>& data, bool withoutAck = false);
-
         template <typename T1, typename T2>
         static T1 down_cast(T1& dst, T2 src)
         {
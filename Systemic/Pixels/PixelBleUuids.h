@@ -5,17 +5,17 @@
 
 #pragma once
 
-#include <winrt/Windows.Foundation.h>
+#include "Systemic/BluetoothLE/BleTypes.h"
 
 /// Bluetooth UUIDs related to Pixels peripherals.
 namespace Systemic::Pixels::PixelBleUuids
 {
     /// Pixel dice service UUID.
-    extern const winrt::guid service;
+    extern const Systemic::BluetoothLE::BleUuid service;
 
     /// Pixel dice write characteristic UUID.
-    extern const winrt::guid notifyCharacteristic;
+    extern const Systemic::BluetoothLE::BleUuid notifyCharacteristic;
 
     /// Pixel dice write characteristic UUID.
-    extern const winrt::guid writeCharacteristic;
+    extern const Systemic::BluetoothLE::BleUuid writeCharacteristic;
 }
@@ -0,0 +1,279 @@
+/**
+ * @file
+ * @brief Definition of the PixelGroup class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <memory>
+#include <type_traits>
+#include <variant>
+#include <vector>
+#include "Systemic/Internal/AwaitableResult.h"
+#include "Pixel.h"
+
+namespace Systemic::Pixels
+{
+    /// The result of a command for one member of a PixelGroup.
+    template <typename R>
+    struct PixelGroupMemberResult
+    {
+        /// The Pixel.
+        std::shared_ptr<Pixel> pixel{};
+
+        /// The command result, default initialized if the command threw an exception,
+        /// std::monostate if the command returns a std::future<void>.
+        R result{};
+
+        /// Time taken by the command.
+        std::chrono::steady_clock::duration duration{};
+
+        /// The exception thrown by the command, if any.
+        std::exception_ptr error{};
+    };
+
+    /// The results of a command run on all the members of a PixelGroup.
+    template <typename R>
+    struct PixelGroupResult
+    {
+        /// The result for each member, in the order of the group members.
+        std::vector<PixelGroupMemberResult<R>> members{};
+
+        /// Time taken to run the command on all the members.
+        std::chrono::steady_clock::duration elapsed{};
+
+        /// Index in members of the member that took the longest, if any.
+        size_t slowestIndex{};
+
+        /**
+         * @brief Gets the result of the member that took the longest.
+         * @return The result of the slowest member, or null if the group is empty.
+         */
+        const PixelGroupMemberResult<R>* slowest() const
+        {
+            return members.empty() ? nullptr : &members[slowestIndex];
+        }
+    };
+
+    /**
+     * @brief A set of Pixels to which commands are sent concurrently.
+     *
+     * A command is started for up to maxConcurrency() members at a time, the next member
+     * being started as soon as a command completes. The returned future completes once
+     * all the commands have completed, with the result for each member.
+     *
+     * The group commands don't hold a thread while waiting for the Pixels. A user command
+     * returning a std::future holds a background thread until the future completes,
+     * so up to maxConcurrency() threads at once.
+     *
+     * This class is thread safe.
+     */
+    class PixelGroup
+    {
+        const std::vector<std::shared_ptr<Pixel>> _pixels;
+        const size_t _maxConcurrency;
+
+        template <typename R>
+        struct RunState
+        {
+            std::vector<PixelGroupMemberResult<R>> members{};
+            std::atomic<size_t> nextIndex{};
+            std::atomic<size_t> activeWorkers{};
+            Internal::AwaitableResult<bool> done{};
+        };
+
+        // Gets the type of the result of a command, which returns a std::future or an AwaitableResult
+        template <typename C>
+        struct CommandTraits;
+
+        template <typename T>
+        struct CommandTraits<std::future<T>>
+        {
+            using Result = std::conditional_t<std::is_void_v<T>, std::monostate, T>;
+            static constexpr bool isAwaitable = false;
+        };
+
+        template <typename T>
+        struct CommandTraits<Internal::AwaitableResult<T>>
+        {
+            using Result = T;
+            static constexpr bool isAwaitable = true;
+        };
+
+        template <typename F>
+        using CommandOf = std::invoke_result_t<F&, const std::shared_ptr<Pixel>&>;
+
+    public:
+        /**
+         * @brief Initializes a new group.
+         * @param pixels The members of the group.
+         * @param maxConcurrency Maximum number of members running a command at the same time.
+         */
+        explicit PixelGroup(std::vector<std::shared_ptr<Pixel>> pixels, size_t maxConcurrency = 8)
+            : _pixels{ std::move(pixels) }, _maxConcurrency{ std::max<size_t>(maxConcurrency, 1) } {}
+
+        /// Gets the members of the group.
+        const std::vector<std::shared_ptr<Pixel>>& pixels() const
+        {
+            return _pixels;
+        }
+
+        /// Gets the maximum number of members running a command at the same time.
+        size_t maxConcurrency() const
+        {
+            return _maxConcurrency;
+        }
+
+        /**
+         * @brief Runs a command on all the members of the group.
+         *
+         * A command returning an Internal::AwaitableResult, such as Pixel::requestConnect(),
+         * doesn't hold a thread while waiting. A command returning a std::future holds
+         * a background thread until its future completes.
+         * @tparam F Type of the command, called with a shared pointer to a Pixel
+         *           and returning a std::future or an Internal::AwaitableResult.
+         * @param command The command to run.
+         * @return A future with the results of the command.
+         */
+        template <typename F, typename R = typename CommandTraits<CommandOf<F>>::Result>
+        std::future<PixelGroupResult<R>> runAsync(F command) const
+        {
+            return Internal::toFuture(requestRun<R>(std::move(command)));
+        }
+
+        /**
+         * @brief Sends a message to all the members of the group.
+         * @tparam T Type of the message.
+         * @param message Message to send.
+         * @param withoutAck Whether to request a confirmation that the message was received.
+         * @return A future with the results of the command.
+         */
+        template <typename T, std::enable_if_t<std::is_base_of_v<Messages::PixelMessage, T>, int> = 0>
+        std::future<PixelGroupResult<bool>> sendMessageAsync(const T& message, bool withoutAck = false) const
+        {
+            return runAsync([message, withoutAck](const std::shared_ptr<Pixel>& pixel)
+                {
+                    return pixel->requestMessage(message, withoutAck);
+                });
+        }
+
+        /**
+         * @brief Requests all the members of the group to blink, see Pixel::blinkAsync().
+         * @tparam Rep Duration arithmetic type representing the number of ticks.
+         * @tparam Period Duration type representing the tick period.
+         * @param duration Total duration of the animation.
+         * @param rgbColor Blink color.
+         * @param count Number of blinks.
+         * @param fade Amount of in and out fading, 0: sharp transition, 1: maximum fading.
+         * @return A future with the results of the command.
+         */
+        template <class Rep, class Period>
+        std::future<PixelGroupResult<bool>> blinkAsync(
+            std::chrono::duration<Rep, Period> duration,
+            uint32_t rgbColor,
+            int count = 1,
+            float fade = 1) const
+        {
+            // Same message as Pixel::blinkAsync()
+            return sendMessageAsync(Pixel::makeBlink(duration, rgbColor, count, fade));
+        }
+
+    private:
+        // Runs the command on all the members and gathers the results
+        template <typename R, typename F>
+        Internal::AwaitableResult<PixelGroupResult<R>> requestRun(F command) const
+        {
+            const auto startTime = std::chrono::steady_clock::now();
+
+            auto state = std::make_shared<RunState<R>>();
+            state->members.resize(_pixels.size());
+            for (size_t i = 0; i < _pixels.size(); ++i)
+            {
+                state->members[i].pixel = _pixels[i];
+            }
+
+            const size_t workerCount = std::min(_maxConcurrency, _pixels.size());
+            if (workerCount)
+            {
+                state->activeWorkers = workerCount;
+                for (size_t i = 0; i < workerCount; ++i)
+                {
+                    runWorkerAsync(state, command);
+                }
+                co_await state->done.waitAsync();
+            }
+
+            PixelGroupResult<R> result{};
+            result.members = std::move(state->members);
+            result.elapsed = std::chrono::steady_clock::now() - startTime;
+            for (size_t i = 1; i < result.members.size(); ++i)
+            {
+                if (result.members[i].duration > result.members[result.slowestIndex].duration)
+                {
+                    result.slowestIndex = i;
+                }
+            }
+            co_return result;
+        }
+
+        // Runs the command on the next member until there is none left
+        template <typename R, typename F>
+        static Internal::DetachedTask runWorkerAsync(std::shared_ptr<RunState<R>> state, F command)
+        {
+            using Traits = CommandTraits<CommandOf<F>>;
+
+            // Waiting on a std::future blocks the thread, don't block the caller
+            co_await Internal::resumeBackground();
+
+            while (true)
+            {
+                const size_t index = state->nextIndex++;
+                if (index >= state->members.size())
+                {
+                    break;
+                }
+
+                // Each member is only accessed by a single worker
+                auto& member = state->members[index];
+                const auto startTime = std::chrono::steady_clock::now();
+                try
+                {
+                    auto pending = command(member.pixel);
+                    if constexpr (Traits::isAwaitable)
+                    {
+                        member.result = co_await pending.waitAsync();
+                    }
+                    else if constexpr (std::is_same_v<R, std::monostate>)
+                    {
+                        pending.get();
+                    }
+                    else
+                    {
+                        member.result = pending.get();
+                    }
+                }
+                catch (...)
+                {
+                    member.error = std::current_exception();
+                }
+                member.duration = std::chrono::steady_clock::now() - startTime;
+
+                if constexpr (Traits::isAwaitable)
+                {
+                    // Leave the thread that completed the command (notification or timer thread)
+                    co_await Internal::resumeBackground();
+                }
+            }
+
+            if (--state->activeWorkers == 0)
+            {
+                state->done.trySetResult(true);
+            }
+        }
+    };
+}
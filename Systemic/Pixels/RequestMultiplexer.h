@@ -0,0 +1,235 @@
+/**
+ * @file
+ * @brief Definition of the RequestMultiplexer class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include "Systemic/Internal/AwaitableResult.h"
+#include "Messages.h"
+
+namespace Systemic::Pixels
+{
+    /**
+     * @brief Keeps track of the requests sent to a Pixel and matches them with the responses.
+     *
+     * The number of requests waiting for a response is limited, extra requests are
+     * queued until a slot becomes available. Requests expecting the same type of response
+     * are served in the order they were registered, so several of them may be in flight
+     * at once without receiving each other's response.
+     *
+     * This class is thread safe.
+     */
+    class RequestMultiplexer
+    {
+    public:
+        /// The response to a request, null if it timed out.
+        using Response = std::shared_ptr<const Messages::PixelMessage>;
+
+        /// A response that a request is waiting for.
+        using PendingResponse = Internal::AwaitableResult<Response>;
+
+        /// A request slot that a request is waiting for.
+        using PendingSlot = Internal::AwaitableResult<bool>;
+
+        /// Default maximum number of requests waiting for a response.
+        static constexpr size_t defaultMaxInFlight = 4;
+
+    private:
+        std::array<std::deque<PendingResponse>, Messages::messageTypeCount> _pendingResponses{};
+        std::deque<PendingSlot> _queuedRequests{};
+        size_t _maxInFlight{ defaultMaxInFlight };
+        size_t _inFlight{};
+        mutable std::mutex _mutex{};
+
+    public:
+        /**
+         * @brief Gets the maximum number of requests waiting for a response.
+         * @return The maximum number of requests in flight.
+         */
+        size_t maxInFlight() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _maxInFlight;
+        }
+
+        /**
+         * @brief Sets the maximum number of requests waiting for a response.
+         *
+         * Queued requests are started if the new limit allows for it.
+         * @param maxInFlight The maximum number of requests in flight, at least one.
+         */
+        void setMaxInFlight(size_t maxInFlight)
+        {
+            {
+                std::lock_guard lock{ _mutex };
+                _maxInFlight = std::max<size_t>(maxInFlight, 1);
+            }
+            startQueuedRequests();
+        }
+
+        /**
+         * @brief Gets the number of requests waiting for a response.
+         * @return The number of requests in flight.
+         */
+        size_t inFlight() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _inFlight;
+        }
+
+        /**
+         * @brief Gets the number of requests waiting for a slot.
+         * @return The number of queued requests.
+         */
+        size_t queued() const
+        {
+            std::lock_guard lock{ _mutex };
+            return _queuedRequests.size();
+        }
+
+        /**
+         * @brief Requests a slot for sending a request.
+         *
+         * The returned result is already completed if a slot is available.
+         * Otherwise it is completed when an earlier request releases its slot.
+         * @return The slot to await. Once completed, the caller must call releaseSlot().
+         */
+        PendingSlot acquireSlot()
+        {
+            PendingSlot slot{};
+            {
+                std::lock_guard lock{ _mutex };
+                if (_inFlight >= _maxInFlight || !_queuedRequests.empty())
+                {
+                    _queuedRequests.push_back(slot);
+                    return slot;
+                }
+                ++_inFlight;
+            }
+            slot.trySetResult(true);
+            return slot;
+        }
+
+        /// Releases a slot obtained with acquireSlot() and starts the next queued request, if any.
+        void releaseSlot()
+        {
+            {
+                std::lock_guard lock{ _mutex };
+                if (_inFlight)
+                {
+                    --_inFlight;
+                }
+            }
+            startQueuedRequests();
+        }
+
+        /**
+         * @brief Registers a request expecting the given type of response.
+         * @param responseType The expected type of response.
+         * @return The response to await.
+         */
+        PendingResponse expectResponse(Messages::MessageType responseType)
+        {
+            PendingResponse response{};
+            const auto index = static_cast<size_t>(responseType);
+            if (index < _pendingResponses.size())
+            {
+                std::lock_guard lock{ _mutex };
+                _pendingResponses[index].push_back(response);
+            }
+            return response;
+        }
+
+        /**
+         * @brief Unregisters a request, typically after its response timed out.
+         * @param responseType The expected type of response.
+         * @param response The object returned by expectResponse().
+         */
+        void cancelResponse(Messages::MessageType responseType, const PendingResponse& response)
+        {
+            const auto index = static_cast<size_t>(responseType);
+            if (index < _pendingResponses.size())
+            {
+                std::lock_guard lock{ _mutex };
+                auto& pending = _pendingResponses[index];
+                pending.erase(std::remove(pending.begin(), pending.end(), response), pending.end());
+            }
+        }
+
+        /**
+         * @brief Indicates whether a request is waiting for the given type of response.
+         * @param type The message type.
+         * @return Whether a request expects this message type.
+         */
+        bool isExpecting(Messages::MessageType type) const
+        {
+            const auto index = static_cast<size_t>(type);
+            std::lock_guard lock{ _mutex };
+            return index < _pendingResponses.size() && !_pendingResponses[index].empty();
+        }
+
+        /**
+         * @brief Gives a received message to the oldest request expecting this type of response.
+         *
+         * The request is resumed on the calling thread.
+         * @param message The received message.
+         * @return Whether the message was given to a request.
+         */
+        bool dispatch(const Response& message)
+        {
+            const auto index = static_cast<size_t>(message->type);
+            if (index >= _pendingResponses.size())
+            {
+                return false;
+            }
+
+            while (true)
+            {
+                PendingResponse response{};
+                {
+                    std::lock_guard lock{ _mutex };
+                    auto& pending = _pendingResponses[index];
+                    if (pending.empty())
+                    {
+                        return false;
+                    }
+                    response = std::move(pending.front());
+                    pending.pop_front();
+                }
+
+                // Skip requests that already timed out
+                if (response.trySetResult(message))
+                {
+                    return true;
+                }
+            }
+        }
+
+    private:
+        void startQueuedRequests()
+        {
+            while (true)
+            {
+                PendingSlot slot{};
+                {
+                    std::lock_guard lock{ _mutex };
+                    if (_inFlight >= _maxInFlight || _queuedRequests.empty())
+                    {
+                        return;
+                    }
+                    slot = std::move(_queuedRequests.front());
+                    _queuedRequests.pop_front();
+                    ++_inFlight;
+                }
+                slot.trySetResult(true);
+            }
+        }
+    };
+}
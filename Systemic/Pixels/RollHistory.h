@@ -0,0 +1,193 @@
+/**
+ * @file
+ * @brief Definition of the RollHistory class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include "PixelTypes.h"
+
+namespace Systemic::Pixels
+{
+    /// A roll state change of a Pixel, see RollHistory.
+    struct RollEvent
+    {
+        /// When the roll state was received.
+        std::chrono::steady_clock::time_point time{};
+
+        /// The roll state.
+        PixelRollState state{};
+
+        /// The face value that is facing up.
+        int face{};
+    };
+
+    /**
+     * @brief A fixed capacity history of the roll state changes of a Pixel.
+     *
+     * Once full, the oldest events are overwritten. Events are added by a single thread,
+     * the one processing the Pixel notifications, and may be read by any number of threads.
+     * Reads don't lock nor retry: an event that is being overwritten while being read
+     * is considered gone, so queries return the most recent events still available.
+     *
+     * This class is thread safe.
+     */
+    class RollHistory
+    {
+        static_assert(std::is_trivially_copyable_v<RollEvent>, "RollEvent must be trivially copyable");
+
+        using Word = std::uint64_t;
+        static constexpr size_t wordCount = (sizeof(RollEvent) + sizeof(Word) - 1) / sizeof(Word);
+        static constexpr std::uint64_t writing = ~std::uint64_t{};
+
+        struct Slot
+        {
+            // Number of the event stored in this slot plus one, zero if empty or 'writing' during an update
+            std::atomic<std::uint64_t> stamp{};
+            std::atomic<Word> words[wordCount]{};
+        };
+
+        const size_t _capacity;
+        const std::unique_ptr<Slot[]> _slots;
+        std::atomic<std::uint64_t> _count{};
+
+    public:
+        /**
+         * @brief Initializes a new history.
+         * @param capacity Maximum number of events kept.
+         */
+        explicit RollHistory(size_t capacity = 256)
+            : _capacity{ std::max<size_t>(capacity, 1) }, _slots{ new Slot[_capacity] } {}
+
+        RollHistory(const RollHistory&) = delete;
+        RollHistory& operator=(const RollHistory&) = delete;
+
+        /// Gets the maximum number of events kept.
+        size_t capacity() const
+        {
+            return _capacity;
+        }
+
+        /// Gets the total number of events added since the history was created.
+        std::uint64_t totalCount() const
+        {
+            return _count.load(std::memory_order_acquire);
+        }
+
+        /**
+         * @brief Adds an event, must always be called from the same thread.
+         * @param event The event to add.
+         */
+        void add(const RollEvent& event)
+        {
+            const auto number = _count.load(std::memory_order_relaxed);
+            auto& slot = _slots[number % _capacity];
+
+            Word words[wordCount]{};
+            std::memcpy(words, &event, sizeof(RollEvent));
+
+            slot.stamp.store(writing, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+            for (size_t i = 0; i < wordCount; ++i)
+            {
+                slot.words[i].store(words[i], std::memory_order_relaxed);
+            }
+            slot.stamp.store(number + 1, std::memory_order_release);
+            _count.store(number + 1, std::memory_order_release);
+        }
+
+        /**
+         * @brief Gets the most recent events.
+         * @param maxCount Maximum number of events to return.
+         * @return The events, from the oldest to the most recent.
+         */
+        std::vector<RollEvent> last(size_t maxCount) const
+        {
+            std::vector<RollEvent> events{};
+            visitFromNewest([&](const RollEvent& event)
+                {
+                    if (events.size() >= maxCount)
+                    {
+                        return false;
+                    }
+                    events.push_back(event);
+                    return true;
+                });
+            std::reverse(events.begin(), events.end());
+            return events;
+        }
+
+        /**
+         * @brief Gets the events that occurred at or after the given time.
+         * @param time The time of the oldest event to return.
+         * @return The events, from the oldest to the most recent.
+         */
+        std::vector<RollEvent> since(std::chrono::steady_clock::time_point time) const
+        {
+            std::vector<RollEvent> events{};
+            visitFromNewest([&](const RollEvent& event)
+                {
+                    if (event.time < time)
+                    {
+                        return false;
+                    }
+                    events.push_back(event);
+                    return true;
+                });
+            std::reverse(events.begin(), events.end());
+            return events;
+        }
+
+        /**
+         * @brief Calls a function with each available event, from the most recent one.
+         * @param visitor Called with each event, returns false to stop.
+         */
+        template <typename F>
+        void visitFromNewest(F&& visitor) const
+        {
+            const auto count = _count.load(std::memory_order_acquire);
+            const auto available = std::min<std::uint64_t>(count, _capacity);
+            for (std::uint64_t i = 0; i < available; ++i)
+            {
+                RollEvent event{};
+                if (!tryRead(count - 1 - i, event) || !visitor(event))
+                {
+                    break;
+                }
+            }
+        }
+
+    private:
+        bool tryRead(std::uint64_t number, RollEvent& event) const
+        {
+            const auto& slot = _slots[number % _capacity];
+            if (slot.stamp.load(std::memory_order_acquire) != number + 1)
+            {
+                return false;
+            }
+
+            Word words[wordCount];
+            for (size_t i = 0; i < wordCount; ++i)
+            {
+                words[i] = slot.words[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (slot.stamp.load(std::memory_order_relaxed) != number + 1)
+            {
+                // Overwritten while reading
+                return false;
+            }
+
+            std::memcpy(&event, words, sizeof(RollEvent));
+            return true;
+        }
+    };
+}
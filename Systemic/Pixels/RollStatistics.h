@@ -0,0 +1,183 @@
+/**
+ * @file
+ * @brief Definition of the RollStatistics class.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include "Systemic/Internal/Seqlock.h"
+
+namespace Systemic::Pixels
+{
+    /**
+     * @brief Statistics of the faces rolled by one or more dice with the same number of faces.
+     *
+     * Only running sums are stored, so adding a roll and computing the mean, variance
+     * and chi-square statistic are constant time, and snapshots of different dice may
+     * be merged by adding them up.
+     */
+    struct RollStatisticsSnapshot
+    {
+        /// Maximum number of faces of a die.
+        static constexpr int maxFaceCount = 20;
+
+        /// Number of faces of the die, zero if unknown.
+        int faceCount{};
+
+        /// Number of rolls.
+        uint64_t rollCount{};
+
+        /// Number of rolls per face, indexed by face value minus one.
+        uint64_t faceCounts[maxFaceCount]{};
+
+        /// Sum of the rolled face values.
+        uint64_t sum{};
+
+        /// Sum of the squares of the rolled face values.
+        uint64_t sumOfSquares{};
+
+        /// Sum of the squares of the per face counts, used for the chi-square statistic.
+        uint64_t sumOfCountSquares{};
+
+        /**
+         * @brief Adds a roll.
+         * @param face The rolled face value, from 1 to faceCount.
+         * @return Whether the roll was added, false if the face value is out of range.
+         */
+        bool add(int face)
+        {
+            if (face < 1 || face > faceCount)
+            {
+                return false;
+            }
+            auto& count = faceCounts[face - 1];
+            sumOfCountSquares += 2 * count + 1; // (n + 1)^2 - n^2
+            ++count;
+            ++rollCount;
+            sum += face;
+            sumOfSquares += static_cast<uint64_t>(face) * face;
+            return true;
+        }
+
+        /**
+         * @brief Adds the rolls of another snapshot.
+         * @param other Statistics to add, for a die with the same number of faces.
+         * @return Whether the statistics were merged, false if the numbers of faces differ.
+         */
+        bool merge(const RollStatisticsSnapshot& other)
+        {
+            if (!faceCount)
+            {
+                faceCount = other.faceCount;
+            }
+            if (other.faceCount != faceCount)
+            {
+                return false;
+            }
+            sumOfCountSquares = 0;
+            for (int i = 0; i < faceCount; ++i)
+            {
+                faceCounts[i] += other.faceCounts[i];
+                sumOfCountSquares += faceCounts[i] * faceCounts[i];
+            }
+            rollCount += other.rollCount;
+            sum += other.sum;
+            sumOfSquares += other.sumOfSquares;
+            return true;
+        }
+
+        /// Gets the average of the rolled face values.
+        double mean() const
+        {
+            return rollCount ? static_cast<double>(sum) / rollCount : 0;
+        }
+
+        /// Gets the (population) variance of the rolled face values.
+        double variance() const
+        {
+            if (!rollCount)
+            {
+                return 0;
+            }
+            const double m = mean();
+            return std::max(static_cast<double>(sumOfSquares) / rollCount - m * m, 0.0);
+        }
+
+        /**
+         * @brief Gets Pearson's chi-square statistic against a fair die.
+         *
+         * Compare it with the critical value for degreesOfFreedom() to test fairness.
+         * The test is only meaningful with at least about 5 expected rolls per face.
+         * @return The chi-square statistic.
+         */
+        double chiSquare() const
+        {
+            if (!rollCount || !faceCount)
+            {
+                return 0;
+            }
+            // Sum((O - E)^2 / E) with E = N / k simplifies to k * Sum(O^2) / N - N
+            const double n = static_cast<double>(rollCount);
+            return faceCount * static_cast<double>(sumOfCountSquares) / n - n;
+        }
+
+        /// Gets the number of degrees of freedom of the chi-square test.
+        int degreesOfFreedom() const
+        {
+            return std::max(faceCount - 1, 0);
+        }
+    };
+
+    /**
+     * @brief Keeps the roll statistics of a Pixel up to date.
+     *
+     * Rolls are added by a single thread, snapshots may be taken by any thread without locking.
+     *
+     * This class is thread safe.
+     */
+    class RollStatistics
+    {
+        Internal::Seqlock<RollStatisticsSnapshot> _data{};
+
+    public:
+        /**
+         * @brief Initializes a new instance.
+         * @param faceCount The number of faces of the die.
+         */
+        explicit RollStatistics(int faceCount = 0)
+        {
+            reset(faceCount);
+        }
+
+        /**
+         * @brief Clears the statistics.
+         * @param faceCount The number of faces of the die.
+         */
+        void reset(int faceCount)
+        {
+            RollStatisticsSnapshot data{};
+            data.faceCount = std::clamp(faceCount, 0, RollStatisticsSnapshot::maxFaceCount);
+            _data.store(data);
+        }
+
+        /**
+         * @brief Adds a roll.
+         * @param face The rolled face value, from 1 to the number of faces.
+         */
+        void addRoll(int face)
+        {
+            _data.update([face](auto& data) { data.add(face); });
+        }
+
+        /**
+         * @brief Gets a consistent copy of the statistics.
+         * @return The statistics.
+         */
+        RollStatisticsSnapshot snapshot() const
+        {
+            return _data.load();
+        }
+    };
+}
@@ -5,6 +5,7 @@
 
 #pragma once
 
+#include <chrono>
 #include <string>
 #include "PixelInfo.h"
 
@@ -52,6 +53,9 @@ namespace Systemic::Pixels
 
         /// The Pixel face value that is currently facing up.
         int currentFace{};
+
+        /// When the advertisement data was received.
+        std::chrono::steady_clock::time_point timestamp{};
     };
 
     /// Data periodically emitted by a Pixel when not connected to a device.
@@ -0,0 +1,90 @@
+/**
+ * @file
+ * @brief Definition of the SimulatedPixelModel class.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <random>
+#include "Systemic/BluetoothLE/SimulatedBackend.h"
+#include "MessageFramer.h"
+#include "PixelTypes.h"
+
+namespace Systemic::Pixels
+{
+    /**
+     * @brief Simulates Pixels dice for a Systemic::BluetoothLE::SimulatedBackend.
+     *
+     * Each die advertises like a Pixel, answers the identification, state and blink
+     * requests, accepts animation set transfers, and randomly rolls while connected.
+     * Like a Pixel, a die only accepts bulk data within an animation set transfer.
+     * Dice are deterministic for a given seed.
+     *
+     * Usage:
+     * @code
+     * using namespace Systemic::BluetoothLE;
+     * SimulatedBackendOptions options{};
+     * options.peripheralCount = 200;
+     * BleBackend::setDefault(SimulatedBackend::create(options, std::make_shared<Pixels::SimulatedPixelModel>()));
+     * @endcode
+     */
+    class SimulatedPixelModel : public Systemic::BluetoothLE::SimulatedPeripheralModel
+    {
+        // State of a simulated die
+        struct Die
+        {
+            std::mt19937 random;
+            std::uint32_t pixelId{};
+            std::uint8_t ledCount{};
+            PixelDesignAndColor designAndColor{};
+            PixelRollState rollState{ PixelRollState::OnFace };
+            std::uint8_t faceIndex{};
+            std::uint8_t batteryLevel{};
+            PixelBatteryState batteryState{};
+            int rollTicksLeft{};
+            std::uint32_t dataSetHash{};
+            MessageFramer framer{};
+
+            // Animation set transfer, the bulk data is accepted once the transfer is acknowledged
+            bool isTransferringAnimSet{};
+            std::vector<std::uint8_t> animSet{};
+            std::vector<std::uint8_t> bulkData{};
+            std::vector<bool> bulkReceived{};
+            size_t bulkReceivedCount{};
+
+            explicit Die(std::uint32_t seed) : random{ seed } {}
+        };
+
+        const std::uint32_t _seed;
+        const int _rollPercent;
+        std::map<size_t, Die> _dice{};
+
+    public:
+        /// UNIX timestamp of the simulated firmware.
+        static constexpr std::uint32_t buildTimestamp = 1672531200;
+
+        /**
+         * @brief Initializes a new instance of SimulatedPixelModel.
+         * @param seed Seed of the dice random generators.
+         * @param rollPercent Chance of a die at rest to start rolling on each tick, in percent.
+         */
+        explicit SimulatedPixelModel(std::uint32_t seed = 0, int rollPercent = 20)
+            : _seed{ seed }, _rollPercent{ rollPercent } {}
+
+        void advertise(size_t index, Systemic::BluetoothLE::AdvertisementPacket& packet) override;
+
+        std::vector<Systemic::BluetoothLE::SimulatedService> services(size_t index) override;
+
+        void onConnectionChanged(size_t index, bool isConnected) override;
+
+        std::vector<Systemic::BluetoothLE::SimulatedNotification> onWrite(size_t index, const Systemic::BluetoothLE::BleUuid& characteristic, ByteSpan data) override;
+
+        std::vector<Systemic::BluetoothLE::SimulatedNotification> onTick(size_t index) override;
+
+    private:
+        Die& getDie(size_t index);
+        void onMessage(Die& die, ByteSpan message, std::vector<Systemic::BluetoothLE::SimulatedNotification>& outNotifications);
+    };
+}
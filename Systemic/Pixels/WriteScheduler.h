@@ -0,0 +1,315 @@
+/**
+ * @file
+ * @brief Definition of the WriteScheduler class.
+ */
+
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+#include "Systemic/Internal/AwaitableResult.h"
+#include "Messages.h"
+
+namespace Systemic::Pixels
+{
+    /// The priority classes of the messages written to a Pixel, from the most urgent one.
+    enum class WritePriority
+    {
+        /// Latency critical commands, such as stopping animations.
+        Control,
+
+        /// Commands resulting from a user action, such as blinking.
+        Interactive,
+
+        /// Requests for data and bulk transfers.
+        Background,
+    };
+
+    /// Number of write priority classes.
+    constexpr size_t writePriorityCount = 3;
+
+    /// Metrics of the queue of messages to write to a Pixel.
+    struct WriteQueueStats
+    {
+        /// Number of messages currently waiting to be written, per WritePriority.
+        std::array<size_t, writePriorityCount> queueDepth{};
+
+        /// Highest number of messages that waited to be written at the same time, per WritePriority.
+        std::array<size_t, writePriorityCount> maxQueueDepth{};
+
+        /// Average time messages waited before being written, per WritePriority.
+        std::array<std::chrono::microseconds, writePriorityCount> averageWaitTime{};
+
+        /// Longest time a message waited before being written, per WritePriority.
+        std::array<std::chrono::microseconds, writePriorityCount> maxWaitTime{};
+
+        /// Number of messages successfully written.
+        uint64_t writesSucceeded{};
+
+        /// Number of messages that failed to be written.
+        uint64_t writesFailed{};
+
+        /// Number of queued messages dropped because a newer message of the same type superseded them.
+        uint64_t writesCoalesced{};
+    };
+
+    /**
+     * @brief Orders the messages to be written to a Pixel.
+     *
+     * Messages are queued in one lane per WritePriority and written one at a time,
+     * the most urgent lane first. Within a lane, messages are written in the order
+     * they were queued.
+     *
+     * A queued message that only changes a setting of the Pixel (see isCoalescable())
+     * is dropped when a newer message of the same type is queued. Its sender gets the
+     * result of the newer message.
+     *
+     * This class is thread safe.
+     */
+    class WriteScheduler
+    {
+    public:
+        /// Clock used for measuring wait times.
+        using Clock = std::chrono::steady_clock;
+
+        /// A message to write.
+        struct Write
+        {
+            /// The serialized message.
+            std::vector<uint8_t> data{};
+
+            /// Whether to write without requesting a confirmation.
+            bool withoutAck{};
+
+            /// The priority class of the message.
+            WritePriority priority{};
+
+            /// Whether a newer message of the same type may supersede this one.
+            bool coalescable{};
+
+            /// When the message was queued.
+            Clock::time_point queuedTime{};
+
+            /// The senders waiting for the write result.
+            std::vector<Internal::AwaitableResult<bool>> completions{};
+        };
+
+    private:
+        struct LaneStats
+        {
+            size_t maxDepth{};
+            uint64_t waitCount{};
+            Clock::duration totalWait{};
+            Clock::duration maxWait{};
+        };
+
+        std::array<std::deque<Write>, writePriorityCount> _lanes{};
+        std::array<LaneStats, writePriorityCount> _laneStats{};
+        uint64_t _writesSucceeded{};
+        uint64_t _writesFailed{};
+        uint64_t _writesCoalesced{};
+        bool _writing{};
+        mutable std::mutex _mutex{};
+
+    public:
+        /**
+         * @brief Gets the priority class of a type of message.
+         * @param type The message type.
+         * @return The priority class.
+         */
+        static WritePriority getPriority(Messages::MessageType type)
+        {
+            using Messages::MessageType;
+            switch (type)
+            {
+            case MessageType::StopAllAnims:
+            case MessageType::StopAnim:
+            case MessageType::Sleep:
+            case MessageType::WhoAreYou:
+                return WritePriority::Control;
+            case MessageType::BulkSetup:
+            case MessageType::BulkData:
+            case MessageType::RequestRollState:
+            case MessageType::RequestTelemetry:
+            case MessageType::RequestBatteryLevel:
+            case MessageType::RequestRssi:
+            case MessageType::RequestTemperature:
+                return WritePriority::Background;
+            default:
+                return WritePriority::Interactive;
+            }
+        }
+
+        /**
+         * @brief Indicates whether a queued message of the given type may be dropped
+         *        when a newer one of the same type is queued.
+         * @param type The message type.
+         * @return Whether the message type is coalescable.
+         */
+        static bool isCoalescable(Messages::MessageType type)
+        {
+            // Those messages set a reporting mode, only the last one matters
+            return type == Messages::MessageType::RequestRssi
+                || type == Messages::MessageType::RequestTelemetry;
+        }
+
+        /**
+         * @brief Queues a message to be written.
+         * @param data The serialized message, must not be empty.
+         * @param withoutAck Whether to write without requesting a confirmation.
+         * @param allowCoalescing Whether the message may supersede or be superseded by another one.
+         * @param[out] startWriting Set to true if the caller must start writing the queued
+         *                          messages, see next().
+         * @return The result of the write to await.
+         */
+        Internal::AwaitableResult<bool> enqueue(std::vector<uint8_t> data, bool withoutAck, bool allowCoalescing, bool& startWriting)
+        {
+            Internal::AwaitableResult<bool> completion{};
+            const auto type = static_cast<Messages::MessageType>(data[0]);
+            const auto priority = getPriority(type);
+            auto& lane = _lanes[static_cast<size_t>(priority)];
+
+            std::lock_guard lock{ _mutex };
+
+            Write write{};
+            write.data = std::move(data);
+            write.withoutAck = withoutAck;
+            write.priority = priority;
+            write.coalescable = allowCoalescing && isCoalescable(type);
+            write.queuedTime = Clock::now();
+            write.completions.push_back(completion);
+
+            if (write.coalescable)
+            {
+                // Take over the superseded message senders, keep its queued time for the metrics
+                for (auto it = lane.begin(); it != lane.end(); ++it)
+                {
+                    if (it->coalescable && it->data[0] == write.data[0])
+                    {
+                        write.queuedTime = it->queuedTime;
+                        write.completions.insert(write.completions.begin(), it->completions.begin(), it->completions.end());
+                        lane.erase(it);
+                        ++_writesCoalesced;
+                        break;
+                    }
+                }
+            }
+
+            lane.push_back(std::move(write));
+            auto& stats = _laneStats[static_cast<size_t>(priority)];
+            stats.maxDepth = std::max(stats.maxDepth, lane.size());
+
+            startWriting = !_writing;
+            _writing = true;
+            return completion;
+        }
+
+        /**
+         * @brief Takes the next message to write.
+         *
+         * When the queue is empty, the next call to enqueue() requests the caller
+         * to start writing again.
+         * @return The message to write, if any.
+         */
+        std::optional<Write> next()
+        {
+            std::lock_guard lock{ _mutex };
+            for (size_t i = 0; i < _lanes.size(); ++i)
+            {
+                if (!_lanes[i].empty())
+                {
+                    return takeFront(i);
+                }
+            }
+            _writing = false;
+            return std::nullopt;
+        }
+
+        /**
+         * @brief Takes the next message to write if it satisfies the given condition,
+         *        typically to be written along with a message returned by next().
+         *
+         * The caller remains responsible for writing the queued messages,
+         * and must call next() once done.
+         * @param predicate Called with the next message, returns whether to take it.
+         * @return The message to write, if any and if it satisfies the condition.
+         */
+        template <typename F>
+        std::optional<Write> nextIf(F&& predicate)
+        {
+            std::lock_guard lock{ _mutex };
+            for (size_t i = 0; i < _lanes.size(); ++i)
+            {
+                if (!_lanes[i].empty())
+                {
+                    return predicate(std::as_const(_lanes[i].front())) ? takeFront(i) : std::nullopt;
+                }
+            }
+            return std::nullopt;
+        }
+
+        /**
+         * @brief Notifies the senders of a message of the write result.
+         * @param write The message returned by next().
+         * @param success Whether the write succeeded.
+         */
+        void complete(const Write& write, bool success)
+        {
+            {
+                std::lock_guard lock{ _mutex };
+                ++(success ? _writesSucceeded : _writesFailed);
+            }
+            for (const auto& completion : write.completions)
+            {
+                completion.trySetResult(success);
+            }
+        }
+
+        /**
+         * @brief Gets a snapshot of the queue metrics.
+         * @return The queue metrics.
+         */
+        WriteQueueStats stats() const
+        {
+            using std::chrono::duration_cast;
+            using std::chrono::microseconds;
+
+            std::lock_guard lock{ _mutex };
+            WriteQueueStats stats{};
+            for (size_t i = 0; i < _lanes.size(); ++i)
+            {
+                const auto& lane = _laneStats[i];
+                stats.queueDepth[i] = _lanes[i].size();
+                stats.maxQueueDepth[i] = lane.maxDepth;
+                stats.averageWaitTime[i] = lane.waitCount ? duration_cast<microseconds>(lane.totalWait / lane.waitCount) : microseconds{};
+                stats.maxWaitTime[i] = duration_cast<microseconds>(lane.maxWait);
+            }
+            stats.writesSucceeded = _writesSucceeded;
+            stats.writesFailed = _writesFailed;
+            stats.writesCoalesced = _writesCoalesced;
+            return stats;
+        }
+
+    private:
+        // Must be called with the lock held
+        std::optional<Write> takeFront(size_t laneIndex)
+        {
+            auto& lane = _lanes[laneIndex];
+            Write write = std::move(lane.front());
+            lane.pop_front();
+
+            auto& stats = _laneStats[laneIndex];
+            const auto wait = Clock::now() - write.queuedTime;
+            ++stats.waitCount;
+            stats.totalWait += wait;
+            stats.maxWait = std::max(stats.maxWait, wait);
+            return write;
+        }
+    };
+}
@@ -0,0 +1,467 @@
+#include "pch.h"
+#include "Systemic/BluetoothLE/WinRTBackend.h"
+
+using namespace winrt::Windows::Devices::Bluetooth;
+using namespace winrt::Windows::Devices::Bluetooth::Advertisement;
+using namespace winrt::Windows::Devices::Bluetooth::GenericAttributeProfile;
+
+namespace Systemic::BluetoothLE
+{
+    namespace
+    {
+        // Converts a WinRT GattCommunicationStatus to a BleRequestStatus
+        inline BleRequestStatus toRequestStatus(GattCommunicationStatus gattStatus)
+        {
+            switch (gattStatus)
+            {
+            case GattCommunicationStatus::Success:
+                return BleRequestStatus::Success;
+            case GattCommunicationStatus::Unreachable:
+                return BleRequestStatus::Timeout;
+            case GattCommunicationStatus::ProtocolError:
+                return BleRequestStatus::ProtocolError;
+            case GattCommunicationStatus::AccessDenied:
+                return BleRequestStatus::AccessDenied;
+            default:
+                return BleRequestStatus::Error;
+            }
+        }
+
+        class WinRTCharacteristic final : public BleCharacteristicBackend
+        {
+            using Handler = std::function<void(ByteSpan)>;
+
+            GattCharacteristic _characteristic{ nullptr };
+
+            // Replaced as a whole with std::atomic_store() so notifications may read it without taking a lock
+            std::shared_ptr<const Handler> _onValueChanged{};
+            winrt::event_token _valueChangedToken{};
+            std::mutex _mutex{};
+
+        public:
+            explicit WinRTCharacteristic(GattCharacteristic characteristic)
+                : _characteristic{ characteristic } {}
+
+            ~WinRTCharacteristic()
+            {
+                setValueChangedHandler(nullptr);
+            }
+
+            std::uint16_t handle() const override
+            {
+                return _characteristic.AttributeHandle();
+            }
+
+            BleUuid uuid() const override
+            {
+                return _characteristic.Uuid();
+            }
+
+            std::uint32_t properties() const override
+            {
+                return static_cast<std::uint32_t>(_characteristic.CharacteristicProperties());
+            }
+
+            Systemic::Internal::AwaitableResult<std::vector<std::uint8_t>> requestRead() override
+            {
+                auto result = co_await _characteristic.ReadValueAsync();
+                co_return Internal::dataBufferToBytesVector(result.Value());
+            }
+
+            Systemic::Internal::AwaitableResult<BleRequestStatus> requestWrite(std::vector<std::uint8_t> data, bool withoutResponse) override
+            {
+                // Copy the characteristic, this instance may be destroyed while the write runs
+                const auto characteristic = _characteristic;
+                auto status = BleRequestStatus::Error;
+                try
+                {
+                    // Awaiting the WinRT operation doesn't block a thread
+                    auto options = withoutResponse ? GattWriteOption::WriteWithoutResponse : GattWriteOption::WriteWithResponse;
+                    auto gattStatus = co_await characteristic.WriteValueAsync(Internal::bytesVectorToDataBuffer(data), options);
+                    status = gattStatus == GattCommunicationStatus::Success ? BleRequestStatus::Success : BleRequestStatus::Error;
+                }
+                catch (...)
+                {
+                    // Reported as a failed write
+                }
+                co_return status;
+            }
+
+            Systemic::Internal::AwaitableResult<BleRequestStatus> requestConfigureNotifications(bool enable) override
+            {
+                auto result = co_await _characteristic.WriteClientCharacteristicConfigurationDescriptorAsync(enable
+                    ? GattClientCharacteristicConfigurationDescriptorValue::Notify
+                    : GattClientCharacteristicConfigurationDescriptorValue::None);
+                co_return result == GattCommunicationStatus::Success ? BleRequestStatus::Success : BleRequestStatus::Error;
+            }
+
+            void setValueChangedHandler(Handler onValueChanged) override
+            {
+                std::lock_guard lock{ _mutex };
+
+                if (onValueChanged)
+                {
+                    std::atomic_store(&_onValueChanged, std::make_shared<const Handler>(std::move(onValueChanged)));
+                    if (!_valueChangedToken)
+                    {
+                        _valueChangedToken = _characteristic.ValueChanged({ this, &WinRTCharacteristic::onValueChanged });
+                    }
+                }
+                else
+                {
+                    if (_valueChangedToken)
+                    {
+                        _characteristic.ValueChanged(_valueChangedToken);
+                        _valueChangedToken = winrt::event_token{};
+                    }
+                    std::atomic_store(&_onValueChanged, std::shared_ptr<const Handler>{});
+                }
+            }
+
+        private:
+            // Called when subscribed to the characteristic and its value changes
+            void onValueChanged(GattCharacteristic _, GattValueChangedEventArgs args)
+            {
+                const auto callback = std::atomic_load(&_onValueChanged);
+                if (callback)
+                {
+                    // Keep the buffer alive while its data is viewed
+                    const auto buffer = args.CharacteristicValue();
+                    (*callback)(Internal::dataBufferToByteSpan(buffer));
+                }
+            }
+        };
+
+        class WinRTService final : public BleServiceBackend
+        {
+            GattDeviceService _service{ nullptr };
+            std::vector<std::shared_ptr<BleCharacteristicBackend>> _characteristics{};
+
+        public:
+            WinRTService(GattDeviceService service, std::vector<std::shared_ptr<BleCharacteristicBackend>> characteristics)
+                : _service{ service }, _characteristics{ std::move(characteristics) } {}
+
+            std::uint16_t handle() const override
+            {
+                return _service.AttributeHandle();
+            }
+
+            BleUuid uuid() const override
+            {
+                return _service.Uuid();
+            }
+
+            std::vector<std::shared_ptr<BleCharacteristicBackend>> characteristics() const override
+            {
+                return _characteristics;
+            }
+
+            void close() override
+            {
+                _characteristics.clear();
+                if (_service)
+                {
+                    _service.Close();
+                    _service = nullptr;
+                }
+            }
+        };
+
+        class WinRTDevice final : public BleDeviceBackend
+        {
+            BluetoothLEDevice _device{ nullptr };
+            GattSession _session{ nullptr };
+            std::function<void(bool)> _onStatusChanged{};
+            winrt::event_token _connectionStatusChangedToken{};
+            mutable std::mutex _mutex{};
+
+        public:
+            WinRTDevice(BluetoothLEDevice device, GattSession session)
+                : _device{ device }, _session{ session } {}
+
+            ~WinRTDevice()
+            {
+                setConnectionStatusHandler(nullptr);
+            }
+
+            bool isConnected() const override
+            {
+                return _device.ConnectionStatus() == BluetoothConnectionStatus::Connected;
+            }
+
+            std::wstring deviceId() const override
+            {
+                return std::wstring{ _device.DeviceId() };
+            }
+
+            std::wstring name() const override
+            {
+                return std::wstring{ _device.Name() };
+            }
+
+            std::uint16_t mtu() const override
+            {
+                return _session.MaxPduSize();
+            }
+
+            bool maintainConnection() const override
+            {
+                return _session.MaintainConnection();
+            }
+
+            void setMaintainConnection(bool maintain) override
+            {
+                _session.MaintainConnection(maintain);
+            }
+
+            Systemic::Internal::AwaitableResult<BleDiscoveryResult> requestDiscoverServices(
+                std::vector<BleUuid> servicesUuids,
+                bool useCache,
+                std::function<bool()> isCanceled) override
+            {
+                const auto cacheMode = useCache ? BluetoothCacheMode::Cached : BluetoothCacheMode::Uncached;
+                auto status = GattCommunicationStatus::Success;
+                BleDiscoveryResult result{};
+
+                std::vector<GattDeviceService> gattServices{};
+                if (servicesUuids.empty())
+                {
+                    auto servicesResult = co_await _device.GetGattServicesAsync(cacheMode);
+                    status = servicesResult.Status();
+                    if (status == GattCommunicationStatus::Success)
+                    {
+                        for (auto service : servicesResult.Services())
+                        {
+                            gattServices.emplace_back(service);
+                        }
+                    }
+                }
+                else
+                {
+                    for (const auto& uuid : servicesUuids)
+                    {
+                        auto servicesResult = co_await _device.GetGattServicesForUuidAsync(uuid, cacheMode);
+                        status = servicesResult.Status();
+                        if (isCanceled() || (status != GattCommunicationStatus::Success))
+                        {
+                            break;
+                        }
+                        for (auto service : servicesResult.Services())
+                        {
+                            gattServices.emplace_back(service);
+                        }
+                    }
+                }
+
+                for (auto& service : gattServices)
+                {
+                    if (isCanceled() || (status != GattCommunicationStatus::Success))
+                    {
+                        break;
+                    }
+
+                    GattCharacteristicsResult characteristicsResult = nullptr;
+                    try
+                    {
+                        // Got an exception once, may be caused by having the device disconnected...
+                        characteristicsResult = co_await service.GetCharacteristicsAsync(cacheMode);
+                    }
+                    catch (const winrt::hresult_error&)
+                    {
+                        status = GattCommunicationStatus::AccessDenied;
+                        break;
+                    }
+
+                    status = characteristicsResult.Status();
+                    if (status == GattCommunicationStatus::Success)
+                    {
+                        std::vector<std::shared_ptr<BleCharacteristicBackend>> characteristics{};
+                        for (auto characteristic : characteristicsResult.Characteristics())
+                        {
+                            characteristics.emplace_back(std::make_shared<WinRTCharacteristic>(characteristic));
+                        }
+                        result.services.emplace_back(std::make_shared<WinRTService>(service, std::move(characteristics)));
+                    }
+                }
+
+                result.status = toRequestStatus(status);
+                co_return result;
+            }
+
+            void setConnectionStatusHandler(std::function<void(bool)> onStatusChanged) override
+            {
+                std::lock_guard lock{ _mutex };
+
+                _onStatusChanged = std::move(onStatusChanged);
+                if (_onStatusChanged && !_connectionStatusChangedToken)
+                {
+                    _connectionStatusChangedToken = _device.ConnectionStatusChanged({ this, &WinRTDevice::onConnectionStatusChanged });
+                }
+                else if (!_onStatusChanged && _connectionStatusChangedToken)
+                {
+                    _device.ConnectionStatusChanged(_connectionStatusChangedToken);
+                    _connectionStatusChangedToken = winrt::event_token{};
+                }
+            }
+
+        private:
+            // Called by the device when the connection status changes
+            void onConnectionStatusChanged(BluetoothLEDevice device, winrt::Windows::Foundation::IInspectable _)
+            {
+                std::function<void(bool)> callback{};
+                {
+                    std::lock_guard lock{ _mutex };
+                    callback = _onStatusChanged;
+                }
+                if (callback)
+                {
+                    callback(device.ConnectionStatus() == BluetoothConnectionStatus::Connected);
+                }
+            }
+        };
+
+        class WinRTScan final : public BleScanBackend
+        {
+            // Watcher and its event tokens
+            BluetoothLEAdvertisementWatcher _watcher{};
+            winrt::event_token _receivedToken{};
+            winrt::event_token _stoppedToken{};
+
+            // User callback for advertisement packets
+            const std::function<void(const AdvertisementPacket&)> _onAdvertisement{};
+
+        public:
+            explicit WinRTScan(std::function<void(const AdvertisementPacket&)> onAdvertisement)
+                : _onAdvertisement{ std::move(onAdvertisement) }
+            {
+                // We want to receive all advertisement packets
+                _watcher.AllowExtendedAdvertisements(true);
+
+                // Send scan requests packets
+                _watcher.ScanningMode(BluetoothLEScanningMode::Active);
+
+                // We must subscribe to both Received and Stopped for the watcher to work
+                _receivedToken = _watcher.Received({ this, &WinRTScan::onReceived });
+                _stoppedToken = _watcher.Stopped({ this, &WinRTScan::onStopped });
+
+                // Starts scanning
+                _watcher.Start();
+            }
+
+            ~WinRTScan()
+            {
+                if (_watcher)
+                {
+                    _watcher.Received(_receivedToken);
+                    _watcher.Stopped(_stoppedToken);
+                    _watcher.Stop();
+                    _watcher = nullptr;
+                }
+            }
+
+        private:
+            // Called by the watcher for each received advertisement packet
+            void onReceived(
+                BluetoothLEAdvertisementWatcher const& /*watcher*/,
+                BluetoothLEAdvertisementReceivedEventArgs const& args)
+            {
+                AdvertisementPacket packet{};
+                packet.timestamp = std::chrono::time_point_cast<std::chrono::system_clock::duration>(winrt::clock::to_sys(args.Timestamp()));
+                packet.address = args.BluetoothAddress();
+                packet.isConnectable = args.IsConnectable();
+                packet.rssi = args.RawSignalStrengthInDBm();
+
+                switch (args.AdvertisementType())
+                {
+                case BluetoothLEAdvertisementType::ConnectableUndirected:
+                case BluetoothLEAdvertisementType::ConnectableDirected:
+                case BluetoothLEAdvertisementType::ScannableUndirected:
+                case BluetoothLEAdvertisementType::NonConnectableUndirected:
+                    break;
+                case BluetoothLEAdvertisementType::ScanResponse:
+                    packet.isScanResponse = true;
+                    break;
+                default:
+                    return;
+                }
+
+                auto advertisement = args.Advertisement();
+                if (advertisement)
+                {
+                    // Get name
+                    packet.name = advertisement.LocalName();
+
+                    // Get services
+                    auto serv = advertisement.ServiceUuids();
+                    if (serv)
+                    {
+                        packet.services.reserve(serv.Size());
+                        for (const auto& uuid : serv)
+                        {
+                            packet.services.push_back(uuid);
+                        }
+                    }
+
+                    // Get manufacturer-specific data sections
+                    auto manufDataList = advertisement.ManufacturerData();
+                    if (manufDataList)
+                    {
+                        packet.manufacturersData.reserve(manufDataList.Size());
+                        for (const auto& manuf : manufDataList)
+                        {
+                            packet.manufacturersData.emplace_back(manuf.CompanyId(), Internal::dataBufferToBytesVector(manuf.Data()));
+                        }
+                    }
+
+                    // Get raw data sections
+                    auto advDataList = advertisement.DataSections();
+                    if (advDataList)
+                    {
+                        packet.dataSections.reserve(advDataList.Size());
+                        for (const auto& adv : advDataList)
+                        {
+                            packet.dataSections.emplace_back(adv.DataType(), Internal::dataBufferToBytesVector(adv.Data()));
+                        }
+                    }
+                }
+
+                // Get TX power
+                if (args.TransmitPowerLevelInDBm())
+                {
+                    packet.txPowerLevel = args.TransmitPowerLevelInDBm().Value();
+                }
+
+                _onAdvertisement(packet);
+            }
+
+            // Called by the watcher when scanning is stopped
+            void onStopped(
+                BluetoothLEAdvertisementWatcher const& /*watcher*/,
+                BluetoothLEAdvertisementWatcherStoppedEventArgs const& /*args*/)
+            {
+            }
+        };
+    }
+
+    Systemic::Internal::AwaitableResult<std::shared_ptr<BleDeviceBackend>> WinRTBackend::requestOpenDevice(bluetooth_address_t address)
+    {
+        // Those 2 requests will succeed as long as the device was previously scanned,
+        // even if it's presently not reachable
+        auto device = co_await BluetoothLEDevice::FromBluetoothAddressAsync(address);
+        if (!device)
+        {
+            co_return nullptr;
+        }
+        auto session = co_await GattSession::FromDeviceIdAsync(device.BluetoothDeviceId());
+        if (!session)
+        {
+            co_return nullptr;
+        }
+        co_return std::make_shared<WinRTDevice>(device, session);
+    }
+
+    std::unique_ptr<BleScanBackend> WinRTBackend::startScan(std::function<void(const AdvertisementPacket&)> onAdvertisement)
+    {
+        return std::make_unique<WinRTScan>(std::move(onAdvertisement));
+    }
+}
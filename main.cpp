@@ -3,9 +3,18 @@
 #include <sstream>
 #include <iomanip>
 #include <thread>
+#include <algorithm>
+#include <map>
+#ifdef _WIN32
+#include <tlhelp32.h>
+#else
+#include <filesystem>
+#endif
 
+#include "Systemic/BluetoothLE/SimulatedBackend.h"
 #include "Systemic/Pixels/PixelScanner.h"
 #include "Systemic/Pixels/Pixel.h"
+#include "Systemic/Pixels/SimulatedPixelModel.h"
 
 using namespace Systemic::Pixels;
 using namespace Systemic::Pixels::Messages;
@@ -79,18 +88,18 @@ struct MyDelegate : PixelDelegate
     //}
 };
 
-// Future that connects to a Pixels die and make it blink
-std::future<void> connectAndBlink(std::shared_ptr<Pixel> pixel)
+// Connects to a Pixels die and make it blink, blocks until done
+void connectAndBlink(std::shared_ptr<Pixel> pixel)
 {
     std::cout << "\nConnecting...";
 
     // Attempts to connect
-    auto result = co_await pixel->connectAsync();
+    auto result = pixel->connectAsync().get();
     // Check result
     if (result != Pixel::ConnectResult::Success)
     {
         // If it failed, try a second time
-        result = co_await pixel->connectAsync();
+        result = pixel->connectAsync().get();
     }
 
     if (result == Pixel::ConnectResult::Success)
@@ -99,10 +108,10 @@ std::future<void> connectAndBlink(std::shared_ptr<Pixel> pixel)
         std::cout << "\nConnected and ready to use!";
 
         // Get RSSI notifications from die
-        co_await pixel->reportRssiAsync();
+        pixel->reportRssiAsync().get();
 
         // Make die blink
-        co_await pixel->blinkAsync(3s, 0xFF0000, 3);
+        pixel->blinkAsync(3s, 0xFF0000, 3).get();
 
         // Let's roll!
         std::cout << "\nRoll die to see results...";
@@ -114,10 +123,190 @@ std::future<void> connectAndBlink(std::shared_ptr<Pixel> pixel)
     }
 }
 
-// Program entry point
-int main()
+// Returns the number of threads of this process
+size_t processThreadCount()
 {
+    size_t count = 0;
+#ifdef _WIN32
+    const auto processId = GetCurrentProcessId();
+    const auto snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPTHREAD, 0);
+    if (snapshot != INVALID_HANDLE_VALUE)
+    {
+        THREADENTRY32 entry{};
+        entry.dwSize = sizeof(entry);
+        for (auto found = Thread32First(snapshot, &entry); found; found = Thread32Next(snapshot, &entry))
+        {
+            if (entry.th32OwnerProcessID == processId)
+            {
+                ++count;
+            }
+        }
+        CloseHandle(snapshot);
+    }
+#else
+    std::error_code error{};
+    for (std::filesystem::directory_iterator it{ "/proc/self/task", error }, end{}; it != end; it.increment(error))
+    {
+        ++count;
+    }
+#endif
+    return count;
+}
+
+// Latencies and thread usage of a batch of requests started at once
+struct BatchStats
+{
+    size_t succeededCount{};
+    std::vector<std::chrono::steady_clock::duration> latencies{};
+    size_t peakThreads{};
+};
+
+// Polls for the completion of the requests without awaiting them, so the only threads are the library ones
+template <typename T, typename Pred>
+BatchStats pollRequests(std::vector<std::future<T>>& requests, std::chrono::steady_clock::time_point startTime, Pred isSuccess)
+{
+    BatchStats stats{};
+    stats.latencies.resize(requests.size());
+    stats.peakThreads = processThreadCount();
+    std::vector<bool> completed(requests.size());
+    size_t pendingCount = requests.size();
+    for (int poll = 0; pendingCount; ++poll)
+    {
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            if (!completed[i] && requests[i].wait_for(0s) == std::future_status::ready)
+            {
+                completed[i] = true;
+                stats.latencies[i] = std::chrono::steady_clock::now() - startTime;
+                stats.succeededCount += isSuccess(requests[i].get()) ? 1 : 0;
+                --pendingCount;
+            }
+        }
+        if (poll % 10 == 0)
+        {
+            stats.peakThreads = std::max(stats.peakThreads, processThreadCount());
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    std::sort(stats.latencies.begin(), stats.latencies.end());
+    return stats;
+}
+
+// Outputs the latencies and thread usage of a batch of requests
+void printBatchStats(const BatchStats& stats, size_t idleThreads)
+{
+    const auto toMs = [](std::chrono::steady_clock::duration duration)
+    {
+        return std::chrono::duration_cast<std::chrono::duration<double, std::milli>>(duration).count();
+    };
+    const auto& latencies = stats.latencies;
+    if (!latencies.empty())
+    {
+        std::cout << std::fixed << std::setprecision(1)
+            << "Latency: median " << toMs(latencies[latencies.size() / 2])
+            << "ms, 95th percentile " << toMs(latencies[latencies.size() * 95 / 100])
+            << "ms, max " << toMs(latencies.back()) << "ms\n";
+    }
+    std::cout << "Threads: " << idleThreads << " idle, " << stats.peakThreads << " peak\n";
+}
+
+// Connects to the given number of simulated dice all at once, then sends them an identify request
+// all at once and outputs for both the requests latency and the number of threads in use
+void runIdentifyBenchmark(size_t diceCount)
+{
+    using namespace Systemic::BluetoothLE;
+    using std::chrono::steady_clock;
+
+    SimulatedBackendOptions options{};
+    options.peripheralCount = diceCount;
+    options.latencyJitter = 5ms;
+    BleBackend::setDefault(SimulatedBackend::create(options, std::make_shared<SimulatedPixelModel>(0, 0))); // Dice don't roll
+
+    // Find the dice
+    std::mutex mutex{};
+    std::map<uint32_t, std::shared_ptr<Pixel>> pixelsById{};
+    {
+        PixelScanner scanner{ [&mutex, &pixelsById](auto scannedPixel)
+            {
+                std::lock_guard lock{ mutex };
+                if (pixelsById.find(scannedPixel->pixelId()) == pixelsById.end())
+                {
+                    pixelsById.emplace(scannedPixel->pixelId(), Pixel::create(*scannedPixel, nullptr));
+                }
+            }
+        };
+        scanner.start();
+        const auto scanEnd = steady_clock::now() + 10s;
+        while (steady_clock::now() < scanEnd)
+        {
+            std::this_thread::sleep_for(50ms);
+            std::lock_guard lock{ mutex };
+            if (pixelsById.size() >= diceCount)
+            {
+                break;
+            }
+        }
+    }
+    std::vector<std::shared_ptr<Pixel>> pixels{};
+    {
+        std::lock_guard lock{ mutex };
+        for (auto& [id, pixel] : pixelsById)
+        {
+            pixels.push_back(pixel);
+        }
+    }
+
+    // Connect to all of them at once
+    const size_t idleThreads = processThreadCount();
+    std::vector<std::future<Pixel::ConnectResult>> connections{};
+    auto startTime = steady_clock::now();
+    for (auto& pixel : pixels)
+    {
+        connections.push_back(pixel->connectAsync());
+    }
+    const auto connectStats = pollRequests(connections, startTime,
+        [](auto result) { return result == Pixel::ConnectResult::Success; });
+    std::cout << "Connected to " << connectStats.succeededCount << " out of " << diceCount << " dice\n";
+    printBatchStats(connectStats, idleThreads);
+
+    // Send all the identify requests at once
+    std::vector<std::future<std::shared_ptr<const PixelMessage>>> requests{};
+    startTime = steady_clock::now();
+    for (auto& pixel : pixels)
+    {
+        requests.push_back(pixel->sendAndWaitForResponseAsync(MessageType::WhoAreYou, MessageType::IAmADie));
+    }
+    const auto identifyStats = pollRequests(requests, startTime,
+        [](const auto& response) { return response != nullptr; });
+    std::cout << "Identified " << identifyStats.succeededCount << " out of " << requests.size() << " dice\n";
+    printBatchStats(identifyStats, idleThreads);
+
+    for (auto& pixel : pixels)
+    {
+        pixel->disconnect();
+    }
+    BleBackend::setDefault(nullptr);
+}
+
+// Program entry point, run with --simulate to use simulated dice,
+// or with --benchmark [count] to time connections and identify requests to simulated dice at once
+int main(int argc, char* argv[])
+{
+#ifdef _WIN32
     winrt::init_apartment();
+#endif
+
+    if (argc > 1 && std::string{ argv[1] } == "--benchmark")
+    {
+        runIdentifyBenchmark(argc > 2 ? std::stoul(argv[2]) : 30);
+        return 0;
+    }
+
+    if (argc > 1 && std::string{ argv[1] } == "--simulate")
+    {
+        using namespace Systemic::BluetoothLE;
+        BleBackend::setDefault(SimulatedBackend::create(SimulatedBackendOptions{}, std::make_shared<SimulatedPixelModel>()));
+    }
 
     // Shared states
     std::mutex mutex{};
@@ -157,7 +346,7 @@ int main()
                     pixel = Pixel::create(*scannedPixel, delegate);
 
                     // And connect to it on a new thread so to not block the scanner
-                    connectThread = std::thread([pixel]() { connectAndBlink(pixel).get(); });
+                    connectThread = std::thread([pixel]() { connectAndBlink(pixel); });
                 }
             }
         }
@@ -167,7 +356,11 @@ int main()
     scanner.start();
 
     // Wait for user to press a key
+#ifdef _WIN32
     std::system("pause");
+#else
+    std::cin.get(); // Terminal input is line buffered
+#endif
     std::cout << "\nBye!";
     if (connectThread.joinable())
     {
@@ -219,7 +412,11 @@ std::string serializeTimePoint(const std::chrono::system_clock::time_point& time
     std::time_t tt = std::chrono::system_clock::to_time_t(time);
     //std::tm tm = *std::gmtime(&tt); //GMT (UTC)
     std::tm tm;
+#ifdef _WIN32
     localtime_s(&tm, &tt); //Locale time-zone, usually UTC by default.
+#else
+    localtime_r(&tt, &tm);
+#endif
     std::stringstream ss{};
     ss << std::put_time(&tm, format.c_str());
     return ss.str();
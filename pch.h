@@ -1,5 +1,7 @@
 ﻿#pragma once
 
+#ifdef _WIN32
+
 // Exclude rarely-used stuff from Windows headers
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
@@ -28,6 +30,8 @@
 #include <winrt/Windows.Devices.Radios.h>
 #include <winrt/Windows.Storage.Streams.h>
 
+#endif
+
 // Standard C++ headers
 #include <cassert>
 #include <cstdint>
@@ -38,8 +42,10 @@
 #include <future>
 #include <mutex>
 
+#ifdef _WIN32
 // Windows Header Files
 #include <windows.h>
+#endif
 
 // Systemic headers
 #include "Systemic/Internal/Utils.h"